@@ -10,24 +10,31 @@ document.querySelectorAll('nav a').forEach(link => {
     });
 });
 
-// Chart initialization
+// The live port keeps connections open, so the event stream and repeated
+// API reads don't cost a new TCP connection each
+const LIVE_BASE = `${location.protocol}//${location.hostname}:81`;
+
+// Chart initialization. Points are {x: time, y: value} with time in
+// seconds of controller local time, formatted as UTC so it reads as such.
 const ctx = document.getElementById('sensorChart').getContext('2d');
 const sensorChart = new Chart(ctx, {
     type: 'line',
     data: {
-        labels: [],
         datasets: [{
             label: 'Temperature',
+            channel: 'temperature',
             data: [],
             borderColor: 'rgb(255, 99, 132)',
             tension: 0.1
         }, {
             label: 'pH',
+            channel: 'ph',
             data: [],
             borderColor: 'rgb(54, 162, 235)',
             tension: 0.1
         }, {
             label: 'DO',
+            channel: 'dissolvedOxygen',
             data: [],
             borderColor: 'rgb(75, 192, 192)',
             tension: 0.1
@@ -35,7 +42,17 @@ const sensorChart = new Chart(ctx, {
     },
     options: {
         responsive: true,
+        animation: false,
+        elements: {
+            point: { radius: 0 }
+        },
         scales: {
+            x: {
+                type: 'linear',
+                ticks: {
+                    callback: (value) => new Date(value * 1000).toISOString().substring(11, 16)
+                }
+            },
             y: {
                 beginAtZero: true
             }
@@ -43,39 +60,193 @@ const sensorChart = new Chart(ctx, {
     }
 });
 
-// Network and sensor data updates
-async function updateSensorData() {
-    try {
-        const response = await fetch('/api/sensors');
-        const data = await response.json();
-        
-        // Update each sensor value
-        Object.keys(data).forEach(sensorId => {
-            const element = document.getElementById(sensorId);
-            if (element) {
-                element.textContent = data[sensorId];
+// Binary telemetry (Accept: application/vnd.orc.telemetry). Records are
+// packed little-endian, see TelemetryHeader and friends in sys_init.h.
+const TELEMETRY_VERSION = 1;
+const TELEMETRY_STATE = 1;
+const TELEMETRY_HISTORY = 2;
+
+function decodeTelemetry(buffer) {
+    const view = new DataView(buffer);
+    let offset = 0;
+    const u8 = () => view.getUint8(offset++);
+    const u16 = () => { const v = view.getUint16(offset, true); offset += 2; return v; };
+    const u32 = () => { const v = view.getUint32(offset, true); offset += 4; return v; };
+    const f32 = () => { const v = view.getFloat32(offset, true); offset += 4; return v; };
+    const sensor = () => ({ value: f32(), online: u8() !== 0 });
+    const pid = () => ({ setpoint: f32(), enabled: u8() !== 0, kp: f32(), ki: f32(), kd: f32() });
+    const duty = () => ({ period: f32(), duty: f32(), enabled: u8() !== 0 });
+
+    if (u8() !== 0x4F || u8() !== 0x52) throw new Error('Not a telemetry record');
+    const version = u8();
+    if (version !== TELEMETRY_VERSION) throw new Error(`Unsupported telemetry version ${version}`);
+    const type = u8();
+    u32(); // Length
+
+    if (type === TELEMETRY_HISTORY) {
+        const history = { ch: u8(), resolution: u32(), t: [], mean: [], min: [], max: [] };
+        const count = u16();
+        for (let i = 0; i < count; i++) {
+            history.t.push(u32());
+            history.mean.push(f32());
+            history.min.push(f32());
+            history.max.push(f32());
+        }
+        return history;
+    }
+    if (type === TELEMETRY_STATE) {
+        const state = { version: u32(), time: u32(), sensors: {}, controls: {}, power: {}, link: {} };
+        state.sensors.power = { volts: f32(), amps: f32(), watts: f32(), online: u8() !== 0 };
+        for (const name of ['temperature', 'ph', 'dissolvedOxygen', 'opticalDensity', 'gasFlow',
+                            'pressure', 'stirrerSpeed', 'weight']) {
+            state.sensors[name] = sensor();
+        }
+        state.controls.temperature = pid();
+        state.controls.ph = { setpoint: f32(), enabled: u8() !== 0, period: f32(), maxDoseTime: f32() };
+        state.controls.dissolvedOxygen = { setpoint: f32(), enabled: u8() !== 0 };
+        state.controls.gasFlow = pid();
+        state.controls.stirrerSpeed = pid();
+        state.controls.pumpSpeed = { percent: f32() };
+        state.controls.feed = duty();
+        state.controls.waste = duty();
+        state.power = { mainVoltage: f32(), v20Voltage: f32(), v5Voltage: f32() };
+        const ok = u8();
+        state.power.mainVoltageOK = (ok & 1) !== 0;
+        state.power.v20VoltageOK = (ok & 2) !== 0;
+        state.power.v5VoltageOK = (ok & 4) !== 0;
+        state.link.connected = u8() !== 0;
+        state.link.ip = [u8(), u8(), u8(), u8()].join('.');
+        return state;
+    }
+    throw new Error(`Unknown telemetry record type ${type}`);
+}
+
+// Sensor history, downsampled by the controller to about one point per two
+// pixels of chart width
+const HISTORY_REFRESH_INTERVAL = 60000;
+
+async function loadHistory() {
+    const points = Math.min(400, Math.max(50, Math.round(sensorChart.width / 2)));
+    for (const dataset of sensorChart.data.datasets) {
+        try {
+            const response = await fetch(`${LIVE_BASE}/api/bin/history?ch=${dataset.channel}&points=${points}`, {
+                headers: { 'Accept': 'application/vnd.orc.telemetry' }
+            });
+            if (!response.ok) {
+                throw new Error(`HTTP error! status: ${response.status}`);
             }
-        });
-    } catch (error) {
-        console.error('Error updating sensor data:', error);
+            const history = decodeTelemetry(await response.arrayBuffer());
+            dataset.data = history.t.map((t, i) => ({ x: t, y: history.mean[i] }));
+        } catch (error) {
+            console.error(`Error loading ${dataset.channel} history:`, error);
+        }
     }
+    sensorChart.update();
 }
 
-async function updateNetworkInfo() {
+// Debug output kept by the controller, tailed with a cursor so each poll only
+// returns the lines added since the last one. Polls while the page is shown.
+const LOG_POLL_INTERVAL = 2000;
+const LOG_MAX_LINES = 1000;
+let logCursor = null;
+let logPolling = false;
+let logGeneration = 0;  // Bumped when the view is cleared, so a poll in flight is discarded
+
+function logPageVisible() {
+    return document.getElementById('logs').classList.contains('active') && !document.hidden;
+}
+
+function appendLogLine(className, text, time) {
+    const view = document.getElementById('logView');
+    const atBottom = view.scrollTop + view.clientHeight >= view.scrollHeight - 5;
+    const line = document.createElement('div');
+    line.className = className;
+    if (time !== undefined) {
+        const stamp = document.createElement('span');
+        stamp.className = 'time';
+        stamp.textContent = new Date(time).toISOString().substring(0, 23).replace('T', ' ');
+        line.appendChild(stamp);
+    }
+    line.appendChild(document.createTextNode(text));
+    view.appendChild(line);
+    while (view.childElementCount > LOG_MAX_LINES) view.firstChild.remove();
+    if (atBottom) view.scrollTop = view.scrollHeight;
+}
+
+async function pollLogs() {
+    if (!logPageVisible() || logPolling) return;
+    logPolling = true;
+    const generation = logGeneration;
+    const level = document.getElementById('logLevel').value;
+    const since = logCursor === null ? '' : `&since=${logCursor}`;
     try {
-        const response = await fetch('/api/network');
-        const settings = await response.json();
-        const currentIPElement = document.getElementById('currentIP');
-        const macAddressElement = document.getElementById('macAddress');
-        
-        if (currentIPElement) {
-            currentIPElement.textContent = settings.ip || 'Not Connected';
+        const response = await fetch(`${LIVE_BASE}/api/logs?level=${level}${since}`);
+        if (!response.ok) {
+            throw new Error(`HTTP error! status: ${response.status}`);
+        }
+        const logs = await response.json();
+        if (generation !== logGeneration) return;
+        if (logs.missed > 0 && logCursor !== null) {
+            appendLogLine('log-gap', `... ${logs.missed} lines no longer kept by the controller`);
         }
-        if (macAddressElement) {
-            macAddressElement.textContent = settings.mac || '';
+        for (const entry of logs.entries) {
+            appendLogLine(`log-line ${entry.level.toLowerCase()}`, `[${entry.level}] ${entry.text}`, entry.time);
         }
+        logCursor = logs.next;
     } catch (error) {
-        console.error('Error updating network info:', error);
+        console.error('Error loading logs:', error);
+    } finally {
+        if (generation === logGeneration) logPolling = false;
+    }
+}
+
+function restartLogs() {
+    logGeneration++;
+    logPolling = false;
+    logCursor = null;
+    document.getElementById('logView').replaceChildren();
+    pollLogs();
+}
+
+// Live updates pushed by the controller over Server-Sent Events. The first
+// event carries the full state, later ones only the groups that changed.
+function connectLiveUpdates() {
+    const source = new EventSource(`${LIVE_BASE}/events`);
+    source.addEventListener('state', (e) => {
+        try {
+            const state = JSON.parse(e.data);
+            if (state.time) updateLiveClock(state.time);
+            if (state.sensors) updateSensorData(state.sensors);
+            if (state.power) updatePowerStatus(state.power);
+            if (state.network) updateNetworkInfo(state.network);
+        } catch (error) {
+            console.error('Error handling live update:', error);
+        }
+    });
+    // EventSource reconnects by itself, the server then sends a full snapshot
+    source.onerror = () => console.warn('Live update stream interrupted, reconnecting');
+}
+
+// Network and sensor data updates
+function updateSensorData(data) {
+    // Update each sensor value
+    Object.keys(data).forEach(sensorId => {
+        const element = document.getElementById(sensorId);
+        if (element) {
+            element.textContent = data[sensorId];
+        }
+    });
+}
+
+function updateNetworkInfo(settings) {
+    const currentIPElement = document.getElementById('currentIP');
+    const macAddressElement = document.getElementById('macAddress');
+    
+    if (currentIPElement) {
+        currentIPElement.textContent = settings.ip || 'Not Connected';
+    }
+    if (macAddressElement) {
+        macAddressElement.textContent = settings.mac || '';
     }
 }
 
@@ -116,14 +287,10 @@ async function saveTimeSettings() {
 }
 
 // Update live clock display
-async function updateLiveClock() {
+function updateLiveClock(data) {
     const clockElement = document.getElementById('liveClock');
     if (clockElement) {
         try {
-            const response = await fetch('/api/time');
-            const data = await response.json();
-            console.log('Time data received:', data);
-
             if (data.date && data.time && data.timezone) {
                 const isoDateTime = `${data.date}T${data.time}${data.timezone}`;
 
@@ -227,9 +394,12 @@ document.addEventListener('DOMContentLoaded', () => {
     loadInitialSettings();  // Load initial NTP and timezone settings
     loadNetworkSettings();  // Load initial network settings
     loadMqttSettings();    // Load initial MQTT settings
-    updateLiveClock();
-    updateSensorData();
-    updateNetworkInfo();
+    connectLiveUpdates();  // Clock, sensor, power and network info are pushed from here on
+    loadHistory();
+    setInterval(loadHistory, HISTORY_REFRESH_INTERVAL);
+    setInterval(pollLogs, LOG_POLL_INTERVAL);
+    document.getElementById('logLevel').addEventListener('change', restartLogs);
+    document.querySelector('nav a[data-page="logs"]').addEventListener('click', pollLogs);
     
     // Set up event listeners
     const ntpCheckbox = document.getElementById('enableNTP');
@@ -258,17 +428,9 @@ document.addEventListener('DOMContentLoaded', () => {
     }
 });
 
-// Update intervals
-setInterval(updateLiveClock, 1000);    // Update clock every second
-setInterval(updateSensorData, 1000);   // Update sensor data every second
-setInterval(updateNetworkInfo, 5000);  // Update network info every 5 seconds
-
 // Update power supply status
-async function updatePowerStatus() {
+function updatePowerStatus(data) {
     try {
-        const response = await fetch('/api/power');
-        const data = await response.json();
-        
         // Update main voltage
         document.getElementById('mainVoltage').textContent = data.mainVoltage.toFixed(1) + 'V';
         const mainStatus = document.getElementById('mainVoltageStatus');
@@ -291,9 +453,6 @@ async function updatePowerStatus() {
     }
 }
 
-// Add power status update to the periodic updates
-setInterval(updatePowerStatus, 1000);
-
 // Network settings handling
 document.getElementById('networkForm').addEventListener('submit', async function(e) {
     e.preventDefault();
@@ -0,0 +1,352 @@
+#include "DataLogger.h"
+
+#include <math.h>
+#include <time.h>
+
+static void clearRange(LogChannelRange &range) {
+    for (uint8_t ch = 0; ch < LOG_MAX_CHANNELS; ch++) {
+        range.min[ch] = INFINITY;
+        range.max[ch] = -INFINITY;
+    }
+}
+
+static void mergeRange(LogChannelRange &range, const LogChannelRange &from) {
+    for (uint8_t ch = 0; ch < LOG_MAX_CHANNELS; ch++) {
+        if (from.min[ch] < range.min[ch]) range.min[ch] = from.min[ch];
+        if (from.max[ch] > range.max[ch]) range.max[ch] = from.max[ch];
+    }
+}
+
+const uint32_t DataLogger::latencyBounds[LOG_LATENCY_BUCKETS] = {
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000
+};
+
+DataLogger::DataLogger(SPIClass &spi, uint8_t csPin, uint8_t cdPin)
+    : _spi(spi), _csPin(csPin), _cdPin(cdPin) {}
+
+void DataLogger::begin(const char *const *channelNames, uint8_t numChannels) {
+    _channelNames = channelNames;
+    _numChannels = numChannels > LOG_MAX_CHANNELS ? LOG_MAX_CHANNELS : numChannels;
+    _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+    pinMode(_cdPin, INPUT_PULLUP);
+    _lastMountAttempt = millis() - LOG_MOUNT_RETRY_INTERVAL;
+    startBuffer();
+}
+
+bool DataLogger::log(uint32_t time, uint8_t channel, float value) {
+    if (channel >= LOG_MAX_CHANNELS) return false;
+    const LogRecord record = {time, channel, value};
+    if (!_queue.push(record)) {
+        _stats.dropped++;
+        return false;
+    }
+    _stats.samples++;
+    return true;
+}
+
+bool DataLogger::cardPresent() const {
+    return digitalRead(_cdPin) == LOW;
+}
+
+bool DataLogger::lock(TickType_t timeout) {
+    return _mutex != NULL && xSemaphoreTake(_mutex, timeout) == pdTRUE;
+}
+
+void DataLogger::unlock() {
+    xSemaphoreGive(_mutex);
+}
+
+void DataLogger::service() {
+    fill();
+    if (!lock(portMAX_DELAY)) return;
+
+    bool present = cardPresent();
+    if (!present) _ejected = false;
+    if (_ejectRequested) {
+        _ejectRequested = false;
+        if (_mounted) {
+            closeFile();
+            if (_mounted) unmount();
+            _ejected = true;
+        }
+    }
+    if (_mounted && !present) unmount();
+    if (!_mounted && present && !_ejected && millis() - _lastMountAttempt >= LOG_MOUNT_RETRY_INTERVAL) {
+        _lastMountAttempt = millis();
+        mount();
+    }
+
+    // Rotate before the full buffer goes in, while the file still has room
+    // for it, the buffer being filled, the last index block and the footer
+    if (_mounted && _pending && _fileOpen && rotationDue()) closeFile();
+
+    // The full buffer holds the older samples, so it goes first
+    if (_mounted && _pending) {
+        if (writeBlocks(_fillBuffer ^ 1, LOG_BUFFER_BLOCKS) && commitBlocks(_fillBuffer ^ 1, LOG_BUFFER_BLOCKS)) {
+            _pending = false;
+        }
+    }
+
+    // Write what there is of the buffer being filled every so often, so a
+    // power loss costs at most LOG_SYNC_INTERVAL of data. The same blocks are
+    // written again, at the same place, as they fill up. The file's directory
+    // entry already covers them, so only the card needs flushing.
+    if (_mounted && !_pending && millis() - _lastSync >= LOG_SYNC_INTERVAL) {
+        _lastSync = millis();
+        uint32_t numBlocks = filledBlocks();
+        if ((numBlocks == 0 || writeBlocks(_fillBuffer, numBlocks)) && _fileOpen) {
+            uint32_t start = micros();
+            if (_sd.card()->syncDevice()) recordLatency(_stats.dataWrites, start);
+            else {
+                _stats.writeErrors++;
+                unmount();
+            }
+        }
+    }
+
+    unlock();
+    fill();
+}
+
+// Move queued samples into the buffers, stopping when both are full
+void DataLogger::fill() {
+    while (true) {
+        if (!_holding) {
+            if (!_queue.pop(_held)) return;
+            _holding = true;
+        }
+        if (_encoder.add(_held)) {
+            BufferSummary &summary = _summary[_fillBuffer];
+            if (_held.value < summary.range.min[_held.channel]) summary.range.min[_held.channel] = _held.value;
+            if (_held.value > summary.range.max[_held.channel]) summary.range.max[_held.channel] = _held.value;
+            summary.lastTime = _held.time;
+            _holding = false;
+            continue;
+        }
+
+        // The block is full, start the next one, or the other buffer once
+        // it has been written
+        if (_fillBlocks < LOG_BUFFER_BLOCKS) {
+            _encoder.begin(&_buffers[_fillBuffer][_fillBlocks++]);
+            continue;
+        }
+        if (_pending) return;
+        _pending = true;
+        _fillBuffer ^= 1;
+        startBuffer();
+    }
+}
+
+void DataLogger::startBuffer() {
+    _fillBlocks = 1;
+    _encoder.begin(&_buffers[_fillBuffer][0]);
+    clearRange(_summary[_fillBuffer].range);
+}
+
+// Blocks of the buffer being filled that hold records
+uint32_t DataLogger::filledBlocks() const {
+    return _encoder.count() > 0 ? _fillBlocks : _fillBlocks - 1;
+}
+
+bool DataLogger::mount() {
+    if (!_sd.begin(sdfat::SdSpiConfig(_csPin, DEDICATED_SPI, LOG_SPI_CLOCK, &_spi))) return false;
+    if (_sd.fatType() == FAT_TYPE_EXFAT || (!_sd.exists(LOG_DIRECTORY) && !_sd.mkdir(LOG_DIRECTORY))) {
+        _sd.end();
+        return false;
+    }
+    _mounted = true;
+    return true;
+}
+
+void DataLogger::unmount() {
+    if (_fileOpen) _file.close();
+    _fileOpen = false;
+    _fileName[0] = '\0';
+    _sd.end();
+    _mounted = false;
+    _generation++;
+}
+
+// Start a new file named after the time of its first sample, allocated in
+// one contiguous run of sectors
+bool DataLogger::openFile(uint32_t time) {
+    time_t t = time;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    snprintf(_fileName, sizeof(_fileName), LOG_DIRECTORY "/%04d%02d%02d-%02d%02d%02d" LOG_FILE_EXTENSION,
+             tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    uint32_t start = micros();
+    if (!_file.open(_fileName, O_RDWR | O_CREAT | O_TRUNC)) {
+        _fileName[0] = '\0';
+        return false;
+    }
+
+    // As large as the free space allows
+    uint32_t size = LOG_FILE_SIZE;
+    while (!_file.preAllocate(size)) {
+        size /= 2;
+        if (size < LOG_FILE_MIN_SIZE) {
+            _file.close();
+            _sd.remove(_fileName);
+            _fileName[0] = '\0';
+            return false;
+        }
+    }
+    uint32_t firstSector, lastSector;
+    if (!_file.contiguousRange(&firstSector, &lastSector)) {
+        _file.close();
+        _fileName[0] = '\0';
+        return false;
+    }
+    _firstSector = firstSector;
+    _fileBlocks = size / LOG_BLOCK_SIZE;
+    _fileId = micros() ^ (time * 2654435761u);
+
+    LogFileHeader header = {};
+    memcpy(header.magic, "ORCLOG", sizeof(header.magic));
+    header.version = LOG_FORMAT_VERSION;
+    header.created = time;
+    header.fileId = _fileId;
+    header.blockSize = LOG_BLOCK_SIZE;
+    header.indexInterval = LOG_INDEX_INTERVAL;
+    header.numChannels = _numChannels;
+    for (uint8_t ch = 0; ch < _numChannels; ch++) {
+        strncpy(header.channels[ch], _channelNames[ch], LOG_CHANNEL_NAME_SIZE - 1);
+    }
+    // The directory entry, with the file at its full size, goes out now and
+    // is not touched again until the file is closed
+    if (!_sd.card()->writeSector(_firstSector, (const uint8_t *)&header) || !_file.sync()) {
+        _file.close();
+        _fileName[0] = '\0';
+        return false;
+    }
+    recordLatency(_stats.fileUpdates, start);
+
+    _fileOpen = true;
+    _dataBlocks = 0;
+    _index.blocks = 0;
+    memset(&_footer, 0, sizeof(_footer));
+    _footer.magic = LOG_FOOTER_MAGIC;
+    _footer.fileId = _fileId;
+    _footer.firstTime = time;
+    _footer.lastTime = time;
+    clearRange(_footer.range);
+    _stats.files++;
+    return true;
+}
+
+// The file can't take another two buffers, or holds a day of samples
+bool DataLogger::rotationDue() const {
+    return logDataBlockPosition(_dataBlocks + 2 * LOG_BUFFER_BLOCKS) + 2 > _fileBlocks ||
+           _footer.lastTime - _footer.firstTime >= LOG_ROTATE_INTERVAL;
+}
+
+// Write everything still buffered, the last index block and the footer
+void DataLogger::closeFile() {
+    if (!_fileOpen) return;
+    if (_pending) {
+        if (!writeBlocks(_fillBuffer ^ 1, LOG_BUFFER_BLOCKS) || !commitBlocks(_fillBuffer ^ 1, LOG_BUFFER_BLOCKS)) return;
+        _pending = false;
+    }
+    uint32_t numBlocks = filledBlocks();
+    if (numBlocks > 0) {
+        if (!writeBlocks(_fillBuffer, numBlocks) || !commitBlocks(_fillBuffer, numBlocks)) return;
+        startBuffer();
+    }
+
+    uint32_t end = logDataBlockPosition(_dataBlocks);
+    if (_index.blocks > 0) {
+        end = logIndexBlockPosition(_index.group);
+        if (!writeBlock(end++, &_index)) return;
+        mergeRange(_footer.range, _index.range);
+    }
+    _footer.dataBlocks = _dataBlocks;
+    if (!writeBlock(end, &_footer)) return;
+
+    // Give back the unused part of the allocation, the second and last
+    // directory update of the file
+    uint32_t start = micros();
+    if (!_file.truncate((uint64_t)(end + 1) * LOG_BLOCK_SIZE) || !_file.close()) _stats.writeErrors++;
+    else recordLatency(_stats.fileUpdates, start);
+    _fileOpen = false;
+    _fileName[0] = '\0';
+}
+
+// Write the first blocks of a buffer as the next data blocks of the file.
+// On failure the card is unmounted and the buffer kept, to go in a new file
+// once the card is back.
+bool DataLogger::writeBlocks(uint8_t buffer, uint32_t numBlocks) {
+    LogBlock *blocks = _buffers[buffer];
+    if (!_fileOpen && !openFile(blocks[0].header.firstTime)) {
+        _stats.writeErrors++;
+        unmount();
+        return false;
+    }
+
+    // The encoder has filled in the rest of the headers
+    for (uint32_t i = 0; i < numBlocks; i++) {
+        blocks[i].header.magic = LOG_BLOCK_MAGIC;
+        blocks[i].header.sequence = _dataBlocks + i;
+        blocks[i].header.fileId = _fileId;
+    }
+
+    // Buffers never span two groups, so the blocks are contiguous in the file
+    uint32_t start = micros();
+    if (!_sd.card()->writeSectors(_firstSector + logDataBlockPosition(_dataBlocks), (const uint8_t *)blocks, numBlocks)) {
+        _stats.writeErrors++;
+        unmount();
+        return false;
+    }
+    recordLatency(_stats.dataWrites, start);
+    _stats.blocksWritten += numBlocks;
+    return true;
+}
+
+// Account for written data blocks in the index, writing the index block
+// once a group is complete
+bool DataLogger::commitBlocks(uint8_t buffer, uint32_t numBlocks) {
+    if (_index.blocks == 0) {
+        memset(&_index, 0, sizeof(_index));
+        _index.magic = LOG_INDEX_MAGIC;
+        _index.group = _dataBlocks / LOG_INDEX_INTERVAL;
+        _index.fileId = _fileId;
+        _index.firstTime = _buffers[buffer][0].header.firstTime;
+        clearRange(_index.range);
+    }
+    for (uint32_t i = 0; i < numBlocks; i++) {
+        _index.blockTime[_dataBlocks % LOG_INDEX_INTERVAL] = _buffers[buffer][i].header.firstTime;
+        _index.blocks++;
+        _dataBlocks++;
+    }
+    mergeRange(_index.range, _summary[buffer].range);
+    _index.lastTime = _summary[buffer].lastTime;
+    _footer.lastTime = _index.lastTime;
+
+    if (_dataBlocks % LOG_INDEX_INTERVAL == 0) {
+        if (!writeBlock(logIndexBlockPosition(_index.group), &_index)) return false;
+        mergeRange(_footer.range, _index.range);
+        _index.blocks = 0;
+    }
+    return true;
+}
+
+bool DataLogger::writeBlock(uint32_t position, const void *block) {
+    uint32_t start = micros();
+    if (!_sd.card()->writeSector(_firstSector + position, (const uint8_t *)block)) {
+        _stats.writeErrors++;
+        unmount();
+        return false;
+    }
+    recordLatency(_stats.dataWrites, start);
+    _stats.blocksWritten++;
+    return true;
+}
+
+void DataLogger::recordLatency(LogLatency &latency, uint32_t start) {
+    uint32_t us = micros() - start;
+    uint8_t bucket = 0;
+    while (bucket < LOG_LATENCY_BUCKETS && us > latencyBounds[bucket]) bucket++;
+    latency.counts[bucket]++;
+    latency.sumUs += us;
+    if (us > latency.maxUs) latency.maxUs = us;
+}
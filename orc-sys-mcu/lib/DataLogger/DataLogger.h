@@ -0,0 +1,193 @@
+#ifndef DATA_LOGGER_H
+#define DATA_LOGGER_H
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <SdFat.h>
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "LogFormat.h"
+#include "LogCodec.h"
+#include "SpscQueue.h"
+
+// Logs sensor samples to an SD card in the LogFormat.h block format.
+//
+// log() puts a sample on a lock-free queue and returns straight away, so the
+// code acquiring samples never waits for the card. service(), called from the
+// logger task, moves queued samples into one of two block buffers and writes
+// a buffer once it is full, as whole sector aligned blocks. While a full
+// buffer waits to be written (slow card, card removed) the other one keeps
+// filling, and the queue holds what arrives while a write is in progress.
+// Samples are only lost if both buffers and the queue fill up, which is
+// counted in stats().dropped.
+//
+// FAT updates are what make SD writes stall for hundreds of ms, so each file
+// is allocated contiguously at LOG_FILE_SIZE when it is created and its
+// blocks are then written straight to their card sectors, with no cluster
+// allocation or directory update along the way. The directory entry is only
+// written when a file is created and when it is closed and cut to length, at
+// rotation (LOG_FILE_SIZE full or LOG_ROTATE_INTERVAL of samples) or eject.
+// The periodic sync just flushes the card. FAT16/FAT32 only: exFAT keeps a
+// separate valid length that raw writes would not move.
+//
+// Other tasks may read the card (see LogReader) between lock() and unlock().
+
+#ifndef LOG_QUEUE_SIZE
+#define LOG_QUEUE_SIZE 1024             // Samples, a power of two
+#endif
+#ifndef LOG_BUFFER_BLOCKS
+#define LOG_BUFFER_BLOCKS 8             // Blocks per buffer, written in one go
+#endif
+#ifndef LOG_SYNC_INTERVAL
+#define LOG_SYNC_INTERVAL 10000         // ms between writes of the partly filled buffer
+#endif
+#ifndef LOG_FILE_SIZE
+#define LOG_FILE_SIZE (64UL << 20)      // Bytes allocated per file, halved down to LOG_FILE_MIN_SIZE if the card has no room
+#endif
+#ifndef LOG_FILE_MIN_SIZE
+#define LOG_FILE_MIN_SIZE (1UL << 20)
+#endif
+#ifndef LOG_ROTATE_INTERVAL
+#define LOG_ROTATE_INTERVAL 86400       // Seconds of samples per file
+#endif
+#ifndef LOG_MOUNT_RETRY_INTERVAL
+#define LOG_MOUNT_RETRY_INTERVAL 5000   // ms between attempts to mount the card
+#endif
+#ifndef LOG_SPI_CLOCK
+#define LOG_SPI_CLOCK 20000000
+#endif
+#ifndef LOG_DIRECTORY
+#define LOG_DIRECTORY "/log"
+#endif
+#ifndef LOG_FILE_EXTENSION
+#define LOG_FILE_EXTENSION ".orl"
+#endif
+#ifndef LOG_FILE_NAME_SIZE
+#define LOG_FILE_NAME_SIZE 40
+#endif
+
+static_assert(LOG_INDEX_INTERVAL % LOG_BUFFER_BLOCKS == 0, "A buffer must not span two index groups");
+
+#define LOG_LATENCY_BUCKETS 9
+
+// Histogram of how long card operations took, bucketed by
+// DataLogger::latencyBounds plus an overflow bucket
+struct LogLatency {
+    uint32_t counts[LOG_LATENCY_BUCKETS + 1];
+    uint32_t sumUs;         // Wraps
+    uint32_t maxUs;
+};
+
+struct DataLoggerStats {
+    uint32_t samples;       // Queued by log()
+    uint32_t dropped;       // Rejected by log() because the queue was full
+    uint32_t blocksWritten;
+    uint32_t writeErrors;
+    uint32_t files;         // Log files started
+    LogLatency dataWrites;  // Raw sector writes and card flushes
+    LogLatency fileUpdates; // Creating, allocating and closing files, the FAT and directory writes
+};
+
+class DataLogger {
+public:
+    // cdPin is the card detect switch, low while a card is inserted
+    DataLogger(SPIClass &spi, uint8_t csPin, uint8_t cdPin);
+
+    // Names are stored in each file header, channel numbers index into them
+    void begin(const char *const *channelNames, uint8_t numChannels);
+
+    // Queue a sample. Never blocks; only one task may call it.
+    bool log(uint32_t time, uint8_t channel, float value);
+
+    // Mount the card, move samples into the buffers and write them. Call
+    // regularly from a single task; may block for as long as the card takes.
+    void service();
+
+    // Close the file and unmount at the next service(), so the card can be
+    // removed without losing the buffered samples. Logging resumes once a
+    // card is inserted again.
+    void eject() { _ejectRequested = true; }
+
+    bool cardPresent() const;
+    bool logging() const { return _fileOpen; }
+    const char *fileName() const { return _fileName; }
+    size_t queued() const { return _queue.size(); }
+    const DataLoggerStats &stats() const { return _stats; }
+
+    // Upper bounds of the LogLatency buckets in µs
+    static const uint32_t latencyBounds[LOG_LATENCY_BUCKETS];
+
+    // Exclusive use of the card for reading. mounted() and generation() are
+    // only meaningful while it is held; generation() changes whenever the
+    // card is unmounted, invalidating any files opened before.
+    bool lock(TickType_t timeout);
+    void unlock();
+    bool mounted() const { return _mounted; }
+    uint32_t generation() const { return _generation; }
+    sdfat::SdFs &fs() { return _sd; }
+
+private:
+    bool mount();
+    void unmount();
+    bool openFile(uint32_t time);
+    void closeFile();
+    bool writeBlocks(uint8_t buffer, uint32_t numBlocks);
+    bool commitBlocks(uint8_t buffer, uint32_t numBlocks);
+    bool writeBlock(uint32_t position, const void *block);
+    bool rotationDue() const;
+    void recordLatency(LogLatency &latency, uint32_t start);
+    void fill();
+    void startBuffer();
+    uint32_t filledBlocks() const;
+
+    SPIClass &_spi;
+    uint8_t _csPin;
+    uint8_t _cdPin;
+    const char *const *_channelNames = nullptr;
+    uint8_t _numChannels = 0;
+    SemaphoreHandle_t _mutex = NULL;
+    StaticSemaphore_t _mutexBuffer;
+
+    sdfat::SdFs _sd;
+    sdfat::FsFile _file;
+    bool _mounted = false;
+    bool _fileOpen = false;
+    volatile bool _ejectRequested = false;
+    bool _ejected = false;          // Stay unmounted until the card is taken out
+    uint32_t _generation = 0;
+    char _fileName[LOG_FILE_NAME_SIZE] = "";
+    uint32_t _fileId = 0;
+    uint32_t _firstSector = 0;      // Card sector of the file's first block
+    uint32_t _fileBlocks = 0;       // Allocated
+    uint32_t _dataBlocks = 0;       // Data blocks committed to the file
+    uint32_t _lastMountAttempt = 0;
+    uint32_t _lastSync = 0;
+
+    // Index of the group being written and the file footer, built up as
+    // data blocks are committed
+    LogIndexBlock _index;
+    LogFooter _footer;
+
+    SpscQueue<LogRecord, LOG_QUEUE_SIZE> _queue;
+
+    // Word aligned for SPI DMA
+    alignas(4) LogBlock _buffers[2][LOG_BUFFER_BLOCKS];
+    uint8_t _fillBuffer = 0;        // Buffer being filled
+    uint32_t _fillBlocks = 0;       // Blocks started in it, the last one being filled by _encoder
+    bool _pending = false;          // The other buffer is full and not yet written
+    LogBlockEncoder _encoder;
+    LogRecord _held;                // Taken off the queue but not yet in a buffer
+    bool _holding = false;
+
+    // What the index needs to know about the records in each buffer, kept
+    // as they go in rather than decoded again
+    struct BufferSummary {
+        LogChannelRange range;
+        uint32_t lastTime;
+    };
+    BufferSummary _summary[2];
+
+    DataLoggerStats _stats = {};
+};
+
+#endif /* DATA_LOGGER_H */
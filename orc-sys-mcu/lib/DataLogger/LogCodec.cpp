@@ -0,0 +1,252 @@
+#include "LogCodec.h"
+
+#include <string.h>
+
+#define PAYLOAD_BITS (sizeof(((LogBlock *)0)->data) * 8)
+#define NO_WINDOW 0xFF
+#define NO_CHANNEL 0xFF
+
+static inline uint32_t floatBits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline float bitsFloat(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline uint8_t leadingZeros(uint32_t x) {
+    return x ? __builtin_clz(x) : 32;
+}
+
+static inline uint8_t trailingZeros(uint32_t x) {
+    return x ? __builtin_ctz(x) : 32;
+}
+
+// ---------------------- Encoder ---------------------- //
+
+void LogBlockEncoder::begin(LogBlock *block) {
+    _block = block;
+    _bits = 0;
+    memset(block, 0, sizeof(*block));
+    for (uint8_t ch = 0; ch < LOG_MAX_CHANNELS; ch++) {
+        _channels[ch].seen = false;
+        _nextChannel[ch] = NO_CHANNEL;
+    }
+    _lastChannel = NO_CHANNEL;
+}
+
+bool LogBlockEncoder::add(const LogRecord &record) {
+    if (_block == nullptr || record.channel >= LOG_MAX_CHANNELS || _block->header.count == UINT16_MAX) return false;
+    if (_block->header.count == 0) _block->header.firstTime = record.time;
+
+    // Roll back to here if the record doesn't fit
+    ChannelState &state = _channels[record.channel];
+    const ChannelState saved = state;
+    const size_t savedBits = _bits;
+    const uint8_t savedLast = _lastChannel;
+    const uint8_t savedNext = savedLast != NO_CHANNEL ? _nextChannel[savedLast] : NO_CHANNEL;
+    if (!writeChannel(record.channel) || !writeTime(state, record.time) || !writeValue(state, floatBits(record.value))) {
+        state = saved;
+        _bits = savedBits;
+        _lastChannel = savedLast;
+        if (savedLast != NO_CHANNEL) _nextChannel[savedLast] = savedNext;
+        return false;
+    }
+    state.seen = true;
+    _block->header.count++;
+    return true;
+}
+
+bool LogBlockEncoder::writeBits(uint32_t value, uint8_t bits) {
+    if (_bits + bits > PAYLOAD_BITS) return false;
+    uint8_t *data = _block->data;
+    while (bits > 0) {
+        uint8_t offset = _bits & 7;
+        uint8_t n = 8 - offset < bits ? 8 - offset : bits;
+        uint8_t shift = 8 - offset - n;
+        uint8_t mask = ((1u << n) - 1) << shift;
+        uint8_t chunk = (value >> (bits - n)) & ((1u << n) - 1);
+        data[_bits >> 3] = (data[_bits >> 3] & ~mask) | (chunk << shift);
+        _bits += n;
+        bits -= n;
+    }
+    return true;
+}
+
+bool LogBlockEncoder::writeChannel(uint8_t channel) {
+    uint8_t last = _lastChannel;
+    _lastChannel = channel;
+    if (last != NO_CHANNEL) {
+        bool predicted = _nextChannel[last] == channel;
+        _nextChannel[last] = channel;
+        if (predicted) return writeBits(0, 1);
+    }
+    return writeBits(0x10 | channel, 5);
+}
+
+bool LogBlockEncoder::writeTime(ChannelState &state, uint32_t time) {
+    uint32_t previous = state.seen ? state.time : _block->header.firstTime;
+    int32_t previousDelta = state.seen ? state.delta : 0;
+    int32_t delta = (int32_t)(time - previous);
+    int32_t dod = (int32_t)((uint32_t)delta - (uint32_t)previousDelta);
+    state.time = time;
+    state.delta = delta;
+
+    if (dod == 0) return writeBits(0, 1);
+    if (dod >= -63 && dod <= 64) return writeBits((0x2u << 7) | (uint32_t)(dod + 63), 9);
+    if (dod >= -255 && dod <= 256) return writeBits((0x6u << 9) | (uint32_t)(dod + 255), 12);
+    if (dod >= -2047 && dod <= 2048) return writeBits((0xEu << 12) | (uint32_t)(dod + 2047), 16);
+    return writeBits(0xF, 4) && writeBits((uint32_t)dod, 32);
+}
+
+bool LogBlockEncoder::writeValue(ChannelState &state, uint32_t value) {
+    if (!state.seen) {
+        state.value = value;
+        state.leading = NO_WINDOW;
+        return writeBits(value, 32);
+    }
+
+    uint32_t x = value ^ state.value;
+    state.value = value;
+    if (x == 0) return writeBits(0, 1);
+
+    uint8_t leading = leadingZeros(x);
+    uint8_t trailing = trailingZeros(x);
+    if (leading > 31) leading = 31;
+    if (state.leading != NO_WINDOW && leading >= state.leading && trailing >= state.trailing) {
+        uint8_t length = 32 - state.leading - state.trailing;
+        return writeBits(0x2, 2) && writeBits(x >> state.trailing, length);
+    }
+    uint8_t length = 32 - leading - trailing;
+    state.leading = leading;
+    state.trailing = trailing;
+    return writeBits((0x3u << 11) | (leading << 6) | length, 13) && writeBits(x >> trailing, length);
+}
+
+// ---------------------- Decoder ---------------------- //
+
+void LogBlockDecoder::begin(const LogBlock *block) {
+    _block = block;
+    _bits = 0;
+    _remaining = block ? block->header.count : 0;
+    for (uint8_t ch = 0; ch < LOG_MAX_CHANNELS; ch++) {
+        _channels[ch].seen = false;
+        _nextChannel[ch] = NO_CHANNEL;
+    }
+    _lastChannel = NO_CHANNEL;
+}
+
+bool LogBlockDecoder::next(LogRecord &record) {
+    if (_remaining == 0) return false;
+    uint32_t channel, time, value;
+    if (!readChannel(channel)) return false;
+    ChannelState &state = _channels[channel];
+    if (!readTime(state, time) || !readValue(state, value)) {
+        _remaining = 0;
+        return false;
+    }
+    state.seen = true;
+    _remaining--;
+    record.time = time;
+    record.channel = channel;
+    record.value = bitsFloat(value);
+    return true;
+}
+
+bool LogBlockDecoder::readBits(uint8_t bits, uint32_t &value) {
+    if (_bits + bits > PAYLOAD_BITS) {
+        _remaining = 0;
+        return false;
+    }
+    const uint8_t *data = _block->data;
+    value = 0;
+    while (bits > 0) {
+        uint8_t offset = _bits & 7;
+        uint8_t n = 8 - offset < bits ? 8 - offset : bits;
+        uint8_t chunk = (data[_bits >> 3] >> (8 - offset - n)) & ((1u << n) - 1);
+        value = (value << n) | chunk;
+        _bits += n;
+        bits -= n;
+    }
+    return true;
+}
+
+bool LogBlockDecoder::readChannel(uint32_t &channel) {
+    uint32_t explicitChannel;
+    if (!readBits(1, explicitChannel)) return false;
+    if (explicitChannel) {
+        if (!readBits(4, channel)) return false;
+    }
+    else if (_lastChannel == NO_CHANNEL || _nextChannel[_lastChannel] == NO_CHANNEL) {
+        _remaining = 0;  // Nothing to predict from, corrupt
+        return false;
+    }
+    else channel = _nextChannel[_lastChannel];
+    if (_lastChannel != NO_CHANNEL) _nextChannel[_lastChannel] = channel;
+    _lastChannel = channel;
+    return true;
+}
+
+bool LogBlockDecoder::readTime(ChannelState &state, uint32_t &time) {
+    uint32_t previous = state.seen ? state.time : _block->header.firstTime;
+    int32_t previousDelta = state.seen ? state.delta : 0;
+
+    // Count the leading ones of the prefix, up to four
+    uint8_t ones = 0;
+    uint32_t bit;
+    while (ones < 4) {
+        if (!readBits(1, bit)) return false;
+        if (bit == 0) break;
+        ones++;
+    }
+    static const uint8_t widths[5] = {0, 7, 9, 12, 32};
+    static const int32_t offsets[5] = {0, 63, 255, 2047, 0};
+    int32_t dod = 0;
+    if (ones > 0) {
+        uint32_t raw;
+        if (!readBits(widths[ones], raw)) return false;
+        dod = (int32_t)raw - offsets[ones];
+    }
+
+    int32_t delta = (int32_t)((uint32_t)previousDelta + (uint32_t)dod);
+    time = previous + (uint32_t)delta;
+    state.time = time;
+    state.delta = delta;
+    return true;
+}
+
+bool LogBlockDecoder::readValue(ChannelState &state, uint32_t &value) {
+    if (!state.seen) {
+        state.leading = NO_WINDOW;
+        if (!readBits(32, value)) return false;
+        state.value = value;
+        return true;
+    }
+
+    uint32_t control;
+    if (!readBits(1, control)) return false;
+    if (control == 0) {
+        value = state.value;
+        return true;
+    }
+    if (!readBits(1, control)) return false;
+    if (control == 1) {
+        uint32_t leading, length;
+        if (!readBits(5, leading) || !readBits(6, length)) return false;
+        if (length == 0 || leading + length > 32) return false;
+        state.leading = leading;
+        state.trailing = 32 - leading - length;
+    }
+    else if (state.leading == NO_WINDOW) return false;
+
+    uint32_t meaningful;
+    uint8_t length = 32 - state.leading - state.trailing;
+    if (!readBits(length, meaningful)) return false;
+    value = state.value ^ (meaningful << state.trailing);
+    state.value = value;
+    return true;
+}
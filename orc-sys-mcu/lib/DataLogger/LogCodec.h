@@ -0,0 +1,103 @@
+#ifndef LOG_CODEC_H
+#define LOG_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "LogFormat.h"
+
+// Compressed encoding of the records in a data block. Free of Arduino
+// headers so it builds on the host for tools and benchmarks.
+//
+// Records are stored in arrival order as a bit stream. Each channel is
+// compressed against its own previous record in the block, Gorilla style:
+//
+//   channel      predicted as the channel that followed the previous record's
+//                channel last time, which holds while sensors report in turn
+//                  0                          as predicted
+//                  1    + 4 bits              anything else
+//   time         delta-of-delta against the channel's previous two samples
+//                (the first sample of a channel in a block against the
+//                block's firstTime with a previous delta of 0)
+//                  0                          same interval as last time
+//                  10   + 7 bits              -63 .. 64
+//                  110  + 9 bits              -255 .. 256
+//                  1110 + 12 bits             -2047 .. 2048
+//                  1111 + 32 bits             anything else, e.g. clock steps
+//   value        float bits XORed with the channel's previous value
+//                (raw 32 bits for the first sample of a channel)
+//                  0                          unchanged
+//                  10   + meaningful bits     inside the previous leading/trailing zero window
+//                  11   + 5 bits leading zeros + 6 bits length + meaningful bits
+//
+// A sample arriving in turn at the usual rate with an unchanged value takes
+// 3 bits rather than the 72 of a LogRecord. Every block starts from scratch, so it
+// decodes on its own and a time range search can start at any block.
+
+class LogBlockEncoder {
+public:
+    // Start filling a block, clearing it
+    void begin(LogBlock *block);
+
+    // Append a record, false (and the block unchanged) if it does not fit
+    bool add(const LogRecord &record);
+
+    uint16_t count() const { return _block ? _block->header.count : 0; }
+    size_t bitsUsed() const { return _bits; }
+
+private:
+    struct ChannelState {
+        uint32_t time;
+        int32_t delta;
+        uint32_t value;
+        uint8_t leading;
+        uint8_t trailing;
+        bool seen;
+    };
+
+    bool writeBits(uint32_t value, uint8_t bits);
+    bool writeChannel(uint8_t channel);
+    bool writeTime(ChannelState &state, uint32_t time);
+    bool writeValue(ChannelState &state, uint32_t value);
+
+    LogBlock *_block = nullptr;
+    size_t _bits = 0;
+    ChannelState _channels[LOG_MAX_CHANNELS];
+    uint8_t _nextChannel[LOG_MAX_CHANNELS];  // Channel that followed each channel last time
+    uint8_t _lastChannel;
+};
+
+class LogBlockDecoder {
+public:
+    // Start reading a block, which must stay valid while decoding
+    void begin(const LogBlock *block);
+
+    // Next record, false once all of the block's records have been read or
+    // if the block is corrupt
+    bool next(LogRecord &record);
+
+    uint16_t remaining() const { return _remaining; }
+
+private:
+    struct ChannelState {
+        uint32_t time;
+        int32_t delta;
+        uint32_t value;
+        uint8_t leading;
+        uint8_t trailing;
+        bool seen;
+    };
+
+    bool readBits(uint8_t bits, uint32_t &value);
+    bool readChannel(uint32_t &channel);
+    bool readTime(ChannelState &state, uint32_t &time);
+    bool readValue(ChannelState &state, uint32_t &value);
+
+    const LogBlock *_block = nullptr;
+    size_t _bits = 0;
+    uint16_t _remaining = 0;
+    ChannelState _channels[LOG_MAX_CHANNELS];
+    uint8_t _nextChannel[LOG_MAX_CHANNELS];  // Channel that followed each channel last time
+    uint8_t _lastChannel;
+};
+
+#endif /* LOG_CODEC_H */
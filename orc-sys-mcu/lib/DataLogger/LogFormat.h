@@ -0,0 +1,132 @@
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+#include <stdint.h>
+
+// On-card format of the data logger. Kept free of Arduino headers so host
+// tools can read log files with the same definitions.
+//
+// A log file is a sequence of 512 byte blocks, the SD card sector size:
+//
+//   LogFileHeader
+//   LogBlock x LOG_INDEX_INTERVAL, LogIndexBlock    one group, repeated
+//   ...
+//   LogBlock x n, LogIndexBlock                     last group, may be short
+//   LogFooter
+//
+// Data blocks hold a variable number of records, compressed as described in
+// LogCodec.h. They are only ever written whole and say how many records
+// they hold. The index block summarising a group is written once its last data
+// block is, and the last group's index and the footer when the file is
+// closed, so a file cut short by a power loss or card removal has neither
+// for its last group but is still readable up to its last data block. Each
+// data block also carries the time of its first record, so such a file can
+// still be searched by time.
+//
+// Files are allocated at full size up front and only cut to length when
+// closed, so a file that was never closed runs on past its last data block
+// into whatever the card held before. Every block carries the fileId of its
+// file's header to tell the two apart.
+
+#define LOG_BLOCK_SIZE 512
+#define LOG_FORMAT_VERSION 4
+#define LOG_MAX_CHANNELS 16
+#define LOG_CHANNEL_NAME_SIZE 24
+#define LOG_INDEX_INTERVAL 64       // Data blocks per index block
+#define LOG_BLOCK_MAGIC 0x424C      // "LB"
+#define LOG_INDEX_MAGIC 0x5849      // "IX"
+#define LOG_FOOTER_MAGIC 0x5446     // "FT"
+
+struct __attribute__((packed)) LogFileHeader
+{
+    char magic[6];          // "ORCLOG"
+    uint16_t version;       // LOG_FORMAT_VERSION
+    uint32_t created;       // Time of the first sample, RTC local time in seconds since 1970
+    uint32_t fileId;        // Repeated in every block of the file
+    uint16_t blockSize;     // LOG_BLOCK_SIZE
+    uint16_t indexInterval; // LOG_INDEX_INTERVAL
+    uint8_t numChannels;
+    uint8_t reserved;
+    char channels[LOG_MAX_CHANNELS][LOG_CHANNEL_NAME_SIZE];  // Names, indexed by LogRecord::channel
+    uint8_t padding[LOG_BLOCK_SIZE - 22 - LOG_MAX_CHANNELS * LOG_CHANNEL_NAME_SIZE];
+};
+static_assert(sizeof(LogFileHeader) == LOG_BLOCK_SIZE, "LogFileHeader must fill one block");
+
+// A sample, as passed to and returned by the codec
+struct __attribute__((packed)) LogRecord
+{
+    uint32_t time;          // RTC local time in seconds since 1970
+    uint8_t channel;
+    float value;
+};
+
+struct __attribute__((packed)) LogBlockHeader
+{
+    uint16_t magic;         // LOG_BLOCK_MAGIC
+    uint16_t count;         // Records used in this block
+    uint32_t sequence;      // Data block number, from 0 at the start of the file
+    uint32_t firstTime;     // Time of the first record
+    uint32_t fileId;
+};
+
+struct __attribute__((packed)) LogBlock
+{
+    LogBlockHeader header;
+    uint8_t data[LOG_BLOCK_SIZE - sizeof(LogBlockHeader)];  // Encoded records
+};
+static_assert(sizeof(LogBlock) == LOG_BLOCK_SIZE, "LogBlock must fill one block");
+
+// Per channel value range. A channel with no samples has min > max.
+struct __attribute__((packed)) LogChannelRange
+{
+    float min[LOG_MAX_CHANNELS];
+    float max[LOG_MAX_CHANNELS];
+};
+
+// Summary of the group of data blocks in front of it
+struct __attribute__((packed)) LogIndexBlock
+{
+    uint16_t magic;         // LOG_INDEX_MAGIC
+    uint16_t blocks;        // Data blocks in the group
+    uint32_t group;         // Group number, from 0
+    uint32_t fileId;
+    uint32_t firstTime;
+    uint32_t lastTime;
+    LogChannelRange range;
+    uint32_t blockTime[LOG_INDEX_INTERVAL];  // firstTime of each data block
+    uint8_t padding[LOG_BLOCK_SIZE - 20 - sizeof(LogChannelRange) - LOG_INDEX_INTERVAL * 4];
+};
+static_assert(sizeof(LogIndexBlock) == LOG_BLOCK_SIZE, "LogIndexBlock must fill one block");
+
+// Last block of a closed file
+struct __attribute__((packed)) LogFooter
+{
+    uint16_t magic;         // LOG_FOOTER_MAGIC
+    uint16_t reserved;
+    uint32_t dataBlocks;
+    uint32_t fileId;
+    uint32_t firstTime;
+    uint32_t lastTime;
+    LogChannelRange range;
+    uint8_t padding[LOG_BLOCK_SIZE - 20 - sizeof(LogChannelRange)];
+};
+static_assert(sizeof(LogFooter) == LOG_BLOCK_SIZE, "LogFooter must fill one block");
+
+// Position of data block n in the file, in blocks
+inline uint32_t logDataBlockPosition(uint32_t n) {
+    return 1 + n + n / LOG_INDEX_INTERVAL;
+}
+
+// Position of the index block of group g, in blocks
+inline uint32_t logIndexBlockPosition(uint32_t g) {
+    return (g + 1) * (LOG_INDEX_INTERVAL + 1);
+}
+
+// Data blocks in a file of the given length in blocks, without a footer
+inline uint32_t logDataBlockCount(uint32_t fileBlocks) {
+    if (fileBlocks <= 1) return 0;
+    uint32_t blocks = fileBlocks - 1;
+    return blocks - blocks / (LOG_INDEX_INTERVAL + 1);
+}
+
+#endif /* LOG_FORMAT_H */
@@ -0,0 +1,238 @@
+#include "LogReader.h"
+
+bool LogReader::begin(uint32_t from, uint32_t to, const char *channel) {
+    end();
+    if (!_logger.lock(pdMS_TO_TICKS(LOG_READ_LOCK_TIMEOUT))) return false;
+    bool mounted = _logger.mounted();
+    _generation = _logger.generation();
+    _logger.unlock();
+    if (!mounted) return false;
+
+    _from = from;
+    _to = to;
+    strlcpy(_channelFilter, channel ? channel : "", sizeof(_channelFilter));
+    _fileName[0] = '\0';
+    _decoder.begin(nullptr);
+    _done = false;
+    return true;
+}
+
+bool LogReader::next(LogRecord &record) {
+    while (!_done) {
+        LogRecord r;
+        if (_fileOpen && _decoder.next(r)) {
+            if (r.time > _to) {
+                _done = true;
+                break;
+            }
+            if (r.time < _from || (_channel >= 0 && r.channel != _channel)) continue;
+            record = r;
+            return true;
+        }
+        if (_fileOpen && loadNextBlock()) continue;
+        if (_done || !openNextFile()) _done = true;
+    }
+    return false;
+}
+
+const char *LogReader::channelName(uint8_t channel) const {
+    return channel < _numChannels ? _channels[channel] : "";
+}
+
+void LogReader::end() {
+    if (_fileOpen && _logger.lock(pdMS_TO_TICKS(LOG_READ_LOCK_TIMEOUT))) {
+        _file.close();
+        _logger.unlock();
+    }
+    _fileOpen = false;
+    _done = true;
+}
+
+// Open the next file in name (and so time) order that may hold records in
+// the range, and seek to the first block of the range in it
+bool LogReader::openNextFile() {
+    while (true) {
+        if (!_logger.lock(pdMS_TO_TICKS(LOG_READ_LOCK_TIMEOUT))) return false;
+        if (_fileOpen) {
+            _file.close();
+            _fileOpen = false;
+        }
+        if (!_logger.mounted() || _logger.generation() != _generation) {
+            _logger.unlock();
+            return false;
+        }
+
+        // Lowest name after the current file
+        sdfat::FsFile dir, entry;
+        char name[LOG_FILE_NAME_SIZE], best[LOG_FILE_NAME_SIZE] = "";
+        const size_t extLen = strlen(LOG_FILE_EXTENSION);
+        if (!dir.open(LOG_DIRECTORY, O_RDONLY)) {
+            _logger.unlock();
+            return false;
+        }
+        while (entry.openNext(&dir, O_RDONLY)) {
+            size_t len = entry.getName(name, sizeof(name));
+            bool isLog = !entry.isDir() && len > extLen && strcmp(name + len - extLen, LOG_FILE_EXTENSION) == 0;
+            entry.close();
+            if (isLog && strcmp(name, _fileName) > 0 && (best[0] == '\0' || strcmp(name, best) < 0)) {
+                strlcpy(best, name, sizeof(best));
+            }
+        }
+        dir.close();
+        if (best[0] == '\0') {
+            _logger.unlock();
+            return false;
+        }
+        strlcpy(_fileName, best, sizeof(_fileName));
+
+        // Header, and the time of the last record from the footer or the last data block
+        char path[LOG_FILE_NAME_SIZE + sizeof(LOG_DIRECTORY)];
+        snprintf(path, sizeof(path), LOG_DIRECTORY "/%s", best);
+        LogFileHeader header;
+        uint32_t lastTime = UINT32_MAX;
+        bool usable = _file.open(path, O_RDONLY) &&
+                      _file.read(&header, sizeof(header)) == (int)sizeof(header) &&
+                      memcmp(header.magic, "ORCLOG", sizeof(header.magic)) == 0 &&
+                      header.version == LOG_FORMAT_VERSION &&
+                      header.blockSize == LOG_BLOCK_SIZE &&
+                      header.indexInterval == LOG_INDEX_INTERVAL;
+        if (usable) {
+            _fileId = header.fileId;
+            _fileBlocks = _file.fileSize() / LOG_BLOCK_SIZE;
+            _dataBlocks = logDataBlockCount(_fileBlocks);
+            const LogFooter *footer = (const LogFooter *)&_current;
+            if (_fileBlocks > 1 && readAt(_fileBlocks - 1, &_current) &&
+                footer->magic == LOG_FOOTER_MAGIC && footer->fileId == _fileId) {
+                _dataBlocks = footer->dataBlocks;
+                lastTime = footer->lastTime;
+            }
+            else {
+                // Not closed, so still at its allocated size: the written
+                // blocks are the ones before the first that isn't ours
+                uint32_t lo = 0, hi = _dataBlocks;
+                while (lo < hi) {
+                    uint32_t mid = lo + (hi - lo) / 2;
+                    if (readAt(logDataBlockPosition(mid), &_current) && validBlock(mid)) lo = mid + 1;
+                    else hi = mid;
+                }
+                _dataBlocks = lo;
+                if (_dataBlocks > 0 && readAt(logDataBlockPosition(_dataBlocks - 1), &_current) && validBlock(_dataBlocks - 1)) {
+                    LogRecord r;
+                    _decoder.begin(&_current);
+                    while (_decoder.next(r)) lastTime = r.time;
+                }
+            }
+        }
+        if (!usable || lastTime < _from) {
+            _file.close();
+            _logger.unlock();
+            continue;
+        }
+        if (header.created > _to) {
+            _file.close();
+            _logger.unlock();
+            return false;
+        }
+        _logger.unlock();
+
+        _numChannels = header.numChannels > LOG_MAX_CHANNELS ? LOG_MAX_CHANNELS : header.numChannels;
+        _channel = -1;
+        for (uint8_t ch = 0; ch < _numChannels; ch++) {
+            memcpy(_channels[ch], header.channels[ch], LOG_CHANNEL_NAME_SIZE);
+            _channels[ch][LOG_CHANNEL_NAME_SIZE - 1] = '\0';
+            if (_channelFilter[0] != '\0' && strcmp(_channels[ch], _channelFilter) == 0) _channel = ch;
+        }
+        _fileOpen = true;
+        if (_channelFilter[0] != '\0' && _channel < 0) continue;  // Channel not logged in this file
+        _indexGroup = -1;
+        return seek();
+    }
+}
+
+// Position at the last block starting at or before from
+bool LogReader::seek() {
+    uint32_t lo = 0, hi = _dataBlocks;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t time;
+        if (!blockTime(mid, time)) {
+            if (_done) return false;
+            hi = mid;  // Not written, the data ends before it
+            continue;
+        }
+        if (time <= _from) lo = mid + 1;
+        else hi = mid;
+    }
+    _block = lo > 0 ? lo - 1 : 0;
+    _decoder.begin(nullptr);
+    return true;
+}
+
+bool LogReader::loadNextBlock() {
+    while (_block < _dataBlocks && !_done) {
+        // Skip whole groups ending before the range or without the channel
+        uint32_t group = _block / LOG_INDEX_INTERVAL;
+        if (loadIndex(group) &&
+            (_index.lastTime < _from || (_channel >= 0 && _index.range.min[_channel] > _index.range.max[_channel]))) {
+            _block = (group + 1) * LOG_INDEX_INTERVAL;
+            continue;
+        }
+        if (!readBlock(logDataBlockPosition(_block), &_current)) return false;
+        if (!validBlock(_block)) {
+            _decoder.begin(nullptr);
+            return false;  // End of the written data
+        }
+        _block++;
+        _decoder.begin(&_current);
+        return true;
+    }
+    return false;
+}
+
+bool LogReader::loadIndex(uint32_t group) {
+    if (_indexGroup == (int32_t)group) return _indexValid;
+    _indexGroup = group;
+    uint32_t position = logIndexBlockPosition(group);
+    _indexValid = position < _fileBlocks && readBlock(position, &_index) &&
+                  _index.magic == LOG_INDEX_MAGIC && _index.group == group && _index.fileId == _fileId;
+    return _indexValid;
+}
+
+bool LogReader::blockTime(uint32_t block, uint32_t &time) {
+    if (loadIndex(block / LOG_INDEX_INTERVAL) && block % LOG_INDEX_INTERVAL < _index.blocks) {
+        time = _index.blockTime[block % LOG_INDEX_INTERVAL];
+        return true;
+    }
+    if (!readBlock(logDataBlockPosition(block), &_current) || !validBlock(block)) return false;
+    time = _current.header.firstTime;
+    return true;
+}
+
+// Read one block of the current file, ending the read if the card was
+// unmounted since begin()
+bool LogReader::readBlock(uint32_t position, void *block) {
+    if (!_logger.lock(pdMS_TO_TICKS(LOG_READ_LOCK_TIMEOUT))) {
+        _done = true;
+        return false;
+    }
+    if (!_logger.mounted() || _logger.generation() != _generation) {
+        _logger.unlock();
+        _fileOpen = false;  // The file went with the card
+        _done = true;
+        return false;
+    }
+    bool ok = readAt(position, block);
+    _logger.unlock();
+    return ok;
+}
+
+// With the card locked
+bool LogReader::readAt(uint32_t position, void *block) {
+    return _file.seekSet((uint64_t)position * LOG_BLOCK_SIZE) && _file.read(block, LOG_BLOCK_SIZE) == LOG_BLOCK_SIZE;
+}
+
+// _current is data block number block of this file
+bool LogReader::validBlock(uint32_t block) const {
+    return _current.header.magic == LOG_BLOCK_MAGIC && _current.header.sequence == block &&
+           _current.header.fileId == _fileId;
+}
@@ -0,0 +1,76 @@
+#ifndef LOG_READER_H
+#define LOG_READER_H
+
+#include "DataLogger.h"
+
+// Reads back the records of a time range from the log files of a DataLogger,
+// in time order across files.
+//
+// Files before the range are skipped using their footer, or their last data
+// block if they have none, found by binary search as a file that was never
+// closed is still at its allocated size. Within a file the first block of the range is
+// found by a binary search on block times, taken from the index blocks where
+// they exist and from the data blocks otherwise, and when a single channel
+// is read, index groups without samples of it are skipped.
+//
+// The card is only locked for each block read, so the logger keeps writing
+// while a long range is read. Data the logger has not written yet (up to
+// LOG_SYNC_INTERVAL) is not seen.
+
+#ifndef LOG_READ_LOCK_TIMEOUT
+#define LOG_READ_LOCK_TIMEOUT 2000      // ms to wait for the logger to finish a write
+#endif
+
+class LogReader {
+public:
+    LogReader(DataLogger &logger) : _logger(logger) {}
+
+    // Start reading records with from <= time <= to, of the named channel or
+    // of all channels if channel is nullptr. False if the card isn't mounted.
+    bool begin(uint32_t from, uint32_t to, const char *channel = nullptr);
+
+    // Next record in the range, false at the end or if the card went away
+    bool next(LogRecord &record);
+
+    // Name of a channel number in the file the last record came from
+    const char *channelName(uint8_t channel) const;
+
+    void end();
+
+private:
+    bool openNextFile();
+    bool seek();
+    bool loadNextBlock();
+    bool loadIndex(uint32_t group);
+    bool blockTime(uint32_t block, uint32_t &time);
+    bool readBlock(uint32_t position, void *block);
+    bool readAt(uint32_t position, void *block);
+    bool validBlock(uint32_t block) const;
+
+    DataLogger &_logger;
+    uint32_t _generation = 0;
+    uint32_t _from = 0;
+    uint32_t _to = 0;
+    char _channelFilter[LOG_CHANNEL_NAME_SIZE] = "";
+    bool _done = true;
+
+    // Current file
+    sdfat::FsFile _file;
+    bool _fileOpen = false;
+    char _fileName[LOG_FILE_NAME_SIZE] = "";  // Without the directory
+    char _channels[LOG_MAX_CHANNELS][LOG_CHANNEL_NAME_SIZE];
+    uint8_t _numChannels = 0;
+    int16_t _channel = -1;          // Channel number of the filter in this file
+    uint32_t _fileId = 0;
+    uint32_t _fileBlocks = 0;
+    uint32_t _dataBlocks = 0;
+
+    uint32_t _block = 0;            // Next data block to read
+    LogBlock _current;
+    LogBlockDecoder _decoder;       // Over _current
+    LogIndexBlock _index;
+    int32_t _indexGroup = -1;       // Group _index was last loaded for
+    bool _indexValid = false;
+};
+
+#endif /* LOG_READER_H */
@@ -0,0 +1,47 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Fixed size single-producer single-consumer queue. The producer only writes
+// _head and the consumer only writes _tail, so neither side takes a lock or
+// waits for the other, and the two may run on different cores. Size must be a
+// power of two.
+template <typename T, size_t Size>
+class SpscQueue {
+    static_assert((Size & (Size - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+    // Producer side, false if the queue is full
+    bool push(const T &item) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) == Size) return false;
+        _items[head & (Size - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, false if the queue is empty
+    bool pop(T &item) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (_head.load(std::memory_order_acquire) == tail) return false;
+        item = _items[tail & (Size - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    static constexpr size_t capacity() { return Size; }
+
+private:
+    T _items[Size];
+    std::atomic<uint32_t> _head{0};
+    std::atomic<uint32_t> _tail{0};
+};
+
+#endif /* SPSC_QUEUE_H */
@@ -0,0 +1,111 @@
+#include "DeadlineMonitor.h"
+#include <string.h>
+
+#ifdef ARDUINO_ARCH_RP2040
+#include <hardware/timer.h>
+#else
+#include <Arduino.h>
+#endif
+
+const uint32_t deadlineBucketBounds[DEADLINE_BUCKETS - 2] = {1000, 10000, 100000, 1000000};
+
+uint32_t DeadlineMonitor::now() {
+#ifdef ARDUINO_ARCH_RP2040
+    return time_us_32();
+#else
+    return micros();
+#endif
+}
+
+bool DeadlineMonitor::watch(uint8_t id, const char *name, uint32_t period, uint32_t budget, bool critical) {
+    if (id >= DEADLINE_MAX_TASKS) return false;
+    Entry &e = _entries[id];
+    e.name = name;
+    e.period = period;
+    e.budget = budget;
+    e.critical = critical;
+    return true;
+}
+
+void DeadlineMonitor::start(uint8_t id) {
+    if (id >= DEADLINE_MAX_TASKS || _entries[id].name == nullptr) return;
+    Entry &e = _entries[id];
+    uint32_t t = now();
+    if (e.started) {
+        // Differences only, so the counter wrapping doesn't matter
+        int32_t lateness = (int32_t)(t - (e.passEnd + e.period));
+        uint8_t bucket = 0;
+        if (lateness > 0) {
+            e.late = e.late + 1;
+            if ((uint32_t)lateness > e.maxLateness) e.maxLateness = lateness;
+            bucket = 1;
+            while (bucket < DEADLINE_BUCKETS - 1 && (uint32_t)lateness > deadlineBucketBounds[bucket - 1]) bucket++;
+        }
+        e.lateness[bucket] = e.lateness[bucket] + 1;
+    }
+    e.passStart = t;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e.inPass = true;
+    e.started = true;
+}
+
+void DeadlineMonitor::end(uint8_t id) {
+    if (id >= DEADLINE_MAX_TASKS || _entries[id].name == nullptr) return;
+    Entry &e = _entries[id];
+    uint32_t t = now();
+    uint32_t execution = t - e.passStart;
+    if (execution > e.maxExecution) e.maxExecution = execution;
+    if (execution > e.budget) e.overruns = e.overruns + 1;
+    e.passes = e.passes + 1;
+    e.passEnd = t;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e.inPass = false;
+}
+
+void DeadlineMonitor::fail(uint8_t id) {
+    if (id >= DEADLINE_MAX_TASKS || _entries[id].name == nullptr) return;
+    _entries[id].failed = true;
+}
+
+bool DeadlineMonitor::check(uint8_t &stalled) {
+    bool healthy = true;
+    for (uint8_t id = 0; id < DEADLINE_MAX_TASKS; id++) {
+        Entry &e = _entries[id];
+        if (e.name == nullptr) continue;
+        if (e.failed) {
+            e.stalled = true;
+            continue;
+        }
+        if (!e.started) continue;
+        bool inPass = e.inPass;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint32_t deadline = inPass ? e.passStart + e.budget : e.passEnd + e.period;
+        int32_t overdue = (int32_t)(now() - deadline);
+        uint32_t limit = e.period + e.budget;
+        if (limit < DEADLINE_MIN_STALL) limit = DEADLINE_MIN_STALL;
+        e.stalled = overdue > 0 && (uint32_t)overdue > limit;
+        if (e.stalled && e.critical && healthy) {
+            healthy = false;
+            stalled = id;
+        }
+    }
+    return healthy;
+}
+
+bool DeadlineMonitor::stats(uint8_t id, DeadlineStats &stats) const {
+    if (id >= DEADLINE_MAX_TASKS || _entries[id].name == nullptr) return false;
+    const Entry &e = _entries[id];
+    stats.name = e.name;
+    stats.period = e.period;
+    stats.budget = e.budget;
+    stats.critical = e.critical;
+    stats.stalled = e.stalled;
+    stats.failed = e.failed;
+    stats.passes = e.passes;
+    stats.late = e.late;
+    stats.overruns = e.overruns;
+    stats.maxLateness = e.maxLateness;
+    stats.maxExecution = e.maxExecution;
+    for (uint8_t b = 0; b < DEADLINE_BUCKETS; b++) stats.lateness[b] = e.lateness[b];
+    return true;
+}
@@ -0,0 +1,104 @@
+#ifndef DEADLINE_MONITOR_H
+#define DEADLINE_MONITOR_H
+
+#include <stdint.h>
+
+// Deadlines for periodic tasks, and the software side of the watchdog.
+//
+// A task registered with watch() brackets each pass of its loop with
+// start() and end(). A pass is due a period after the previous one ended
+// (a task woken early by an event is just early) and should end within the
+// budget. start() puts how late the pass began into a histogram, end()
+// keeps the longest execution time, and both count missed deadlines.
+//
+// check(), called every so often from a task that outranks the watched
+// ones, looks for tasks that are overdue right now: still in a pass past its
+// budget, or not started a pass a period after the last one. A task overdue
+// by more than its period and budget together (and at least
+// DEADLINE_MIN_STALL) has stalled. check() returns false while a critical
+// task has stalled, which the caller escalates by no longer feeding the
+// hardware watchdog.
+//
+// A task that gives up for good (missing hardware) calls fail() instead of
+// exiting. It then shows as stalled and failed from the next check() on,
+// but doesn't count against the critical tasks: a reset wouldn't bring the
+// hardware back and would only loop.
+//
+// An entry is only written by its own task, in 32-bit fields that don't
+// tear, so neither side locks. Entries are checked from the first start()
+// on. Times are µs from a 32 bit counter, which wraps after 71 minutes;
+// only differences are used, so periods must stay well below that.
+
+#ifndef DEADLINE_MAX_TASKS
+#define DEADLINE_MAX_TASKS 16
+#endif
+#ifndef DEADLINE_MIN_STALL
+#define DEADLINE_MIN_STALL 1000000      // µs overdue before any task counts as stalled
+#endif
+
+// Lateness histogram: on time, then up to each bound (1 ms, 10 ms, 100 ms,
+// 1 s), then later than that
+#define DEADLINE_BUCKETS 6
+extern const uint32_t deadlineBucketBounds[DEADLINE_BUCKETS - 2];   // µs
+
+struct DeadlineStats {
+    const char *name;
+    uint32_t period;                    // µs
+    uint32_t budget;                    // µs
+    bool critical;
+    bool stalled;                       // At the last check()
+    bool failed;                        // Gave up, see fail()
+    uint32_t passes;
+    uint32_t late;                      // Passes started after they were due
+    uint32_t overruns;                  // Passes that took longer than the budget
+    uint32_t maxLateness;               // µs
+    uint32_t maxExecution;              // µs
+    uint32_t lateness[DEADLINE_BUCKETS];
+};
+
+class DeadlineMonitor {
+public:
+    // Expect a pass of task id every period µs, taking at most budget µs.
+    // Call before the task starts. False if id is out of range.
+    bool watch(uint8_t id, const char *name, uint32_t period, uint32_t budget, bool critical);
+
+    // Around each pass, from the task itself
+    void start(uint8_t id);
+    void end(uint8_t id);
+
+    // From the task, when it stops running for good
+    void fail(uint8_t id);
+
+    // Update the stalled flags. False if a critical task has stalled, in
+    // which case stalled is its id.
+    bool check(uint8_t &stalled);
+
+    // Copy of a task's figures. False if id isn't watched.
+    bool stats(uint8_t id, DeadlineStats &stats) const;
+
+    static uint32_t now();
+
+private:
+    struct Entry {
+        const char *name;
+        uint32_t period;
+        uint32_t budget;
+        bool critical;
+        volatile bool started;
+        volatile bool inPass;
+        volatile bool stalled;
+        volatile bool failed;
+        volatile uint32_t passStart;
+        volatile uint32_t passEnd;
+        volatile uint32_t passes;
+        volatile uint32_t late;
+        volatile uint32_t overruns;
+        volatile uint32_t maxLateness;
+        volatile uint32_t maxExecution;
+        volatile uint32_t lateness[DEADLINE_BUCKETS];
+    };
+
+    Entry _entries[DEADLINE_MAX_TASKS] = {};
+};
+
+#endif /* DEADLINE_MONITOR_H */
@@ -0,0 +1,514 @@
+#include "DebugLog.h"
+
+#ifdef ARDUINO_ARCH_RP2040
+#include <hardware/sync.h>
+#define DEBUG_LOG_LOCAL_BEGIN() uint32_t _irqState = save_and_disable_interrupts()
+#define DEBUG_LOG_LOCAL_END() restore_interrupts(_irqState)
+#else
+#define DEBUG_LOG_LOCAL_BEGIN()
+#define DEBUG_LOG_LOCAL_END()
+#endif
+
+#define HEADER_SIZE sizeof(RecordHeader)
+#define ALIGN(n) (((n) + 7) & ~7u)
+#define RING_MASK (DEBUG_LOG_RING_SIZE - 1)
+#define COMMITTED 0x80000000u
+#define TOKENIZED 0x40000000u
+#define STATE_SIZE(state) ((state) & 0xFFFF)
+#define STATE_LENGTH(state) (((state) >> 16) & 0x3FFF)
+#define HISTORY_HEADER_SIZE sizeof(HistoryHeader)
+#define HISTORY_ALIGN(n) (((n) + HISTORY_HEADER_SIZE - 1) & ~(HISTORY_HEADER_SIZE - 1))
+#define HISTORY_MASK (DEBUG_LOG_HISTORY_SIZE - 1)
+#define HISTORY_TOKENIZED 0x01
+#define HISTORY_PADDING 0x02
+
+static_assert(DEBUG_LOG_MAX_LINE <= 0x3FFF, "DEBUG_LOG_MAX_LINE too long for the record header");
+static_assert(DEBUG_LOG_RING_SIZE >= 2 * (DEBUG_LOG_MAX_LINE + 16), "DEBUG_LOG_RING_SIZE too small for DEBUG_LOG_MAX_LINE");
+static_assert(DEBUG_LOG_HISTORY_SIZE >= 2 * (DEBUG_LOG_MAX_LINE + 32), "DEBUG_LOG_HISTORY_SIZE too small for DEBUG_LOG_MAX_LINE");
+
+// COBS encodes what is written to it, for binary mode frames
+class CobsPrint : public Print {
+public:
+    CobsPrint(Print &out) : _out(out) {}
+
+    size_t write(uint8_t b) override {
+        if (b == 0) flushBlock();
+        else {
+            _block[_length++] = b;
+            if (_length == sizeof(_block)) flushBlock();
+        }
+        return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size) override {
+        for (size_t i = 0; i < size; i++) write(buffer[i]);
+        return size;
+    }
+
+    // Finish the frame, returning the bytes written out for it
+    size_t end() {
+        if (_length > 0 || !_full) flushBlock();
+        _out.write((uint8_t)0);
+        return _written + 1;
+    }
+
+private:
+    void flushBlock() {
+        _full = _length == sizeof(_block);
+        _out.write((uint8_t)(_length + 1));
+        _out.write(_block, _length);
+        _written += _length + 1;
+        _length = 0;
+    }
+
+    Print &_out;
+    uint8_t _block[254];
+    size_t _length = 0;
+    size_t _written = 0;
+    bool _full = false;     // The last block was a full one, with no implied zero
+};
+
+// Writes into a string, truncating at its size
+class BufferPrint : public Print {
+public:
+    BufferPrint(char *buffer, size_t size) : _buffer(buffer), _size(size) { _buffer[0] = '\0'; }
+
+    size_t write(uint8_t b) override {
+        if (_length + 1 >= _size) return 0;
+        _buffer[_length++] = b;
+        _buffer[_length] = '\0';
+        return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size) override {
+        size_t n = 0;
+        while (n < size && write(buffer[n])) n++;
+        return n;
+    }
+
+private:
+    char *_buffer;
+    size_t _size;
+    size_t _length = 0;
+};
+
+uint8_t DebugLog::core() {
+#ifdef ARDUINO_ARCH_RP2040
+    return get_core_num();
+#else
+    return 0;
+#endif
+}
+
+uint64_t DebugLog::uptime() {
+#ifdef ARDUINO_ARCH_RP2040
+    return time_us_64();
+#else
+    return micros();
+#endif
+}
+
+void DebugLog::setLevelNames(const char *const *names, uint8_t count) {
+    _levelNames = names;
+    _numLevels = count;
+}
+
+bool DebugLog::printf(uint8_t level, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    bool queued = vprintf(level, format, args);
+    va_end(args);
+    return queued;
+}
+
+// Text records are the level then the text
+bool DebugLog::vprintf(uint8_t level, const char *format, va_list args) {
+    uint8_t ring;
+    uint32_t start, reserved;
+    uint8_t *record = reserve(DEBUG_LOG_MAX_LINE, ring, start, reserved);
+    if (record == nullptr) return false;
+
+    record[0] = level;
+    int len = vsnprintf((char *)record + 1, DEBUG_LOG_MAX_LINE - 1, format, args);
+    if (len < 0) len = 0;
+    if (len >= DEBUG_LOG_MAX_LINE - 1) len = DEBUG_LOG_MAX_LINE - 2;  // Truncated
+    commit(ring, start, reserved, len + 1, false);
+    return true;
+}
+
+uint8_t *DebugLog::pack(uint8_t *p, const char *s) {
+    uint8_t length = stringLength(s);
+    *p++ = DEBUG_ARG_STRING;
+    *p++ = length;
+    if (length > 0) memcpy(p, s, length);
+    return p + length;
+}
+
+// Space for a record in the calling core's ring, after a padding record if
+// it would otherwise run past the end
+uint8_t *DebugLog::reserve(size_t payload, uint8_t &ring, uint32_t &start, uint32_t &reserved) {
+    uint8_t *data = nullptr;
+    uint32_t size = ALIGN(HEADER_SIZE + payload);
+    DEBUG_LOG_LOCAL_BEGIN();
+    ring = core();
+    Ring &r = _rings[ring];
+    uint32_t head = r.head;
+    uint32_t offset = head & RING_MASK;
+    uint32_t pad = offset + size > DEBUG_LOG_RING_SIZE ? DEBUG_LOG_RING_SIZE - offset : 0;
+    uint32_t used = head - r.tail + pad + size;
+    if (payload > DEBUG_LOG_MAX_LINE || used > DEBUG_LOG_RING_SIZE) r.stats.dropped++;
+    else {
+        if (pad > 0) {
+            RecordHeader *padding = (RecordHeader *)&r.data[offset];
+            padding->time = 0;
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            padding->state = COMMITTED | pad;  // No payload, drain() just skips it
+            head += pad;
+            offset = 0;
+        }
+        RecordHeader *header = (RecordHeader *)&r.data[offset];
+        header->time = micros();
+        start = head;
+        reserved = size;
+        r.head = head + size;
+        if (used > r.stats.maxUsed) r.stats.maxUsed = used;
+        data = &r.data[offset + HEADER_SIZE];
+    }
+    DEBUG_LOG_LOCAL_END();
+    return data;
+}
+
+// Publish a reserved record, giving back the unused part of the reservation
+// if nothing was reserved after it. The task may have moved to the other
+// core since reserve(), in which case the ring's head is not its to change.
+void DebugLog::commit(uint8_t ring, uint32_t start, uint32_t reserved, size_t length, bool tokenized) {
+    Ring &r = _rings[ring];
+    RecordHeader *header = (RecordHeader *)&r.data[start & RING_MASK];
+    uint32_t size = reserved;
+    DEBUG_LOG_LOCAL_BEGIN();
+    uint8_t c = core();
+    if (c == ring && r.head == start + reserved) {
+        size = ALIGN(HEADER_SIZE + length);
+        r.head = start + size;
+    }
+    _rings[c].stats.lines++;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    header->state = COMMITTED | (tokenized ? TOKENIZED : 0) | (uint32_t)length << 16 | size;
+    DEBUG_LOG_LOCAL_END();
+}
+
+size_t DebugLog::drain(Print &out) {
+    size_t written = 0;
+    while (true) {
+        // Oldest committed record at the tail of a ring, skipping padding
+        Ring *oldest = nullptr;
+        const RecordHeader *oldestHeader = nullptr;
+        for (uint8_t c = 0; c < DEBUG_LOG_NUM_CORES; c++) {
+            Ring &r = _rings[c];
+            while (r.tail != r.head) {
+                const RecordHeader *header = (const RecordHeader *)&r.data[r.tail & RING_MASK];
+                uint32_t state = header->state;
+                if (!(state & COMMITTED)) break;  // Still being written
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                if (STATE_LENGTH(state) == 0) {
+                    release(r, STATE_SIZE(state));
+                    continue;
+                }
+                if (oldest == nullptr || (int32_t)(header->time - oldestHeader->time) < 0) {
+                    oldest = &r;
+                    oldestHeader = header;
+                }
+                break;
+            }
+        }
+        if (oldest == nullptr) return written;
+
+        uint32_t state = oldestHeader->state;
+        const uint8_t *payload = (const uint8_t *)oldestHeader + HEADER_SIZE;
+        size_t length = STATE_LENGTH(state);
+        bool tokenized = state & TOKENIZED;
+        uint8_t level = recordLevel(payload, tokenized);
+        uint64_t now = uptime();
+        remember(now - (uint32_t)((uint32_t)now - oldestHeader->time), payload, length, tokenized);
+        writeRecord(out, level, payload, length, tokenized, oldestHeader->time, written);
+        release(*oldest, STATE_SIZE(state));
+    }
+}
+
+uint8_t DebugLog::recordLevel(const uint8_t *payload, bool tokenized) {
+    return tokenized ? payload[sizeof(const char *)] : payload[0];
+}
+
+size_t DebugLog::writeLevel(Print &out, uint8_t level) {
+    size_t written = out.print('[');
+    written += out.print(level < _numLevels ? _levelNames[level] : "UNKNOWN");
+    return written + out.print("] ");
+}
+
+void DebugLog::writeRecord(Print &out, uint8_t level, const uint8_t *payload, size_t length, bool tokenized,
+                           uint32_t time, size_t &written) {
+    if (!_binary) {
+        written += writeLevel(out, level);
+        written += format(out, payload, length, tokenized);
+        return;
+    }
+
+    // Tokens whose format the host can't look up go out formatted
+    const char *fmt = nullptr;
+    if (tokenized) memcpy(&fmt, payload, sizeof(fmt));
+    bool inRom = (uintptr_t)fmt >= DEBUG_LOG_ROM_START && (uintptr_t)fmt < DEBUG_LOG_ROM_END;
+
+    CobsPrint frame(out);
+    frame.write(tokenized && inRom ? DEBUG_FRAME_TOKEN : DEBUG_FRAME_TEXT);
+    frame.write((const uint8_t *)&time, 4);
+    if (!tokenized || !inRom) {
+        writeLevel(frame, level);
+        format(frame, payload, length, tokenized);
+    }
+    else {
+        uint32_t address = (uint32_t)(uintptr_t)fmt;
+        frame.write((const uint8_t *)&address, 4);
+        frame.write(payload + sizeof(fmt), length - sizeof(fmt));
+    }
+    written += frame.end();
+}
+
+// Argument of a tokenized record, widened
+struct DebugArg {
+    DebugArgType type;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+    };
+    char s[DEBUG_LOG_MAX_STRING + 1];
+};
+
+static bool nextArg(const uint8_t *&p, const uint8_t *end, DebugArg &arg) {
+    if (p >= end) return false;
+    arg.type = (DebugArgType)*p++;
+    size_t size;
+    switch (arg.type) {
+    case DEBUG_ARG_INT: { int32_t v; size = 4; if (p + size > end) return false; memcpy(&v, p, size); arg.i = v; break; }
+    case DEBUG_ARG_UINT:
+    case DEBUG_ARG_POINTER: { uint32_t v; size = 4; if (p + size > end) return false; memcpy(&v, p, size); arg.u = v; break; }
+    case DEBUG_ARG_INT64:
+    case DEBUG_ARG_UINT64: size = 8; if (p + size > end) return false; memcpy(&arg.u, p, size); break;
+    case DEBUG_ARG_FLOAT: { float v; size = 4; if (p + size > end) return false; memcpy(&v, p, size); arg.d = v; break; }
+    case DEBUG_ARG_DOUBLE: size = 8; if (p + size > end) return false; memcpy(&arg.d, p, size); break;
+    case DEBUG_ARG_STRING:
+        if (p >= end) return false;
+        size = *p++;
+        if (p + size > end || size > DEBUG_LOG_MAX_STRING) return false;
+        memcpy(arg.s, p, size);
+        arg.s[size] = '\0';
+        break;
+    default: return false;
+    }
+    p += size;
+    return true;
+}
+
+// The text of a record. Tokenized ones are printf'd one conversion at a
+// time with the argument's own type, so a mismatched conversion prints the
+// value rather than garbage.
+size_t DebugLog::format(Print &out, const uint8_t *payload, size_t length, bool tokenized) {
+    if (!tokenized) return out.write(payload + 1, length - 1);
+    const char *fmt;
+    memcpy(&fmt, payload, sizeof(fmt));
+    const uint8_t *p = payload + sizeof(fmt) + 1, *end = payload + length;
+
+    DebugArg arg;
+    char spec[24], text[DEBUG_LOG_MAX_STRING + 64];
+    size_t written = 0;
+    while (*fmt) {
+        if (*fmt != '%') {
+            const char *next = strchr(fmt, '%');
+            size_t n = next ? (size_t)(next - fmt) : strlen(fmt);
+            written += out.write((const uint8_t *)fmt, n);
+            fmt += n;
+            continue;
+        }
+        if (fmt[1] == '%') {
+            written += out.print('%');
+            fmt += 2;
+            continue;
+        }
+
+        // Flags, width and precision, with * taken from the arguments. The
+        // last 4 bytes of spec are kept for "ll", the conversion and the NUL.
+        size_t n = 0;
+        bool fits = true;
+        spec[n++] = *fmt++;
+        while (*fmt && strchr("-+ #0", *fmt) && n < 8) spec[n++] = *fmt++;
+        for (uint8_t part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*fmt != '.') break;
+                fmt++;
+                if (n + 1 < sizeof(spec) - 4) spec[n++] = '.';
+                else fits = false;
+            }
+            if (*fmt == '*') {
+                fmt++;
+                int v = nextArg(p, end, arg) && arg.type != DEBUG_ARG_STRING ? (int)arg.i : 0;
+                int len = fits ? snprintf(spec + n, sizeof(spec) - 4 - n, "%d", v) : -1;
+                if (len >= 0 && n + len < sizeof(spec) - 4) n += len;
+                else fits = false;
+            }
+            else while (isdigit((unsigned char)*fmt)) {
+                if (n < sizeof(spec) - 5) spec[n++] = *fmt;
+                else fits = false;
+                fmt++;
+            }
+        }
+        while (*fmt && strchr("hlLqjzt", *fmt)) fmt++;  // The argument's own size is used
+        char conversion = *fmt;
+        if (conversion == '\0') break;
+        fmt++;
+
+        if (!nextArg(p, end, arg) || !fits) {
+            written += out.print("(?)");
+            continue;
+        }
+        bool isFloat = arg.type == DEBUG_ARG_FLOAT || arg.type == DEBUG_ARG_DOUBLE;
+        bool isSigned = arg.type == DEBUG_ARG_INT || arg.type == DEBUG_ARG_INT64;
+        if (strchr("fFeEgGaA", conversion)) {
+            spec[n++] = conversion;
+            spec[n] = '\0';
+            snprintf(text, sizeof(text), spec, isFloat ? arg.d : isSigned ? (double)arg.i : (double)arg.u);
+        }
+        else if (strchr("diouxX", conversion)) {
+            spec[n++] = 'l';
+            spec[n++] = 'l';
+            spec[n++] = conversion;
+            spec[n] = '\0';
+            long long v = isFloat ? (long long)arg.d : (long long)arg.i;
+            snprintf(text, sizeof(text), spec, v);
+        }
+        else if (conversion == 'c') {
+            // No length modifier: "%llc" isn't a conversion
+            spec[n++] = 'c';
+            spec[n] = '\0';
+            int v = isFloat ? (int)arg.d : (int)arg.i;
+            snprintf(text, sizeof(text), spec, v);
+        }
+        else if (conversion == 's') {
+            spec[n++] = 's';
+            spec[n] = '\0';
+            if (arg.type != DEBUG_ARG_STRING) strcpy(arg.s, "(?)");
+            snprintf(text, sizeof(text), spec, arg.s);
+        }
+        else if (conversion == 'p') snprintf(text, sizeof(text), "0x%08lx", (unsigned long)arg.u);
+        else text[0] = '\0';
+        written += out.print(text);
+    }
+    return written;
+}
+
+// Copy a drained record to the history, overwriting the oldest lines to
+// make room. The tail is moved past them before they are overwritten.
+void DebugLog::remember(uint64_t time, const uint8_t *payload, size_t length, bool tokenized) {
+    uint32_t size = HISTORY_ALIGN(HISTORY_HEADER_SIZE + length);
+    uint32_t head = _historyHead;
+    uint32_t offset = head & HISTORY_MASK;
+    uint32_t pad = offset + size > DEBUG_LOG_HISTORY_SIZE ? DEBUG_LOG_HISTORY_SIZE - offset : 0;
+
+    uint32_t tail = _historyTail, first = _historyFirst;
+    while (head + pad + size - tail > DEBUG_LOG_HISTORY_SIZE) {
+        const HistoryHeader *old = (const HistoryHeader *)&_history[tail & HISTORY_MASK];
+        if (old->flags & HISTORY_PADDING) tail += DEBUG_LOG_HISTORY_SIZE - (tail & HISTORY_MASK);
+        else {
+            tail += HISTORY_ALIGN(HISTORY_HEADER_SIZE + old->length);
+            first++;
+        }
+    }
+    _historyFirst = first;
+    _historyTail = tail;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (pad > 0) {
+        HistoryHeader *padding = (HistoryHeader *)&_history[offset];
+        padding->flags = HISTORY_PADDING;
+        head += pad;
+        offset = 0;
+    }
+    HistoryHeader *header = (HistoryHeader *)&_history[offset];
+    header->seq = _historyNext;
+    header->length = length;
+    header->flags = tokenized ? HISTORY_TOKENIZED : 0;
+    header->time = time;
+    memcpy(&_history[offset + HISTORY_HEADER_SIZE], payload, length);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    _historyHead = head + size;
+    _historyNext = _historyNext + 1;
+}
+
+bool DebugLog::readHistory(uint32_t &cursor, uint32_t levels, DebugLogEntry &entry) {
+    alignas(8) uint8_t copy[HISTORY_HEADER_SIZE + DEBUG_LOG_MAX_LINE];
+    const HistoryHeader *header = (const HistoryHeader *)copy;
+
+    // Carry on from the last read if this continues it
+    uint32_t tail = _historyTail;
+    uint32_t pos = _hintSeq == cursor && (int32_t)(_hintPos - tail) >= 0 ? _hintPos : tail;
+    while (true) {
+        uint32_t head = _historyHead;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (pos == head) return false;
+
+        uint32_t offset = pos & HISTORY_MASK;
+        memcpy(copy, &_history[offset], HISTORY_HEADER_SIZE);
+        size_t length = header->length;
+        bool padding = header->flags & HISTORY_PADDING;
+        bool wanted = !padding && (int32_t)(header->seq - cursor) >= 0 && length <= DEBUG_LOG_MAX_LINE;
+        if (wanted) memcpy(copy + HISTORY_HEADER_SIZE, &_history[offset + HISTORY_HEADER_SIZE], length);
+
+        // Overwritten while it was copied, start again from the oldest line
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        tail = _historyTail;
+        if ((int32_t)(pos - tail) < 0) {
+            pos = tail;
+            continue;
+        }
+
+        pos += padding ? DEBUG_LOG_HISTORY_SIZE - offset : HISTORY_ALIGN(HISTORY_HEADER_SIZE + length);
+        if (!wanted) continue;
+        cursor = header->seq + 1;
+        _hintSeq = cursor;
+        _hintPos = pos;
+
+        bool tokenized = header->flags & HISTORY_TOKENIZED;
+        const uint8_t *payload = copy + HISTORY_HEADER_SIZE;
+        uint8_t level = recordLevel(payload, tokenized);
+        if (level >= 32 || !(levels & (1u << level))) continue;
+
+        entry.seq = header->seq;
+        entry.time = header->time;
+        entry.level = level;
+        BufferPrint text(entry.text, sizeof(entry.text));
+        format(text, payload, length, tokenized);
+        return true;
+    }
+}
+
+// Hand the record at the tail back to the producers, zeroed so that
+// whatever is reserved there next reads as not yet committed
+void DebugLog::release(Ring &ring, uint32_t size) {
+    memset(&ring.data[ring.tail & RING_MASK], 0, size);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ring.tail = ring.tail + size;
+}
+
+bool DebugLog::empty() const {
+    for (uint8_t c = 0; c < DEBUG_LOG_NUM_CORES; c++) {
+        if (_rings[c].tail != _rings[c].head) return false;
+    }
+    return true;
+}
+
+DebugLogStats DebugLog::stats() const {
+    DebugLogStats total = {};
+    for (uint8_t c = 0; c < DEBUG_LOG_NUM_CORES; c++) {
+        total.lines += _rings[c].stats.lines;
+        total.dropped += _rings[c].stats.dropped;
+        if (_rings[c].stats.maxUsed > total.maxUsed) total.maxUsed = _rings[c].stats.maxUsed;
+    }
+    return total;
+}
@@ -0,0 +1,281 @@
+#ifndef DEBUG_LOG_H
+#define DEBUG_LOG_H
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// Asynchronous debug output.
+//
+// Lines are queued in a ring buffer and the caller returns; it never waits
+// for the serial port or for another task. drain(), called from a low
+// priority task, writes queued lines out. When a ring is full the line is
+// dropped and counted instead of blocking the caller.
+//
+// There is one ring per core, so the only producers of a ring are the tasks
+// of its core. Reserving space masks interrupts on that core for a few
+// instructions, which is enough to keep those tasks from interleaving, and
+// nothing is shared with the other core but the head and tail indices of
+// the consumer. The Cortex-M0+ has no atomic read-modify-write, so this is
+// also what keeps it lock-free. Lines carry a µs timestamp and drain()
+// merges the rings in time order.
+//
+// Lines are queued one of two ways:
+//
+//   log()      tokenized: only the address of the format string and the raw
+//              argument values (with a type tag each) are stored, so a call
+//              costs a reservation and a few stores rather than a
+//              vsnprintf, and a line takes a fraction of the ring space.
+//              drain() formats it later, or writes it out as is in binary
+//              mode for scripts/decode_debug_log.py to format on the host
+//              from the firmware ELF.
+//   printf()   formatted in place into space reserved for the longest line,
+//              the reservation then cut down to what was used (unless
+//              another task of the core reserved after it in the meantime,
+//              which only wastes the difference until it is drained).
+//
+// A log() format string must outlive the line, which string literals do.
+// Strings passed as arguments are copied, up to DEBUG_LOG_MAX_STRING bytes.
+//
+// drain() also keeps the lines it writes out in a history ring, still
+// tokenized, for readHistory(). Each line there has a sequence number, which
+// readers use as a cursor to fetch only the lines after the ones they have.
+// The history has a single writer, drain(), and readers never block it: a
+// reader checks after copying a line that the writer did not overwrite it
+// meanwhile, and if it did, carries on from the oldest line. readHistory()
+// is for one task at a time.
+//
+// Binary mode frames, each COBS encoded and followed by a 0 byte:
+//
+//   u8 kind (DEBUG_FRAME_TEXT or DEBUG_FRAME_TOKEN), u32 time in µs, then
+//   text:    the formatted line
+//   token:   u32 format string address, u8 level, then per argument a
+//            DebugArgType tag and its value (strings: u8 length + bytes),
+//            all little endian
+
+#ifndef DEBUG_LOG_RING_SIZE
+#define DEBUG_LOG_RING_SIZE 4096        // Bytes per core, a power of two
+#endif
+#ifndef DEBUG_LOG_MAX_LINE
+#define DEBUG_LOG_MAX_LINE 256          // Longest line or tokenized record, longer ones are truncated or dropped
+#endif
+#ifndef DEBUG_LOG_MAX_STRING
+#define DEBUG_LOG_MAX_STRING 64         // Longest string argument copied by log()
+#endif
+#ifndef DEBUG_LOG_HISTORY_SIZE
+#define DEBUG_LOG_HISTORY_SIZE 8192     // Bytes of drained lines kept for readHistory(), a power of two
+#endif
+#ifndef DEBUG_LOG_NUM_CORES
+#define DEBUG_LOG_NUM_CORES 2
+#endif
+
+// Where string literals live, so their address is enough for the host to
+// find them in the ELF. Tokenized lines with a format anywhere else are
+// formatted on the device even in binary mode.
+#ifndef DEBUG_LOG_ROM_START
+#ifdef ARDUINO_ARCH_RP2040
+#define DEBUG_LOG_ROM_START 0x10000000u  // XIP flash
+#define DEBUG_LOG_ROM_END 0x11000000u
+#else
+#define DEBUG_LOG_ROM_START 0u
+#define DEBUG_LOG_ROM_END 0u
+#endif
+#endif
+
+static_assert((DEBUG_LOG_RING_SIZE & (DEBUG_LOG_RING_SIZE - 1)) == 0, "DEBUG_LOG_RING_SIZE must be a power of two");
+static_assert((DEBUG_LOG_HISTORY_SIZE & (DEBUG_LOG_HISTORY_SIZE - 1)) == 0, "DEBUG_LOG_HISTORY_SIZE must be a power of two");
+static_assert(DEBUG_LOG_MAX_STRING <= 255, "String arguments have a one byte length");
+
+enum DebugArgType : uint8_t {
+    DEBUG_ARG_INT = 1,      // int32
+    DEBUG_ARG_UINT,         // uint32
+    DEBUG_ARG_INT64,
+    DEBUG_ARG_UINT64,
+    DEBUG_ARG_FLOAT,        // float32
+    DEBUG_ARG_DOUBLE,       // float64
+    DEBUG_ARG_STRING,       // u8 length + bytes
+    DEBUG_ARG_POINTER,      // uint32
+};
+
+enum DebugFrameKind : uint8_t {
+    DEBUG_FRAME_TEXT = 1,
+    DEBUG_FRAME_TOKEN,
+};
+
+struct DebugLogStats {
+    uint32_t lines;         // Queued
+    uint32_t dropped;       // Lost to a full ring
+    uint32_t maxUsed;       // Most bytes queued in one ring at once
+};
+
+// A line from the history
+struct DebugLogEntry {
+    uint32_t seq;
+    uint64_t time;                      // µs since boot
+    uint8_t level;
+    char text[DEBUG_LOG_MAX_LINE];      // Formatted, without the "[level] " prefix
+};
+
+class DebugLog {
+public:
+    // Names of the log() levels, for formatting on the device
+    void setLevelNames(const char *const *names, uint8_t count);
+
+    // Tokenized line. False if it was dropped.
+    template <typename... Args>
+    bool log(uint8_t level, const char *format, const Args &...args);
+
+    // Queue a line formatted now
+    bool printf(uint8_t level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+    bool vprintf(uint8_t level, const char *format, va_list args);
+
+    // Write queued lines to out, oldest first. Returns the bytes written.
+    // Only one task may drain.
+    size_t drain(Print &out);
+
+    // Write frames for the host decoder rather than text
+    void setBinary(bool binary) { _binary = binary; }
+    bool binary() const { return _binary; }
+
+    bool empty() const;
+
+    // Summed over the cores
+    DebugLogStats stats() const;
+
+    // The first line from sequence number cursor on with a level in the levels bit mask
+    // (bit n for level n). cursor is moved past it. False when there are no
+    // more; lines already overwritten are skipped.
+    bool readHistory(uint32_t &cursor, uint32_t levels, DebugLogEntry &entry);
+
+    // Sequence numbers of the oldest line in the history and of the next
+    // line to be added
+    uint32_t historyFirst() const { return _historyFirst; }
+    uint32_t historyNext() const { return _historyNext; }
+
+private:
+    // Every record starts 8 byte aligned with this header, so a header never
+    // wraps around the end of the ring
+    struct RecordHeader {
+        volatile uint32_t state;  // 0 while being written, then COMMITTED, TOKENIZED, length << 16 and size
+        uint32_t time;            // µs
+    };
+
+    // History records start aligned to the size of this header, so whatever
+    // is left at the end of the history always fits a padding header
+    struct HistoryHeader {
+        uint32_t seq;
+        uint16_t length;
+        uint8_t flags;
+        uint8_t reserved;
+        uint64_t time;            // µs since boot
+    };
+    static_assert((sizeof(HistoryHeader) & (sizeof(HistoryHeader) - 1)) == 0, "HistoryHeader size must be a power of two");
+
+    struct Ring {
+        alignas(8) uint8_t data[DEBUG_LOG_RING_SIZE];
+        volatile uint32_t head = 0;     // Free running byte counts, written by the core's tasks
+        volatile uint32_t tail = 0;     // and by drain()
+        DebugLogStats stats = {};
+    };
+
+    // Argument packing for log(), by type
+    static size_t stringLength(const char *s) {
+        size_t n = 0;
+        while (s && n < DEBUG_LOG_MAX_STRING && s[n]) n++;
+        return n;
+    }
+    static size_t argSize(const char *s) { return 2 + stringLength(s); }
+    static size_t argSize(char *s) { return argSize((const char *)s); }
+    template <typename T>
+    static constexpr size_t argSize(const T &) { return 1 + (std::is_arithmetic<T>::value && sizeof(T) > 4 ? 8 : 4); }
+    static uint8_t *pack(uint8_t *p, const char *s);
+    static uint8_t *pack(uint8_t *p, char *s) { return pack(p, (const char *)s); }
+    template <typename T>
+    static uint8_t *pack(uint8_t *p, const T &value);
+    static uint8_t *put(uint8_t *p, DebugArgType type, const void *value, size_t size) {
+        *p++ = type;
+        memcpy(p, value, size);
+        return p + size;
+    }
+
+    uint8_t *reserve(size_t payload, uint8_t &ring, uint32_t &start, uint32_t &reserved);
+    void commit(uint8_t ring, uint32_t start, uint32_t reserved, size_t length, bool tokenized);
+    void release(Ring &ring, uint32_t size);
+    void writeRecord(Print &out, uint8_t level, const uint8_t *payload, size_t length, bool tokenized, uint32_t time, size_t &written);
+    size_t writeLevel(Print &out, uint8_t level);
+    static size_t format(Print &out, const uint8_t *payload, size_t length, bool tokenized);
+    static uint8_t recordLevel(const uint8_t *payload, bool tokenized);
+    void remember(uint64_t time, const uint8_t *payload, size_t length, bool tokenized);
+    static uint8_t core();
+    static uint64_t uptime();
+
+    Ring _rings[DEBUG_LOG_NUM_CORES];
+    const char *const *_levelNames = nullptr;
+    uint8_t _numLevels = 0;
+    volatile bool _binary = false;
+
+    alignas(8) uint8_t _history[DEBUG_LOG_HISTORY_SIZE];
+    volatile uint32_t _historyHead = 0;     // Free running byte counts
+    volatile uint32_t _historyTail = 0;     // Moved before the space is reused
+    volatile uint32_t _historyFirst = 0;
+    volatile uint32_t _historyNext = 0;
+    uint32_t _hintSeq = 0;                  // Where the last readHistory() left off,
+    uint32_t _hintPos = 0;                  // so tailing readers don't search
+};
+
+template <typename T>
+uint8_t *DebugLog::pack(uint8_t *p, const T &value) {
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+                  "log() arguments must be numbers, enums, pointers or strings");
+    if constexpr (std::is_pointer<T>::value) {
+        uint32_t v = (uint32_t)(uintptr_t)value;
+        return put(p, DEBUG_ARG_POINTER, &v, 4);
+    }
+    else if constexpr (std::is_floating_point<T>::value) {
+        if constexpr (sizeof(T) > 4) {
+            double v = value;
+            return put(p, DEBUG_ARG_DOUBLE, &v, 8);
+        }
+        else {
+            float v = value;
+            return put(p, DEBUG_ARG_FLOAT, &v, 4);
+        }
+    }
+    else if constexpr (sizeof(T) > 4) {
+        if constexpr (std::is_signed<T>::value) {
+            int64_t v = value;
+            return put(p, DEBUG_ARG_INT64, &v, 8);
+        }
+        else {
+            uint64_t v = value;
+            return put(p, DEBUG_ARG_UINT64, &v, 8);
+        }
+    }
+    else if constexpr (std::is_enum<T>::value || std::is_signed<T>::value) {
+        int32_t v = (int32_t)value;
+        return put(p, DEBUG_ARG_INT, &v, 4);
+    }
+    else {
+        uint32_t v = value;
+        return put(p, DEBUG_ARG_UINT, &v, 4);
+    }
+}
+
+template <typename... Args>
+bool DebugLog::log(uint8_t level, const char *format, const Args &...args) {
+    size_t size = sizeof(format) + 1 + (0 + ... + argSize(args));
+    uint8_t ring;
+    uint32_t start, reserved;
+    uint8_t *p = reserve(size, ring, start, reserved);
+    if (p == nullptr) return false;
+    memcpy(p, &format, sizeof(format));
+    p += sizeof(format);
+    *p++ = level;
+    ((p = pack(p, args)), ...);
+    commit(ring, start, reserved, size, true);
+    return true;
+}
+
+#endif /* DEBUG_LOG_H */
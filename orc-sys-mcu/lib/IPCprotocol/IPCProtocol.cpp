@@ -53,12 +53,13 @@ bool IPCProtocol::sendMessage(const Message& msg) {
 
 
     _serial.write(buffer, bufferIndex);
+    _stats.framesSent++;
     
     return true;
 }
 
 void IPCProtocol::registerCallback(uint8_t msgId, std::function<void(const Message&)> callback) {
-  if (_numCallbacks < 10) {
+  if (_numCallbacks < MAX_CALLBACKS) {
       _callbacks[_numCallbacks].msgId = msgId;
       _callbacks[_numCallbacks].callback = callback;
       _numCallbacks++;
@@ -81,6 +82,7 @@ void IPCProtocol::update() {
         {
           if (_rxBufferIndex > (int)(sizeof(Message) + 2)) {
             // message is too large, error.
+            _stats.oversized++;
             _rxBufferIndex = 0; // reset buffer for next message
             continue;
           }
@@ -95,17 +97,22 @@ void IPCProtocol::update() {
 
             if (calculatedCrc == receivedCrc)
             {
-               for (int i = 0; i < _numCallbacks; i++) {
+               _stats.framesReceived++;
+               int i;
+               for (i = 0; i < _numCallbacks; i++) {
                     if (_callbacks[i].msgId == msg.msgId) {
                     _callbacks[i].callback(msg);
                     break; // Exit loop once the handler is found
                 }
               }
+              if (i == _numCallbacks) _stats.unhandled++;
             }
+            else _stats.crcErrors++;
             _rxBufferIndex = 0; // reset buffer for next message
         }
        if(_rxBufferIndex >= (int)(sizeof(Message)+2)) {
             // If we exceed the maximum size of the buffer then reset for the next message.
+           _stats.oversized++;
            _rxBufferIndex = 0;
         }
     }
@@ -8,6 +8,9 @@
 // Define the maximum size of the data payload (adjust as needed)
 #define MAX_PAYLOAD_SIZE 128
 
+// Maximum number of message handlers (one per sensor and control message type)
+#define MAX_CALLBACKS 20
+
 // Define a generic Message struct
 struct Message {
   uint8_t msgId;
@@ -17,6 +20,15 @@ struct Message {
   uint16_t crc;
 };
 
+// Frame counters, only ever incremented
+struct IPCStats {
+  uint32_t framesSent;
+  uint32_t framesReceived;  // Valid frames, handled or not
+  uint32_t crcErrors;
+  uint32_t oversized;       // Frames discarded for exceeding the receive buffer
+  uint32_t unhandled;       // Valid frames with no registered callback
+};
+
 // Define a structure for mapping a message ID to a callback function
 struct MessageCallback {
   uint8_t msgId;
@@ -43,11 +55,14 @@ public:
     // Calculate the CRC value from the message (without the CRC field).
     uint16_t calculateCRC(const Message& msg) const;
 
+    // Frame counters since begin()
+    const IPCStats& stats() const { return _stats; }
+
 private:
   HardwareSerial& _serial;
 
   // Array to store registered callbacks
-  MessageCallback _callbacks[10]; // Store 10 message handlers
+  MessageCallback _callbacks[MAX_CALLBACKS]; // Registered message handlers
   int _numCallbacks = 0; // Track the number of callbacks
     
     // Start and end delimiter constants
@@ -57,6 +72,8 @@ private:
     // Receive buffer
     uint8_t _rxBuffer[MAX_PAYLOAD_SIZE + 7];
     int _rxBufferIndex = 0;
+
+    IPCStats _stats = {};
 };
 
 #endif /* IPC_PROTOCOL_H */
\ No newline at end of file
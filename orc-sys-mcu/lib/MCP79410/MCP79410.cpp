@@ -119,6 +119,15 @@ bool MCP79410::getTime(uint8_t &hour, uint8_t &minute, uint8_t &second) {
     return true;
 }
 
+bool MCP79410::getSeconds(uint8_t &second) {
+    uint8_t sec = read_register(REG_RTCSEC);
+    if (sec == 0xFF) {
+        return false;
+    }
+    second = bcd2dec(sec & 0x7F);
+    return true;
+}
+
 bool MCP79410::getDate(uint16_t &year, uint8_t &month, uint8_t &day) {
     uint8_t yr = read_register(REG_RTCYEAR);
     uint8_t mth = read_register(REG_RTCMTH);
@@ -50,6 +50,7 @@ public:
     bool getDateTime(uint16_t &year, uint8_t &month, uint8_t &day,
                     uint8_t &hour, uint8_t &minute, uint8_t &second);
     bool getDateTime(DateTime* dateTime);
+    bool getSeconds(uint8_t &second);   // One register read, for timing the seconds tick
     
     // SRAM operations
     bool writeSRAM(uint8_t address, uint8_t data);
@@ -0,0 +1,148 @@
+#include "Metrics.h"
+
+#ifdef ARDUINO_ARCH_RP2040
+#include <hardware/sync.h>
+#define METRICS_LOCAL_BEGIN() uint32_t _irqState = save_and_disable_interrupts()
+#define METRICS_LOCAL_END() restore_interrupts(_irqState)
+#else
+#define METRICS_LOCAL_BEGIN()
+#define METRICS_LOCAL_END()
+#endif
+
+static const char *metricTypeName[] = {"counter", "gauge", "histogram"};
+
+Metric *Metric::_first = nullptr;
+MetricsCollector Metric::_collectors[METRICS_MAX_COLLECTORS];
+uint8_t Metric::_numCollectors = 0;
+
+Metric::Metric(const char *name, const char *help, const char *labels, MetricType type)
+    : _name(name), _help(help), _labels(labels), _type(type), _next(nullptr) {
+    // Append, so metrics render in declaration order
+    Metric **link = &_first;
+    while (*link) link = &(*link)->_next;
+    *link = this;
+}
+
+uint8_t Metric::core() {
+#ifdef ARDUINO_ARCH_RP2040
+    return get_core_num();
+#else
+    return 0;
+#endif
+}
+
+bool Metric::addCollector(MetricsCollector collector) {
+    if (_numCollectors >= METRICS_MAX_COLLECTORS) return false;
+    _collectors[_numCollectors++] = collector;
+    return true;
+}
+
+void Metric::writeAll(Print &out) {
+    for (Metric *m = _first; m; m = m->_next) {
+        // Each family is written once, at its first member
+        bool seen = false;
+        for (Metric *p = _first; p != m; p = p->_next) {
+            if (strcmp(p->_name, m->_name) == 0) {
+                seen = true;
+                break;
+            }
+        }
+        if (seen) continue;
+        out.printf("# HELP %s %s\n# TYPE %s %s\n", m->_name, m->_help, m->_name, metricTypeName[m->_type]);
+        for (Metric *f = m; f; f = f->_next) {
+            if (strcmp(f->_name, m->_name) == 0) f->writeSamples(out);
+        }
+    }
+    for (uint8_t i = 0; i < _numCollectors; i++) _collectors[i](out);
+}
+
+void Metric::writeName(Print &out, const char *suffix, const char *extraLabel) const {
+    out.print(_name);
+    if (suffix) out.print(suffix);
+    bool hasLabels = _labels && _labels[0];
+    if (!hasLabels && !extraLabel) return;
+    out.print('{');
+    if (hasLabels) out.print(_labels);
+    if (extraLabel) {
+        if (hasLabels) out.print(',');
+        out.print(extraLabel);
+    }
+    out.print('}');
+}
+
+MetricsCounter::MetricsCounter(const char *name, const char *help, const char *labels)
+    : Metric(name, help, labels, METRIC_COUNTER) {}
+
+void MetricsCounter::inc(uint32_t n) {
+    // Core is read with interrupts masked so the task can't migrate in between
+    METRICS_LOCAL_BEGIN();
+    uint8_t c = core();
+    _value[c] += n;
+    METRICS_LOCAL_END();
+}
+
+uint32_t MetricsCounter::value() const {
+    uint32_t total = 0;
+    for (uint8_t c = 0; c < METRICS_NUM_CORES; c++) total += _value[c];
+    return total;
+}
+
+void MetricsCounter::writeSamples(Print &out) const {
+    writeName(out, nullptr);
+    out.printf(" %lu\n", (unsigned long)value());
+}
+
+MetricsGauge::MetricsGauge(const char *name, const char *help, const char *labels)
+    : Metric(name, help, labels, METRIC_GAUGE) {}
+
+void MetricsGauge::writeSamples(Print &out) const {
+    writeName(out, nullptr);
+    out.printf(" %g\n", (double)_value);
+}
+
+MetricsHistogram::MetricsHistogram(const char *name, const char *help, const char *labels,
+                                   const float *bounds, uint8_t numBounds)
+    : Metric(name, help, labels, METRIC_HISTOGRAM), _bounds(bounds),
+      _numBounds(numBounds > METRICS_MAX_BUCKETS ? METRICS_MAX_BUCKETS : numBounds) {}
+
+void MetricsHistogram::observe(float value) {
+    uint8_t bucket = 0;
+    while (bucket < _numBounds && value > _bounds[bucket]) bucket++;
+    METRICS_LOCAL_BEGIN();
+    uint8_t c = core();
+    _counts[c][bucket]++;
+    _sumSequence[c]++;
+    _sum[c] += value;
+    _sumSequence[c]++;
+    METRICS_LOCAL_END();
+}
+
+void MetricsHistogram::writeSamples(Print &out) const {
+    // Prometheus buckets are cumulative. The other core may update its slot
+    // while this runs, so a scrape can be off by the samples added meanwhile.
+    uint32_t cumulative = 0;
+    char le[24];
+    for (uint8_t b = 0; b <= _numBounds; b++) {
+        for (uint8_t c = 0; c < METRICS_NUM_CORES; c++) cumulative += _counts[c][b];
+        if (b < _numBounds) snprintf(le, sizeof(le), "le=\"%g\"", (double)_bounds[b]);
+        else strcpy(le, "le=\"+Inf\"");
+        writeName(out, "_bucket", le);
+        out.printf(" %lu\n", (unsigned long)cumulative);
+    }
+    double sum = 0;
+    for (uint8_t c = 0; c < METRICS_NUM_CORES; c++) {
+        // The update runs with interrupts masked, so only the other core can
+        // be part way through one and the retry is a few instructions at most
+        uint32_t sequence;
+        double value;
+        do {
+            sequence = _sumSequence[c];
+            value = _sum[c];
+        } while ((sequence & 1) || sequence != _sumSequence[c]);
+        sum += value;
+    }
+    writeName(out, "_sum");
+    out.printf(" %g\n", sum);
+    writeName(out, "_count");
+    out.printf(" %lu\n", (unsigned long)cumulative);
+}
@@ -0,0 +1,115 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+// Lightweight metrics registry rendered in the Prometheus text format.
+//
+// Metrics are declared as globals and register themselves on construction.
+// Updates are lock-free across cores: every metric keeps one slot per core
+// and an update only touches the slot of the core it runs on, with
+// interrupts masked for the few instructions of the read-modify-write so
+// tasks on the same core can't interleave. Slots are summed when rendering.
+
+#ifndef METRICS_NUM_CORES
+#define METRICS_NUM_CORES 2
+#endif
+#ifndef METRICS_MAX_BUCKETS
+#define METRICS_MAX_BUCKETS 12
+#endif
+#ifndef METRICS_MAX_COLLECTORS
+#define METRICS_MAX_COLLECTORS 8
+#endif
+
+enum MetricType { METRIC_COUNTER, METRIC_GAUGE, METRIC_HISTOGRAM };
+
+// Writes samples that are only known at scrape time (task stacks, library
+// statistics), including their own # HELP / # TYPE lines
+typedef void (*MetricsCollector)(Print &out);
+
+class Metric {
+public:
+    // labels is the inside of the label set, e.g. "route=\"/api/state\"", or nullptr
+    Metric(const char *name, const char *help, const char *labels, MetricType type);
+
+    // Render every registered metric and collector
+    static void writeAll(Print &out);
+    static bool addCollector(MetricsCollector collector);
+
+protected:
+    virtual void writeSamples(Print &out) const = 0;
+    void writeName(Print &out, const char *suffix, const char *extraLabel = nullptr) const;
+    static uint8_t core();
+
+    const char *_name;
+    const char *_help;
+    const char *_labels;
+    MetricType _type;
+
+private:
+    Metric *_next;
+    static Metric *_first;
+    static MetricsCollector _collectors[METRICS_MAX_COLLECTORS];
+    static uint8_t _numCollectors;
+};
+
+class MetricsCounter : public Metric {
+public:
+    MetricsCounter(const char *name, const char *help, const char *labels = nullptr);
+    void inc(uint32_t n = 1);
+    uint32_t value() const;  // Wraps at 2^32, which Prometheus treats as a counter reset
+
+protected:
+    void writeSamples(Print &out) const override;
+
+private:
+    volatile uint32_t _value[METRICS_NUM_CORES] = {};  // 32-bit so reads never tear
+};
+
+class MetricsGauge : public Metric {
+public:
+    MetricsGauge(const char *name, const char *help, const char *labels = nullptr);
+    // A single aligned 32-bit store, so no per-core slots are needed
+    void set(float value) { _value = value; }
+    float value() const { return _value; }
+
+protected:
+    void writeSamples(Print &out) const override;
+
+private:
+    volatile float _value = 0;
+};
+
+class MetricsHistogram : public Metric {
+public:
+    // bounds are the upper bounds of the buckets in ascending order, +Inf is implied
+    MetricsHistogram(const char *name, const char *help, const char *labels,
+                     const float *bounds, uint8_t numBounds);
+    void observe(float value);
+
+protected:
+    void writeSamples(Print &out) const override;
+
+private:
+    const float *_bounds;
+    uint8_t _numBounds;
+    volatile uint32_t _counts[METRICS_NUM_CORES][METRICS_MAX_BUCKETS + 1] = {};
+    // A double takes two stores on the M0+, so the other core reading a sum
+    // retries while the slot's sequence is odd or changed under it
+    volatile uint32_t _sumSequence[METRICS_NUM_CORES] = {};
+    volatile double _sum[METRICS_NUM_CORES] = {};
+};
+
+// Measures the time from construction to destruction into a histogram, in seconds
+class MetricsTimer {
+public:
+    MetricsTimer(MetricsHistogram &histogram) : _histogram(histogram), _start(micros()) {}
+    ~MetricsTimer() { _histogram.observe((micros() - _start) * 1e-6f); }
+
+private:
+    MetricsHistogram &_histogram;
+    uint32_t _start;
+};
+
+#endif /* METRICS_H */
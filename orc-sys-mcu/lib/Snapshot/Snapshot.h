@@ -0,0 +1,98 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// Shared struct that readers copy without locking.
+//
+// Two buffers, one published. A writer copies the published buffer into the
+// other one, changes it and publishes it, so readers never see a partial
+// update and never wait, and writers never wait for readers. Each buffer has
+// a guard counter that is odd while it is being written; a reader that finds
+// the guard moved while it was copying (a second update started on the
+// buffer it was reading) copies again.
+//
+// Writers are serialised with an RP2040 hardware spin lock taken with
+// interrupts masked, held for the copy and the update function only. It is
+// shared by all snapshots, so an update must be short, must not block and
+// must not update another snapshot.
+
+#ifdef ARDUINO_ARCH_RP2040
+#include <hardware/sync.h>
+#ifndef SNAPSHOT_SPIN_LOCK
+#define SNAPSHOT_SPIN_LOCK PICO_SPINLOCK_ID_STRIPED_FIRST
+#endif
+#define SNAPSHOT_LOCK() uint32_t _irqState = spin_lock_blocking(spin_lock_instance(SNAPSHOT_SPIN_LOCK))
+#define SNAPSHOT_UNLOCK() spin_unlock(spin_lock_instance(SNAPSHOT_SPIN_LOCK), _irqState)
+#else
+#define SNAPSHOT_LOCK()
+#define SNAPSHOT_UNLOCK()
+#endif
+
+template <typename T>
+class Snapshot {
+    static_assert(std::is_trivially_copyable<T>::value, "Snapshot holds plain structs");
+
+public:
+    Snapshot() : _buffers() {}
+
+    // Consistent copy of the published value
+    void read(T &value) const {
+        while (true) {
+            uint8_t front = _front;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            uint32_t guard = _guard[front];
+            if (guard & 1) continue;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            memcpy(&value, (const void *)&_buffers[front], sizeof(T));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (_guard[front] == guard) return;
+        }
+    }
+
+    T read() const {
+        T value;
+        read(value);
+        return value;
+    }
+
+    // Publish the current value as changed by update(T &)
+    template <typename UpdateFn>
+    void update(UpdateFn update) {
+        SNAPSHOT_LOCK();
+        uint8_t front = _front;
+        uint8_t back = front ^ 1;
+        _guard[back] = _guard[back] + 1;  // Odd: being written
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        memcpy(&_buffers[back], &_buffers[front], sizeof(T));
+        update(_buffers[back]);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        _guard[back] = _guard[back] + 1;  // Even: stable again
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        _front = back;
+        SNAPSHOT_UNLOCK();
+    }
+
+    // Publish a whole new value, without first copying the current one
+    void write(const T &value) {
+        SNAPSHOT_LOCK();
+        uint8_t back = _front ^ 1;
+        _guard[back] = _guard[back] + 1;  // Odd: being written
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        memcpy(&_buffers[back], &value, sizeof(T));
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        _guard[back] = _guard[back] + 1;  // Even: stable again
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        _front = back;
+        SNAPSHOT_UNLOCK();
+    }
+
+private:
+    T _buffers[2];
+    volatile uint32_t _guard[2] = {0, 0};
+    volatile uint8_t _front = 0;
+};
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,105 @@
+#include "SystemClock.h"
+
+#include <hardware/timer.h>
+
+static int32_t clamp(int64_t value, int32_t limit) {
+    if (value > limit) return limit;
+    if (value < -limit) return -limit;
+    return (int32_t)value;
+}
+
+uint64_t SystemClock::uptime() {
+    return time_us_64();
+}
+
+// us * ppb / 1e9, split so a long gap between syncs can't overflow
+int64_t SystemClock::scale(int64_t us, int32_t ppb) {
+    return us / 1000000 * ppb / 1000 + us % 1000000 * ppb / 1000000000;
+}
+
+int64_t SystemClock::project(const State &s, uint64_t uptimeUs) {
+    int64_t elapsed = (int64_t)(uptimeUs - s.baseUptime);
+    int64_t slewed = (int64_t)((uptimeUs < s.slewEnd ? uptimeUs : s.slewEnd) - s.baseUptime);
+    if (slewed < 0) slewed = 0;
+    return s.baseEpoch + elapsed + scale(elapsed, s.frequency) + scale(slewed, s.slew);
+}
+
+int64_t SystemClock::now() const {
+    // State first, so the time read is never before its base
+    State s = _state.read();
+    if (!s.valid) return 0;
+    return project(s, uptime());
+}
+
+int64_t SystemClock::at(uint64_t uptimeUs) const {
+    State s = _state.read();
+    return s.valid ? project(s, uptimeUs) : 0;
+}
+
+void SystemClock::set(int64_t epochUs, uint64_t uptimeUs) {
+    _state.update([&](State &s) {
+        s.baseUptime = uptimeUs;
+        s.baseEpoch = epochUs;
+        s.slew = 0;
+        s.slewEnd = uptimeUs;
+        s.lastSync = 0;         // No frequency estimate across a step
+        s.stepNext = true;
+        if (s.valid) s.steps++;
+        s.generation++;
+        s.valid = true;
+    });
+}
+
+bool SystemClock::discipline(int64_t epochUs, uint64_t uptimeUs, uint32_t generation) {
+    State s = _state.read();
+    if (s.generation != generation) return false;
+    int64_t offset = s.valid ? epochUs - project(s, uptimeUs) : 0;
+    bool step = !s.valid || s.stepNext || offset > CLOCK_STEP_THRESHOLD || offset < -CLOCK_STEP_THRESHOLD;
+
+    // What is left of the offset after the last one was slewed out (or of
+    // the part still to be slewed) built up from frequency error
+    int32_t frequency = s.frequency;
+    if (!step && s.lastSync != 0 && uptimeUs > s.lastSync) {
+        int64_t pending = s.slewEnd > uptimeUs ? scale((int64_t)(s.slewEnd - uptimeUs), s.slew) : 0;
+        int64_t ppb = (offset - pending) * 1000000000 / (int64_t)(uptimeUs - s.lastSync);
+        frequency = clamp(frequency + ppb / CLOCK_FREQUENCY_GAIN, CLOCK_MAX_FREQUENCY);
+    }
+
+    // Rebase at the present so the clock carries on from where it is, then
+    // slew the whole offset out, no faster than CLOCK_MAX_SLEW
+    uint64_t base = uptime();
+    bool current = true;
+    _state.update([&](State &s) {
+        if (s.generation != generation) {
+            current = false;
+            return;
+        }
+        if (step) {
+            s.baseEpoch = epochUs + (int64_t)(base - uptimeUs);
+            s.slew = 0;
+            s.slewEnd = base;
+            if (s.valid) s.steps++;
+        }
+        else {
+            s.baseEpoch = project(s, base);
+            int64_t magnitude = offset < 0 ? -offset : offset;
+            int64_t duration = magnitude * 1000000000 / CLOCK_MAX_SLEW;
+            if (duration < CLOCK_SLEW_TIME) duration = CLOCK_SLEW_TIME;
+            s.slew = clamp(offset * 1000000000 / duration, CLOCK_MAX_SLEW);
+            s.slewEnd = base + duration;
+        }
+        s.baseUptime = base;
+        s.frequency = frequency;
+        s.offset = clamp(offset, INT32_MAX);
+        s.syncs++;
+        s.lastSync = uptimeUs;
+        s.stepNext = false;
+        s.valid = true;
+    });
+    return current;
+}
+
+ClockStats SystemClock::stats() const {
+    State s = _state.read();
+    return {s.offset, s.frequency, s.syncs, s.steps, s.lastSync};
+}
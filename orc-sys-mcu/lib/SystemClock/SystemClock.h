@@ -0,0 +1,96 @@
+#ifndef SYSTEM_CLOCK_H
+#define SYSTEM_CLOCK_H
+
+#include <stdint.h>
+#include "Snapshot.h"
+
+// Microsecond wall clock, read without I2C or locks.
+//
+// Time is the RP2040's 64 bit µs timer, corrected for its frequency error and
+// offset onto the epoch (RTC local time, like the rest of the firmware).
+// The RTC stays the reference: every so often the caller timestamps an RTC
+// seconds tick and passes it to discipline(), which slews the clock onto it
+// (runs it slightly fast or slow for a while) rather than jumping, and
+// learns the frequency error of the RP2040 crystal against the RTC's from
+// the offsets left over since the previous tick.
+// The clock only steps (possibly backwards) after set() and for offsets
+// over CLOCK_STEP_THRESHOLD, otherwise it is monotonic. For durations use
+// uptime(), which never steps.
+//
+// The parameters are kept in a Snapshot, so now() from any task or core is
+// a copy and a little arithmetic.
+
+#ifndef CLOCK_STEP_THRESHOLD
+#define CLOCK_STEP_THRESHOLD 100000     // µs, larger offsets are stepped rather than slewed
+#endif
+#ifndef CLOCK_SLEW_TIME
+#define CLOCK_SLEW_TIME 4000000         // µs over which an offset is slewed out, at least
+#endif
+#ifndef CLOCK_MAX_SLEW
+#define CLOCK_MAX_SLEW 500000           // ppb, fastest slew, so larger offsets take longer
+#endif
+#ifndef CLOCK_MAX_FREQUENCY
+#define CLOCK_MAX_FREQUENCY 500000      // ppb, largest frequency correction
+#endif
+#ifndef CLOCK_FREQUENCY_GAIN
+#define CLOCK_FREQUENCY_GAIN 4          // Frequency estimates are averaged over about this many syncs
+#endif
+
+struct ClockStats {
+    int32_t offset;         // µs, RTC minus clock at the last discipline()
+    int32_t frequency;      // ppb, correction for the RP2040 timer's error against the RTC
+    uint32_t syncs;
+    uint32_t steps;
+    uint64_t lastSync;      // uptime() of the last discipline() or set()
+};
+
+class SystemClock {
+public:
+    // µs since boot, monotonic
+    static uint64_t uptime();
+
+    // Epoch µs now, or 0 until the clock is set
+    int64_t now() const;
+
+    // Epoch µs at an earlier (or later) uptime()
+    int64_t at(uint64_t uptimeUs) const;
+
+    bool valid() const { return _state.read().valid; }
+
+    // Jump to epochUs as of uptimeUs, when the time is set. The next
+    // discipline() steps onto the RTC rather than slewing.
+    void set(int64_t epochUs, uint64_t uptimeUs);
+
+    // Counts set() calls
+    uint32_t generation() const { return _state.read().generation; }
+
+    // An RTC second started at epochUs, at uptimeUs. Take generation() before
+    // reading the RTC: if the time has been set since, the reading is
+    // discarded and this returns false.
+    bool discipline(int64_t epochUs, uint64_t uptimeUs, uint32_t generation);
+
+    ClockStats stats() const;
+
+private:
+    struct State {
+        uint64_t baseUptime;
+        int64_t baseEpoch;      // At baseUptime
+        int32_t frequency;      // ppb, learnt
+        int32_t slew;           // ppb on top until slewEnd
+        uint64_t slewEnd;
+        int32_t offset;
+        uint32_t syncs;
+        uint32_t steps;
+        uint64_t lastSync;
+        uint32_t generation;
+        bool valid;
+        bool stepNext;
+    };
+
+    static int64_t project(const State &s, uint64_t uptimeUs);
+    static int64_t scale(int64_t us, int32_t ppb);
+
+    Snapshot<State> _state;
+};
+
+#endif /* SYSTEM_CLOCK_H */
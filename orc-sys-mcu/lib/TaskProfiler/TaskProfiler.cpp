@@ -0,0 +1,98 @@
+#include "TaskProfiler.h"
+#include <string.h>
+
+volatile unsigned long taskProfilerSwitches[TASK_PROFILER_NUM_CORES] = {};
+
+const TaskProfiler::History *TaskProfiler::findPrevious(TaskHandle_t handle) const {
+    for (uint8_t i = 0; i < _numPrevious; i++) {
+        if (_previous[i].handle == handle) return &_previous[i];
+    }
+    return nullptr;
+}
+
+// Idle tasks are named IDLE, IDLE0, IDLE1.., by core where there is one
+static bool idleTaskCore(const TaskStatus_t &status, uint8_t &core, uint8_t &unnumbered) {
+    if (status.uxBasePriority != tskIDLE_PRIORITY || strncmp(status.pcTaskName, "IDLE", 4) != 0) return false;
+    char digit = status.pcTaskName[4];
+    if (digit >= '0' && digit <= '9') core = digit - '0';
+    else core = unnumbered++;
+    return core < TASK_PROFILER_NUM_CORES;
+}
+
+void TaskProfiler::sample() {
+    uint32_t totalRunTime;
+    UBaseType_t count = uxTaskGetSystemState(_status, TASK_PROFILER_MAX_TASKS, &totalRunTime);
+    bool truncated = count == 0;
+    uint32_t tick = xTaskGetTickCount();
+
+    uint32_t switches[TASK_PROFILER_NUM_CORES];
+    for (uint8_t c = 0; c < TASK_PROFILER_NUM_CORES; c++) switches[c] = taskProfilerSwitches[c];
+
+    // Run time counters wrap, differences don't mind. Each core's run time
+    // goes up by elapsed, the tasks' between them by about cores * elapsed.
+    bool first = _samples == 0;
+    uint32_t elapsed = totalRunTime - _totalRunTime;
+    uint32_t interval = tick - _lastTick;
+    bool trendPoint = _samples % TASK_PROFILER_TREND_STEP == 0;
+    uint8_t point = (_samples / TASK_PROFILER_TREND_STEP) % TASK_PROFILER_TREND_POINTS;
+
+    memcpy(_previous, _history, sizeof(History) * _numHistory);
+    _numPrevious = _numHistory;
+    _numHistory = (uint8_t)count;
+
+    uint32_t idle[TASK_PROFILER_NUM_CORES] = {};
+    uint8_t unnumbered = 0;
+    // Built outside the snapshot's lock, which is shared and held with
+    // interrupts masked, and only copied in under it
+    TaskProfileSet &set = _set;
+    set.time = tick;
+    set.interval = first ? 0 : interval;
+    set.numTasks = (uint8_t)count;
+    set.truncated = truncated;
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t &status = _status[i];
+        const History *previous = findPrevious(status.xHandle);
+        History &history = _history[i];
+        history.handle = status.xHandle;
+        history.runTime = status.ulRunTimeCounter;
+        uint32_t stackFree = status.usStackHighWaterMark * sizeof(StackType_t);
+        if (previous != nullptr) memcpy(history.stackFree, previous->stackFree, sizeof(history.stackFree));
+        else {
+            for (uint8_t p = 0; p < TASK_PROFILER_TREND_POINTS; p++) history.stackFree[p] = stackFree;
+        }
+        // The point about to be replaced is the oldest
+        uint32_t oldest = history.stackFree[trendPoint ? point : (point + 1) % TASK_PROFILER_TREND_POINTS];
+        if (trendPoint) history.stackFree[point] = stackFree;
+
+        uint32_t ran = previous != nullptr ? status.ulRunTimeCounter - previous->runTime : 0;
+        if (ran > elapsed) ran = elapsed;
+        TaskProfile &task = set.tasks[i];
+        strncpy(task.name, status.pcTaskName, sizeof(task.name) - 1);
+        task.name[sizeof(task.name) - 1] = '\0';
+        task.state = (uint8_t)status.eCurrentState;
+        task.priority = (uint8_t)status.uxCurrentPriority;
+        UBaseType_t mask = status.uxCoreAffinityMask & ((1u << TASK_PROFILER_NUM_CORES) - 1);
+        task.core = -1;
+        for (uint8_t c = 0; c < TASK_PROFILER_NUM_CORES; c++) {
+            if (mask == (1u << c)) task.core = c;
+        }
+        task.cpu = elapsed > 0 ? (uint16_t)((uint64_t)ran * 10000 / elapsed) : 0;
+        task.stackFree = stackFree;
+        task.stackDrop = oldest > stackFree ? oldest - stackFree : 0;
+
+        uint8_t core;
+        if (idleTaskCore(status, core, unnumbered)) idle[core] = task.cpu;
+    }
+    for (uint8_t c = 0; c < TASK_PROFILER_NUM_CORES; c++) {
+        CoreProfile &profile = set.cores[c];
+        profile.cpu = first || elapsed == 0 ? 0 : 10000 - idle[c];
+        uint32_t ms = interval * portTICK_PERIOD_MS;
+        profile.switches = first || ms == 0 ? 0 : (uint32_t)((uint64_t)(switches[c] - _switches[c]) * 1000 / ms);
+    }
+    _profile.write(set);
+
+    _totalRunTime = totalRunTime;
+    for (uint8_t c = 0; c < TASK_PROFILER_NUM_CORES; c++) _switches[c] = switches[c];
+    _lastTick = tick;
+    _samples++;
+}
@@ -0,0 +1,105 @@
+#ifndef TASK_PROFILER_H
+#define TASK_PROFILER_H
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "Snapshot.h"
+
+// Per-task CPU use and stack headroom.
+//
+// sample(), called every so often from a low priority task, reads the
+// FreeRTOS task list into preallocated storage and works out from the run
+// time counters how much of the time since the previous sample each task
+// ran, and each core was busy (everything but its idle task). The results
+// are published in a Snapshot for the terminal, the API and the metrics to
+// read, so readers never call into the scheduler themselves.
+//
+// CPU is in hundredths of a percent of one core: a task that kept a core
+// busy is at 10000 whichever core it ran on.
+//
+// Stack headroom is the high water mark, which only goes down, so the
+// trend is how far it went down over the last TASK_PROFILER_TREND_POINTS *
+// TASK_PROFILER_TREND_STEP samples: a task that is still finding deeper
+// paths keeps showing a drop.
+//
+// Context switches are counted per core by traceTASK_SWITCHED_IN() (defined
+// in platformio.ini), into taskProfilerSwitches. Without the hook the rates
+// read 0.
+
+// Every task in the system, not just the application's: FreeRTOS SMP adds an
+// IDLE task per core and the timer task, the core its loop() tasks and USB
+// and flash tasks. If there are more, uxTaskGetSystemState() lists none.
+#ifndef TASK_PROFILER_MAX_TASKS
+#define TASK_PROFILER_MAX_TASKS 24
+#endif
+#ifndef TASK_PROFILER_NAME_LEN
+#define TASK_PROFILER_NAME_LEN 16
+#endif
+#ifndef TASK_PROFILER_TREND_POINTS
+#define TASK_PROFILER_TREND_POINTS 6
+#endif
+#ifndef TASK_PROFILER_TREND_STEP
+#define TASK_PROFILER_TREND_STEP 10     // Samples between trend points
+#endif
+#ifndef TASK_PROFILER_NUM_CORES
+#define TASK_PROFILER_NUM_CORES 2
+#endif
+
+extern "C" volatile unsigned long taskProfilerSwitches[TASK_PROFILER_NUM_CORES];
+
+struct TaskProfile {
+    char name[TASK_PROFILER_NAME_LEN];
+    uint8_t state;          // eTaskState
+    uint8_t priority;
+    int8_t core;            // Pinned to, -1 if it may run on either
+    uint16_t cpu;           // 0.01 % of a core since the previous sample
+    uint32_t stackFree;     // Bytes, lowest since the task started
+    uint32_t stackDrop;     // Bytes stackFree went down over the trend window
+};
+
+struct CoreProfile {
+    uint16_t cpu;           // 0.01 %, busy (not idle) since the previous sample
+    uint32_t switches;      // Context switches per second
+};
+
+struct TaskProfileSet {
+    uint32_t time;          // Tick count of the sample
+    uint32_t interval;      // Ticks since the previous one, 0 before there was one
+    uint8_t numTasks;
+    bool truncated;         // More tasks than TASK_PROFILER_MAX_TASKS
+    CoreProfile cores[TASK_PROFILER_NUM_CORES];
+    TaskProfile tasks[TASK_PROFILER_MAX_TASKS];
+};
+
+class TaskProfiler {
+public:
+    void sample();
+
+    // Latest results, tasks in the order FreeRTOS lists them
+    void read(TaskProfileSet &set) const { _profile.read(set); }
+
+private:
+    // What the previous samples saw of a task
+    struct History {
+        TaskHandle_t handle;
+        uint32_t runTime;
+        uint32_t stackFree[TASK_PROFILER_TREND_POINTS];    // Ring, a point every TASK_PROFILER_TREND_STEP samples
+    };
+
+    const History *findPrevious(TaskHandle_t handle) const;
+
+    TaskStatus_t _status[TASK_PROFILER_MAX_TASKS];
+    History _history[TASK_PROFILER_MAX_TASKS];
+    History _previous[TASK_PROFILER_MAX_TASKS];
+    uint8_t _numHistory = 0;
+    uint8_t _numPrevious = 0;
+    uint32_t _totalRunTime = 0;
+    uint32_t _switches[TASK_PROFILER_NUM_CORES] = {};
+    uint32_t _lastTick = 0;
+    uint32_t _samples = 0;
+    TaskProfileSet _set;                // Being built, then written to _profile
+    Snapshot<TaskProfileSet> _profile;
+};
+
+#endif /* TASK_PROFILER_H */
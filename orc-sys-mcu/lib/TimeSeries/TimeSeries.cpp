@@ -0,0 +1,233 @@
+#include "TimeSeries.h"
+
+#include <math.h>
+
+TimeSeries::TimeSeries() {
+    const uint32_t periods[HISTORY_NUM_TIERS] = {0, 10, 60, 600};
+    const uint16_t capacities[HISTORY_NUM_TIERS] = {
+        HISTORY_RAW_SAMPLES, HISTORY_10S_BUCKETS, HISTORY_1MIN_BUCKETS, HISTORY_10MIN_BUCKETS
+    };
+    for (uint8_t t = 0; t < HISTORY_NUM_TIERS; t++) {
+        _tiers[t].period = periods[t];
+        _tiers[t].capacity = capacities[t];
+    }
+    clear();
+}
+
+void TimeSeries::clear() {
+    for (uint8_t t = 0; t < HISTORY_NUM_TIERS; t++) {
+        _tiers[t].head = 0;
+        _tiers[t].count = 0;
+        _tiers[t].lastTime = 0;
+        _tiers[t].openCount = 0;
+    }
+}
+
+void TimeSeries::add(uint32_t time, float value) {
+    if (isnan(value)) return;
+
+    Tier &raw = _tiers[0];
+    if (raw.count > 0 && time < raw.lastTime) clear();
+    _rawTime[raw.head] = time;
+    _rawValue[raw.head] = value;
+    raw.head = (raw.head + 1) % raw.capacity;
+    if (raw.count < raw.capacity) raw.count++;
+    raw.lastTime = time;
+
+    for (uint8_t t = 1; t < HISTORY_NUM_TIERS; t++) {
+        Tier &tier = _tiers[t];
+        uint32_t start = time - time % tier.period;
+        if (tier.openCount > 0 && start != tier.openStart) {
+            closeBucket(t);
+            // Mark the buckets with no samples, or start over if the gap is
+            // longer than the tier holds
+            uint32_t missing = (start - tier.lastTime) / tier.period - 1;
+            if (missing >= tier.capacity) {
+                tier.head = 0;
+                tier.count = 0;
+            }
+            else {
+                const Bucket gap = {NAN, NAN, NAN};
+                for (uint32_t i = 0; i < missing; i++) {
+                    pushBucket(t, gap, tier.lastTime + tier.period);
+                }
+            }
+        }
+        if (tier.openCount == 0) {
+            tier.openStart = start;
+            tier.openMin = value;
+            tier.openMax = value;
+            tier.openSum = 0;
+        }
+        if (value < tier.openMin) tier.openMin = value;
+        if (value > tier.openMax) tier.openMax = value;
+        tier.openSum += value;
+        tier.openCount++;
+    }
+}
+
+size_t TimeSeries::query(uint32_t from, uint32_t to, HistoryPoint *out, size_t maxPoints,
+                         uint32_t *resolution) const {
+    if (maxPoints == 0 || to < from) return 0;
+
+    // Finest tier reaching back to from, otherwise the one reaching furthest
+    int8_t tier = -1;
+    uint32_t bestOldest = 0;
+    for (uint8_t t = 0; t < HISTORY_NUM_TIERS; t++) {
+        uint32_t oldest;
+        if (!oldestTime(t, oldest)) continue;
+        if (oldest <= from) {
+            tier = t;
+            break;
+        }
+        if (tier < 0 || oldest < bestOldest) {
+            tier = t;
+            bestOldest = oldest;
+        }
+    }
+    if (tier < 0) return 0;
+    if (resolution) *resolution = _tiers[tier].period;
+
+    size_t first = lowerBound(tier, from);
+    size_t end = (to == UINT32_MAX) ? length(tier) : lowerBound(tier, to + 1);
+    while (first < end && isnan(point(tier, first).mean)) first++;
+    while (end > first && isnan(point(tier, end - 1).mean)) end--;
+    size_t n = end - first;
+    if (n == 0) return 0;
+
+    size_t count = 0;
+    if (n <= maxPoints) {
+        for (size_t i = first; i < end; i++) {
+            HistoryPoint p = point(tier, i);
+            if (!isnan(p.mean)) out[count++] = p;
+        }
+        return count;
+    }
+    if (maxPoints < 3) {
+        out[count++] = point(tier, first);
+        if (maxPoints == 2) out[count++] = point(tier, end - 1);
+        return count;
+    }
+
+    // Largest-Triangle-Three-Buckets: keep the first and last points and from
+    // each bucket in between the point forming the largest triangle with the
+    // previously kept point and the average of the next bucket
+    const uint32_t t0 = point(tier, first).time;
+    const double every = (double)(n - 2) / (maxPoints - 2);
+    HistoryPoint a = point(tier, first);
+    out[count++] = a;
+
+    for (size_t b = 0; b < maxPoints - 2; b++) {
+        size_t rangeStart = first + 1 + (size_t)(b * every);
+        size_t rangeEnd = first + 1 + (size_t)((b + 1) * every);
+        size_t nextEnd = first + 1 + (size_t)((b + 2) * every);
+        if (nextEnd > end) nextEnd = end;
+
+        float avgX = 0, avgY = 0;
+        uint32_t avgCount = 0;
+        for (size_t i = rangeEnd; i < nextEnd; i++) {
+            HistoryPoint p = point(tier, i);
+            if (isnan(p.mean)) continue;
+            avgX += (float)(p.time - t0);
+            avgY += p.mean;
+            avgCount++;
+        }
+        if (avgCount == 0) {
+            HistoryPoint last = point(tier, end - 1);
+            avgX = (float)(last.time - t0);
+            avgY = last.mean;
+        }
+        else {
+            avgX /= avgCount;
+            avgY /= avgCount;
+        }
+
+        const float ax = (float)(a.time - t0);
+        float maxArea = -1;
+        HistoryPoint selected = a;
+        float envMin = INFINITY, envMax = -INFINITY;
+        for (size_t i = rangeStart; i < rangeEnd; i++) {
+            HistoryPoint p = point(tier, i);
+            if (isnan(p.mean)) continue;
+            float area = fabsf((ax - avgX) * (p.mean - a.mean) - (ax - (float)(p.time - t0)) * (avgY - a.mean));
+            if (area > maxArea) {
+                maxArea = area;
+                selected = p;
+            }
+            if (p.min < envMin) envMin = p.min;
+            if (p.max > envMax) envMax = p.max;
+        }
+        if (maxArea < 0) continue;  // Bucket is all gaps
+        a = selected;
+        selected.min = envMin;
+        selected.max = envMax;
+        out[count++] = selected;
+    }
+
+    out[count++] = point(tier, end - 1);
+    return count;
+}
+
+TimeSeries::Bucket *TimeSeries::storage(uint8_t tier) {
+    switch (tier) {
+        case 1: return _buckets10s;
+        case 2: return _buckets1min;
+        case 3: return _buckets10min;
+        default: return nullptr;
+    }
+}
+
+const TimeSeries::Bucket *TimeSeries::storage(uint8_t tier) const {
+    return const_cast<TimeSeries *>(this)->storage(tier);
+}
+
+void TimeSeries::pushBucket(uint8_t tier, const Bucket &bucket, uint32_t start) {
+    Tier &t = _tiers[tier];
+    storage(tier)[t.head] = bucket;
+    t.head = (t.head + 1) % t.capacity;
+    if (t.count < t.capacity) t.count++;
+    t.lastTime = start;
+}
+
+void TimeSeries::closeBucket(uint8_t tier) {
+    Tier &t = _tiers[tier];
+    const Bucket bucket = {t.openMin, t.openSum / t.openCount, t.openMax};
+    pushBucket(tier, bucket, t.openStart);
+    t.openCount = 0;
+}
+
+size_t TimeSeries::length(uint8_t tier) const {
+    const Tier &t = _tiers[tier];
+    return t.count + (t.openCount > 0 ? 1 : 0);
+}
+
+HistoryPoint TimeSeries::point(uint8_t tier, size_t index) const {
+    const Tier &t = _tiers[tier];
+    if (index >= t.count) {
+        // The open bucket, its mean so far
+        return {t.openStart, t.openSum / t.openCount, t.openMin, t.openMax};
+    }
+    size_t slot = (t.head + t.capacity - t.count + index) % t.capacity;
+    if (tier == 0) {
+        float v = _rawValue[slot];
+        return {_rawTime[slot], v, v, v};
+    }
+    const Bucket &b = storage(tier)[slot];
+    return {t.lastTime - (uint32_t)(t.count - 1 - index) * t.period, b.mean, b.min, b.max};
+}
+
+bool TimeSeries::oldestTime(uint8_t tier, uint32_t &time) const {
+    if (length(tier) == 0) return false;
+    time = point(tier, 0).time;
+    return true;
+}
+
+size_t TimeSeries::lowerBound(uint8_t tier, uint32_t time) const {
+    size_t lo = 0, hi = length(tier);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (point(tier, mid).time < time) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
@@ -0,0 +1,98 @@
+#ifndef TIME_SERIES_H
+#define TIME_SERIES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed memory history for one sensor channel. Every sample goes into a raw
+// ring and into three aggregate tiers that keep min/mean/max per bucket, so
+// recent data is exact and older data costs a fixed amount of RAM.
+//
+// Capacities can be overridden from build_flags.
+#ifndef HISTORY_RAW_SAMPLES
+#define HISTORY_RAW_SAMPLES 64      // Most recent samples, as received
+#endif
+#ifndef HISTORY_10S_BUCKETS
+#define HISTORY_10S_BUCKETS 90      // 15 minutes
+#endif
+#ifndef HISTORY_1MIN_BUCKETS
+#define HISTORY_1MIN_BUCKETS 120    // 2 hours
+#endif
+#ifndef HISTORY_10MIN_BUCKETS
+#define HISTORY_10MIN_BUCKETS 144   // 24 hours
+#endif
+
+#define HISTORY_NUM_TIERS 4         // Raw plus the three aggregate tiers
+
+// One point of a query result. Raw samples have min == mean == max.
+struct HistoryPoint {
+    uint32_t time;  // Seconds, start of the bucket for aggregate tiers
+    float mean;
+    float min;
+    float max;
+};
+
+class TimeSeries {
+public:
+    TimeSeries();
+
+    // Drop all history
+    void clear();
+
+    // Add a sample. Samples must arrive in time order, a clock step
+    // backwards discards the history since it can no longer be ordered.
+    void add(uint32_t time, float value);
+
+    // Copy the points between from and to (inclusive) into out, using the
+    // finest tier that reaches back to from. If there are more than
+    // maxPoints they are reduced with Largest-Triangle-Three-Buckets, and
+    // each output point carries the min/max of the points it stands for.
+    // resolution is set to the bucket length in seconds (0 = raw samples).
+    size_t query(uint32_t from, uint32_t to, HistoryPoint *out, size_t maxPoints,
+                 uint32_t *resolution = nullptr) const;
+
+private:
+    struct Bucket {
+        float min;
+        float mean;
+        float max;
+    };
+
+    struct Tier {
+        uint32_t period;    // Bucket length in seconds, 0 for the raw tier
+        uint16_t capacity;
+        uint16_t head;      // Next slot to write
+        uint16_t count;     // Stored buckets/samples
+        uint32_t lastTime;  // Time of the newest stored bucket/sample
+        // Bucket being accumulated (aggregate tiers only)
+        uint32_t openStart;
+        uint32_t openCount;
+        float openMin;
+        float openMax;
+        float openSum;
+    };
+
+    Tier _tiers[HISTORY_NUM_TIERS];
+
+    // Raw samples keep their own timestamps, aggregate buckets are contiguous
+    // so their time follows from lastTime and the position in the ring
+    uint32_t _rawTime[HISTORY_RAW_SAMPLES];
+    float _rawValue[HISTORY_RAW_SAMPLES];
+    Bucket _buckets10s[HISTORY_10S_BUCKETS];
+    Bucket _buckets1min[HISTORY_1MIN_BUCKETS];
+    Bucket _buckets10min[HISTORY_10MIN_BUCKETS];
+
+    Bucket *storage(uint8_t tier);
+    const Bucket *storage(uint8_t tier) const;
+    void pushBucket(uint8_t tier, const Bucket &bucket, uint32_t start);
+    void closeBucket(uint8_t tier);
+
+    // Tier contents as a sequence: stored entries oldest first, then the
+    // open bucket if it has any samples
+    size_t length(uint8_t tier) const;
+    HistoryPoint point(uint8_t tier, size_t index) const;
+    bool oldestTime(uint8_t tier, uint32_t &time) const;
+    size_t lowerBound(uint8_t tier, uint32_t time) const;
+};
+
+#endif /* TIME_SERIES_H */
@@ -0,0 +1,181 @@
+# Decode binary debug output (lib/DebugLog, "binlog on" on the terminal)
+#
+# Tokenized lines carry the flash address of their format string rather than
+# the text, which is looked up in the firmware ELF the board is running.
+#
+# Usage: python scripts/decode_debug_log.py .pio/build/<env>/firmware.elf <port or capture file>
+#        e.g. ... /dev/ttyACM0, or a file saved with "cat /dev/ttyACM0 > capture.bin"
+# Reading a serial port needs pyserial.
+
+import argparse
+import re
+import struct
+import sys
+
+FRAME_TEXT = 1
+FRAME_TOKEN = 2
+
+ARG_INT, ARG_UINT, ARG_INT64, ARG_UINT64, ARG_FLOAT, ARG_DOUBLE, ARG_STRING, ARG_POINTER = range(1, 9)
+ARG_FORMATS = {
+    ARG_INT: "<i", ARG_UINT: "<I", ARG_INT64: "<q", ARG_UINT64: "<Q",
+    ARG_FLOAT: "<f", ARG_DOUBLE: "<d", ARG_POINTER: "<I",
+}
+
+LEVELS = ["INFO", "WARNING", "ERROR", "DEBUG"]  # logType[] in src/sys_init.h
+
+# One printf conversion: flags, width, precision, length modifiers, conversion
+SPEC = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d*))?[hlLqjzt]*([diouxXcfFeEgGaAsp%])")
+
+
+class Elf:
+    """Loaded sections of a little endian ELF32, enough to read strings by address"""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1 or self.data[5] != 1:
+            raise ValueError("not a little endian 32 bit ELF")
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            _, sh_type, _, addr, offset, size = struct.unpack_from("<IIIIII", self.data, shoff + i * shentsize)
+            if addr and sh_type != 8:  # Not SHT_NOBITS
+                self.sections.append((addr, offset, size))
+
+    def string(self, address):
+        for addr, offset, size in self.sections:
+            if addr <= address < addr + size:
+                start = offset + address - addr
+                end = self.data.index(b"\0", start, offset + size)
+                return self.data[start:end].decode(errors="replace")
+        return None
+
+
+def cobs_decode(frame):
+    out = bytearray()
+    i = 0
+    while i < len(frame):
+        code = frame[i]
+        if code == 0 or i + code > len(frame) + 1:
+            raise ValueError("bad COBS frame")
+        out += frame[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(frame):
+            out.append(0)
+    return bytes(out)
+
+
+def read_args(data):
+    args = []
+    pos = 0
+    while pos < len(data):
+        tag = data[pos]
+        pos += 1
+        if tag == ARG_STRING:
+            length = data[pos]
+            args.append(data[pos + 1:pos + 1 + length].decode(errors="replace"))
+            pos += 1 + length
+        elif tag in ARG_FORMATS:
+            fmt = ARG_FORMATS[tag]
+            value, = struct.unpack_from(fmt, data, pos)
+            args.append(value)
+            pos += struct.calcsize(fmt)
+        else:
+            raise ValueError(f"bad argument tag {tag}")
+    return args
+
+
+def render(fmt, args):
+    """printf with the C length modifiers dropped, as the device does"""
+    args = list(args)
+
+    def take():
+        return args.pop(0) if args else None
+
+    def convert(match):
+        flags, width, precision, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+        if width == "*":
+            width = str(take() or 0)
+        if precision == "*":
+            precision = str(take() or 0)
+        spec = "%" + flags + (width or "") + ("." + precision if precision is not None else "")
+        value = take()
+        if value is None:
+            return "(?)"
+        if conversion == "s":
+            return (spec + "s") % value if isinstance(value, str) else "(?)"
+        if isinstance(value, str):
+            return "(?)"
+        if conversion == "p":
+            return f"0x{value:08x}"
+        if conversion in "diu":
+            return (spec + "d") % int(value)
+        if conversion in "oxXc":
+            return (spec + conversion) % int(value)
+        return (spec + conversion) % float(value)
+
+    return SPEC.sub(convert, fmt)
+
+
+def decode(elf, frame):
+    data = cobs_decode(frame)
+    kind, time = struct.unpack_from("<BI", data)
+    if kind == FRAME_TEXT:
+        return time, data[5:].decode(errors="replace")
+    if kind != FRAME_TOKEN:
+        raise ValueError(f"bad frame kind {kind}")
+    address, level = struct.unpack_from("<IB", data, 5)
+    fmt = elf.string(address)
+    if fmt is None:
+        return time, f"[?] <format 0x{address:08x} not in the ELF, wrong firmware?>\n"
+    name = LEVELS[level] if level < len(LEVELS) else "UNKNOWN"
+    return time, f"[{name}] " + render(fmt, read_args(data[10:]))
+
+
+def frames(stream, follow):
+    frame = bytearray()
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            if follow:
+                continue  # Serial read timed out
+            return
+        for b in chunk:
+            if b == 0:
+                if frame:
+                    yield bytes(frame)
+                frame = bytearray()
+            else:
+                frame.append(b)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("elf", help="firmware.elf of the running build")
+    parser.add_argument("input", help="serial port or capture file")
+    parser.add_argument("--baud", type=int, default=115200)
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    follow = args.input.startswith("/dev/") or args.input.upper().startswith("COM")
+    if follow:
+        import serial
+        stream = serial.Serial(args.input, args.baud, timeout=1)
+    else:
+        stream = open(args.input, "rb")
+
+    for frame in frames(stream, follow):
+        try:
+            time, line = decode(elf, frame)
+        except (ValueError, struct.error, IndexError) as e:
+            print(f"<{e}>", file=sys.stderr)
+            continue
+        sys.stdout.write(f"{time / 1e6:12.6f} {line}")
+        sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
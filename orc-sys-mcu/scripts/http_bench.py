@@ -0,0 +1,126 @@
+# HTTP load test for the controller's web server
+#
+# Hammers one or more paths from a number of concurrent client threads and
+# reports requests/s and latency percentiles. See
+# notes/web-server-performance.txt for the runs to make; --record appends
+# the result to the Results section there.
+#
+# Usage: python scripts/http_bench.py <host> [--port 80] [--keep-alive] [--paths /api/state /]
+#                                     [--clients 4] [--seconds 10] [--record "note"]
+
+import argparse
+import datetime
+import http.client
+import os
+import shlex
+import subprocess
+import sys
+import threading
+import time
+
+NOTES = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "notes", "web-server-performance.txt")
+
+
+def worker(host, port, paths, deadline, keep_alive, results, lock):
+    latencies = []
+    errors = 0
+    i = 0
+    conn = None
+    while time.monotonic() < deadline:
+        path = paths[i % len(paths)]
+        i += 1
+        start = time.monotonic()
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection(host, port, timeout=5)
+            conn.request("GET", path, headers={"Accept-Encoding": "gzip"})
+            response = conn.getresponse()
+            response.read()
+            if not keep_alive or response.will_close:
+                conn.close()
+                conn = None
+            if response.status >= 400:
+                errors += 1
+                continue
+        except (OSError, http.client.HTTPException):
+            errors += 1
+            if conn is not None:
+                conn.close()
+                conn = None
+            continue
+        latencies.append(time.monotonic() - start)
+    if conn is not None:
+        conn.close()
+    with lock:
+        results["latencies"].extend(latencies)
+        results["errors"] += errors
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def record(lines, note):
+    """Append a run to the Results section of the notes, with the command and the commit."""
+    try:
+        commit = subprocess.check_output(["git", "describe", "--always", "--dirty"],
+                                         cwd=os.path.dirname(NOTES), stderr=subprocess.DEVNULL,
+                                         text=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        commit = "unknown"
+    with open(NOTES, "a") as f:
+        f.write("\n%s, firmware %s, %s\n" % (datetime.date.today().isoformat(), commit, note))
+        f.write("  $ python scripts/%s %s\n" % (os.path.basename(sys.argv[0]), shlex.join(sys.argv[1:])))
+        for line in lines:
+            f.write("  " + line + "\n")
+    print("Recorded in %s" % os.path.normpath(NOTES))
+
+
+def add_record_argument(parser):
+    parser.add_argument("--record", metavar="NOTE",
+                        help="append the result to notes/web-server-performance.txt, NOTE says what else "
+                             "was running (e.g. \"dashboard connected\") and that the firmware is this commit")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="HTTP load test for the controller web server")
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--paths", nargs="+", default=["/api/state"])
+    parser.add_argument("--clients", type=int, default=4)
+    parser.add_argument("--seconds", type=float, default=10)
+    parser.add_argument("--keep-alive", action="store_true",
+                        help="reuse one connection per client (use with --port 81)")
+    add_record_argument(parser)
+    args = parser.parse_args()
+
+    results = {"latencies": [], "errors": 0}
+    lock = threading.Lock()
+    deadline = time.monotonic() + args.seconds
+    threads = [threading.Thread(target=worker, args=(args.host, args.port, args.paths, deadline, args.keep_alive, results, lock))
+               for _ in range(args.clients)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    lat = results["latencies"]
+    lines = [
+        "%d clients, %.0f s, port %d%s, paths: %s" % (args.clients, args.seconds, args.port,
+                                                      ", keep-alive" if args.keep_alive else "", " ".join(args.paths)),
+        "  requests/s: %.1f" % (len(lat) / args.seconds),
+        "  errors:     %d" % results["errors"],
+        "  latency ms: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f" % (
+            percentile(lat, 50) * 1000, percentile(lat, 90) * 1000,
+            percentile(lat, 99) * 1000, max(lat, default=0) * 1000),
+    ]
+    print("\n".join(lines))
+    if args.record:
+        record(lines, args.record)
+
+
+if __name__ == "__main__":
+    main()
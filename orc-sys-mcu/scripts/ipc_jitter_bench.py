@@ -0,0 +1,106 @@
+# IPC dispatch jitter under HTTP load
+#
+# Reads the orc_ipc_dispatch_latency_seconds histogram from /metrics before
+# and after an idle period and a period of HTTP load (the same load as
+# http_bench.py), and reports the latency distribution of each from the
+# bucket counts. The IPC task polls every millisecond on core 1, so with the
+# scheduling layout in the task table the loaded figures should stay close
+# to the idle ones. See notes/web-server-performance.txt; --record appends
+# both histograms to the Results section there.
+#
+# Usage: python scripts/ipc_jitter_bench.py <host> [--port 80] [--keep-alive]
+#                                           [--paths /api/state /] [--clients 4] [--seconds 30]
+#                                           [--record "note"]
+
+import argparse
+import http.client
+import re
+import threading
+import time
+
+from http_bench import add_record_argument, record, worker
+
+METRIC = "orc_ipc_dispatch_latency_seconds"
+BUCKET = re.compile(r'^' + METRIC + r'_bucket\{le="([^"]+)"\} (\d+)$')
+
+
+def read_buckets(host):
+    conn = http.client.HTTPConnection(host, 80, timeout=5)
+    conn.request("GET", "/metrics")
+    text = conn.getresponse().read().decode()
+    conn.close()
+    buckets = []
+    for line in text.splitlines():
+        match = BUCKET.match(line)
+        if match:
+            bound = float("inf") if match.group(1) == "+Inf" else float(match.group(1))
+            buckets.append((bound, int(match.group(2))))
+    if not buckets:
+        raise SystemExit("%s not found in /metrics" % METRIC)
+    return buckets
+
+
+def report(name, before, after):
+    """Lines describing the distribution between two bucket readings."""
+    counts = [(bound, b - a) for (bound, b), (_, a) in zip(after, before)]
+    total = counts[-1][1]
+    lines = ["%s: %d polls" % (name, total)]
+    if total == 0:
+        return lines
+    # Cumulative counts, so a percentile is the first bucket reaching it
+    for p in (50, 99, 99.9):
+        bound = next(bound for bound, count in counts if count >= total * p / 100)
+        lines.append("  p%-5s <= %s" % (p, format_bound(bound)))
+    worst = next(bound for bound, count in counts if count == total)
+    lines.append("  max    <= %s" % format_bound(worst))
+    previous = 0
+    for bound, count in counts:
+        if count > previous:
+            lines.append("    %10s  %d" % ("<= " + format_bound(bound), count - previous))
+        previous = count
+    return lines
+
+
+def format_bound(bound):
+    return "inf" if bound == float("inf") else "%g us" % (bound * 1e6)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="IPC dispatch jitter with and without HTTP load")
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--paths", nargs="+", default=["/api/state"])
+    parser.add_argument("--clients", type=int, default=4)
+    parser.add_argument("--seconds", type=float, default=30)
+    parser.add_argument("--keep-alive", action="store_true",
+                        help="reuse one connection per client (use with --port 81)")
+    add_record_argument(parser)
+    args = parser.parse_args()
+
+    start = read_buckets(args.host)
+    time.sleep(args.seconds)
+    idle = read_buckets(args.host)
+
+    results = {"latencies": [], "errors": 0}
+    lock = threading.Lock()
+    deadline = time.monotonic() + args.seconds
+    threads = [threading.Thread(target=worker, args=(args.host, args.port, args.paths, deadline, args.keep_alive, results, lock))
+               for _ in range(args.clients)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    loaded = read_buckets(args.host)
+
+    lines = ["%.0f s each, load: %d clients, port %d%s, paths: %s, %.1f requests/s, %d errors" % (
+        args.seconds, args.clients, args.port, ", keep-alive" if args.keep_alive else "",
+        " ".join(args.paths), len(results["latencies"]) / args.seconds, results["errors"])]
+    lines += report("Idle", start, idle)
+    lines += report("HTTP load", idle, loaded)
+    print("\n".join(lines))
+    if args.record:
+        record(lines, args.record)
+
+
+if __name__ == "__main__":
+    main()
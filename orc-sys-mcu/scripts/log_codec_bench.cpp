@@ -0,0 +1,123 @@
+// Host benchmark for the SD log codec (lib/DataLogger/LogCodec)
+//
+// Encodes a synthetic run of reactor data into 512 byte log blocks, checks
+// that it decodes back bit for bit, and reports the compression against the
+// fixed size LogRecord layout and the encode/decode speed.
+//
+// Build and run from orc-sys-mcu/:
+//   g++ -O2 -std=gnu++17 -I lib/DataLogger scripts/log_codec_bench.cpp lib/DataLogger/LogCodec.cpp -o log_codec_bench
+//   ./log_codec_bench [hours]
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "LogCodec.h"
+
+struct Channel {
+    const char *name;
+    float base;
+    float drift;        // Amplitude of the slow change over the run
+    float noise;        // Standard deviation of the sensor noise
+    float resolution;   // Sensor resolution, 0 for full float precision
+};
+
+// Roughly the channels and sensors of a fermentation run, one sample per
+// channel per second
+static const Channel channels[] = {
+    {"power", 48.0f, 6.0f, 0.4f, 0},
+    {"temperature", 37.0f, 0.3f, 0.02f, 0.0625f},
+    {"ph", 7.0f, 0.5f, 0.005f, 0.01f},
+    {"dissolvedOxygen", 60.0f, 30.0f, 0.3f, 0.1f},
+    {"opticalDensity", 0.1f, 8.0f, 0.002f, 0.001f},
+    {"gasFlow", 500.0f, 0.0f, 1.0f, 1.0f},
+    {"pressure", 101.3f, 0.5f, 0.02f, 0.01f},
+    {"stirrerSpeed", 300.0f, 0.0f, 0.0f, 1.0f},
+    {"weight", 1500.0f, 300.0f, 0.05f, 0.1f},
+};
+static const uint8_t numChannels = sizeof(channels) / sizeof(channels[0]);
+
+static float gaussian() {
+    float u = (rand() + 1.0f) / (RAND_MAX + 2.0f), v = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+    return sqrtf(-2.0f * logf(u)) * cosf(6.2831853f * v);
+}
+
+static std::vector<LogRecord> makeRun(uint32_t seconds, bool quantised) {
+    std::vector<LogRecord> records;
+    records.reserve((size_t)seconds * numChannels);
+    const uint32_t start = 1760000000;
+    for (uint32_t s = 0; s < seconds; s++) {
+        float phase = (float)s / seconds;
+        for (uint8_t ch = 0; ch < numChannels; ch++) {
+            const Channel &c = channels[ch];
+            float value = c.base + c.drift * sinf(3.1415926f * phase) + c.noise * gaussian();
+            if (quantised && c.resolution > 0) value = roundf(value / c.resolution) * c.resolution;
+            records.push_back({start + s, ch, value});
+        }
+    }
+    return records;
+}
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void run(const char *name, const std::vector<LogRecord> &records) {
+    std::vector<LogBlock> blocks;
+    blocks.reserve(records.size() / 20 + 1);
+    LogBlockEncoder encoder;
+
+    auto start = std::chrono::steady_clock::now();
+    blocks.emplace_back();
+    encoder.begin(&blocks.back());
+    for (const LogRecord &r : records) {
+        if (!encoder.add(r)) {
+            blocks.emplace_back();
+            encoder.begin(&blocks.back());
+            encoder.add(r);
+        }
+    }
+    double encodeTime = seconds(start);
+
+    LogBlockDecoder decoder;
+    LogRecord r;
+    size_t decoded = 0;
+    bool match = true;
+    start = std::chrono::steady_clock::now();
+    for (const LogBlock &block : blocks) {
+        decoder.begin(&block);
+        while (decoder.next(r)) {
+            const LogRecord &expected = records[decoded++];
+            if (r.time != expected.time || r.channel != expected.channel ||
+                memcmp(&r.value, &expected.value, sizeof(float)) != 0) match = false;
+        }
+    }
+    double decodeTime = seconds(start);
+    if (decoded != records.size()) match = false;
+
+    // The uncompressed layout held 55 records of 9 bytes per block
+    const size_t plainRecordsPerBlock = (LOG_BLOCK_SIZE - sizeof(LogBlockHeader)) / sizeof(LogRecord);
+    size_t plainBlocks = (records.size() + plainRecordsPerBlock - 1) / plainRecordsPerBlock;
+    printf("%s\n", name);
+    printf("  records            %zu\n", records.size());
+    printf("  round trip         %s\n", match ? "ok" : "MISMATCH");
+    printf("  blocks             %zu (uncompressed %zu)\n", blocks.size(), plainBlocks);
+    printf("  ratio              %.2fx\n", (double)plainBlocks / blocks.size());
+    printf("  records per block  %.1f\n", (double)records.size() / blocks.size());
+    printf("  bits per record    %.1f\n", blocks.size() * sizeof(((LogBlock *)0)->data) * 8.0 / records.size());
+    printf("  encode             %.1f ns/record, %.1f MB/s of blocks\n",
+           encodeTime * 1e9 / records.size(), blocks.size() * LOG_BLOCK_SIZE / encodeTime / 1e6);
+    printf("  decode             %.1f ns/record, %.1f MB/s of blocks\n",
+           decodeTime * 1e9 / records.size(), blocks.size() * LOG_BLOCK_SIZE / decodeTime / 1e6);
+}
+
+int main(int argc, char **argv) {
+    uint32_t hours = argc > 1 ? atoi(argv[1]) : 24;
+    srand(1);
+    run("Sensor resolution (values quantised as the sensors report them)", makeRun(hours * 3600, true));
+    run("Full float noise (worst case for XOR compression)", makeRun(hours * 3600, false));
+    return 0;
+}
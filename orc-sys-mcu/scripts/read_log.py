@@ -0,0 +1,131 @@
+# Convert an SD card log file (lib/DataLogger/LogFormat.h) to CSV
+#
+# Usage: python scripts/read_log.py <file.orl> [--channel temperature] > out.csv
+
+import argparse
+import struct
+import sys
+from datetime import datetime, timezone
+
+BLOCK_SIZE = 512
+BLOCK_MAGIC = 0x424C
+INDEX_MAGIC = 0x5849
+FOOTER_MAGIC = 0x5446
+HEADER = struct.Struct("<6sHIIHHBB")
+BLOCK_HEADER = struct.Struct("<HHIII")
+MAX_CHANNELS = 16
+CHANNEL_NAME_SIZE = 24
+
+
+def read_header(block):
+    magic, version, created, file_id, block_size, _, num_channels, _ = HEADER.unpack_from(block)
+    if magic != b"ORCLOG":
+        raise ValueError("not a log file")
+    if version != 4 or block_size != BLOCK_SIZE:
+        raise ValueError(f"unsupported log version {version}, block size {block_size}")
+    names = []
+    for ch in range(num_channels):
+        raw = block[HEADER.size + ch * CHANNEL_NAME_SIZE:HEADER.size + (ch + 1) * CHANNEL_NAME_SIZE]
+        names.append(raw.split(b"\0", 1)[0].decode())
+    return created, file_id, names
+
+
+class BitReader:
+    def __init__(self, data):
+        self.value = int.from_bytes(data, "big")
+        self.bits = len(data) * 8
+        self.pos = 0
+
+    def read(self, n):
+        if self.pos + n > self.bits:
+            raise ValueError("block overrun")
+        self.pos += n
+        return (self.value >> (self.bits - self.pos)) & ((1 << n) - 1)
+
+
+# Time delta-of-delta prefixes 0, 10, 110, 1110, 1111: payload bits and offset
+DOD_WIDTHS = [0, 7, 9, 12, 32]
+DOD_OFFSETS = [0, 63, 255, 2047, 0]
+
+
+def decode_block(block):
+    """Records of a data block, as encoded by lib/DataLogger/LogCodec.cpp"""
+    _, count, _, first_time, _ = BLOCK_HEADER.unpack_from(block)
+    bits = BitReader(block[BLOCK_HEADER.size:])
+    state = {}          # channel -> [time, delta, value bits, leading, trailing]
+    next_channel = {}   # channel -> channel that followed it
+    last = None
+    try:
+        for _ in range(count):
+            if bits.read(1):
+                ch = bits.read(4)
+            else:
+                ch = next_channel[last]
+            if last is not None:
+                next_channel[last] = ch
+            last = ch
+
+            s = state.get(ch)
+            previous, previous_delta = (s[0], s[1]) if s else (first_time, 0)
+            ones = 0
+            while ones < 4 and bits.read(1):
+                ones += 1
+            dod = 0
+            if ones:
+                dod = bits.read(DOD_WIDTHS[ones]) - DOD_OFFSETS[ones]
+                if ones == 4 and dod >= 1 << 31:
+                    dod -= 1 << 32
+            delta = previous_delta + dod
+            time = (previous + delta) & 0xFFFFFFFF
+
+            if s is None:
+                value = bits.read(32)
+                s = state[ch] = [time, delta, value, None, None]
+            elif bits.read(1) == 0:
+                value = s[2]
+            else:
+                if bits.read(1):
+                    s[3] = bits.read(5)
+                    s[4] = 32 - s[3] - bits.read(6)
+                value = s[2] ^ (bits.read(32 - s[3] - s[4]) << s[4])
+            s[0], s[1], s[2] = time, delta, value
+            yield time, ch, struct.unpack("<f", struct.pack("<I", value))[0]
+    except (KeyError, TypeError, ValueError):
+        return  # Corrupt block
+
+
+def read_records(f, file_id):
+    sequence = 0
+    while True:
+        block = f.read(BLOCK_SIZE)
+        if len(block) < BLOCK_SIZE:
+            return
+        magic, _, block_sequence, _, block_file_id = BLOCK_HEADER.unpack_from(block)
+        if magic == INDEX_MAGIC:
+            continue
+        if magic != BLOCK_MAGIC or block_sequence != sequence or block_file_id != file_id:
+            return  # Footer, or the end of the written part of a file that was never closed
+        yield from decode_block(block)
+        sequence += 1
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("file")
+    parser.add_argument("--channel", help="only this channel")
+    args = parser.parse_args()
+
+    with open(args.file, "rb") as f:
+        _, file_id, names = read_header(f.read(BLOCK_SIZE))
+        out = sys.stdout
+        out.write("time,channel,value\n")
+        for time, ch, value in read_records(f, file_id):
+            name = names[ch] if ch < len(names) else str(ch)
+            if args.channel and name != args.channel:
+                continue
+            stamp = datetime.fromtimestamp(time, timezone.utc).strftime("%Y-%m-%dT%H:%M:%S")
+            out.write(f"{stamp},{name},{value:.6g}\n")
+
+
+if __name__ == "__main__":
+    main()
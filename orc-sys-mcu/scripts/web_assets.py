@@ -0,0 +1,269 @@
+# Web asset build step
+#
+# Runs as a PlatformIO pre-script (see extra_scripts in platformio.ini) and
+# turns the web UI sources in data/ into the LittleFS image directory
+# (data_dir, .pio/webfs):
+#   - references from HTML to local assets are fingerprinted (script.js?v=<hash>)
+#     so those assets can be cached by the browser indefinitely; the firmware
+#     only says so when a request carries the current hash, anything else
+#     (favicon.ico, a stale or hand typed URL) is revalidated by ETag
+#   - every file is written as-is plus a gzip variant where that is smaller
+#   - manifest.json lists each file with a strong ETag per variant, so the
+#     firmware can answer requests without probing the filesystem
+#
+# It also writes include/web_assets_embedded.h, the same assets as constant
+# byte arrays (placed in XIP flash) with a perfect hash route table. The
+# firmware serves from it when built with -D WEB_ASSETS_EMBEDDED.
+#
+# Can also be run by hand: python scripts/web_assets.py [project_dir]
+
+import gzip
+import hashlib
+import json
+import os
+import re
+import sys
+
+SOURCE_DIR = "data"
+MANIFEST_NAME = "manifest.json"
+EMBEDDED_HEADER = os.path.join("include", "web_assets_embedded.h")
+
+# Keep in step with getContentType() in main.cpp
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".ico": "image/x-icon",
+}
+
+# Local references in HTML that get a ?v=<hash> cache buster
+REF_PATTERN = re.compile(r'((?:src|href)=")([^"/:?#]+\.(?:js|css|ico))(")')
+
+
+def content_hash(data):
+    return hashlib.sha256(data).hexdigest()[:16]
+
+
+def asset_version(data):
+    # The v= value in fingerprinted references, checked by the firmware
+    return content_hash(data)[:8]
+
+
+def gzip_bytes(data):
+    # mtime=0 keeps the output (and therefore the ETag) reproducible
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+
+def load_sources(src_dir):
+    files = {}
+    for name in sorted(os.listdir(src_dir)):
+        path = os.path.join(src_dir, name)
+        if not os.path.isfile(path) or name.startswith("."):
+            continue
+        with open(path, "rb") as f:
+            files[name] = f.read()
+    return files
+
+
+def fingerprint_html(files):
+    """Rewrite local asset references in HTML files to include a content hash."""
+    versions = {name: asset_version(data) for name, data in files.items()}
+
+    def replace(match):
+        name = match.group(2)
+        if name not in versions:
+            return match.group(0)
+        return "%s%s?v=%s%s" % (match.group(1), name, versions[name], match.group(3))
+
+    for name, data in files.items():
+        if name.endswith(".html"):
+            files[name] = REF_PATTERN.sub(replace, data.decode("utf-8")).encode("utf-8")
+
+
+def process_assets(src_dir):
+    """Return a list of processed assets: name, raw bytes, gzip bytes (or None), etags, version."""
+    files = load_sources(src_dir)
+    fingerprint_html(files)
+    assets = []
+    for name, data in files.items():
+        gz = gzip_bytes(data)
+        if len(gz) >= len(data):
+            gz = None
+        assets.append({
+            "name": name,
+            "data": data,
+            "gz": gz,
+            "etag": '"%s"' % content_hash(data),
+            "gzEtag": '"%s"' % content_hash(gz) if gz else "",
+            # HTML is the entry point and is always revalidated. Everything
+            # else is cached indefinitely when requested with this version,
+            # as it never changes under that URL
+            "version": "" if name.endswith(".html") else asset_version(data),
+        })
+    return assets
+
+
+def write_if_changed(path, data):
+    if os.path.isfile(path):
+        with open(path, "rb") as f:
+            if f.read() == data:
+                return
+    with open(path, "wb") as f:
+        f.write(data)
+
+
+def build_filesystem(assets, out_dir):
+    os.makedirs(out_dir, exist_ok=True)
+    manifest = {"files": []}
+    for asset in assets:
+        write_if_changed(os.path.join(out_dir, asset["name"]), asset["data"])
+        gz_path = os.path.join(out_dir, asset["name"] + ".gz")
+        if asset["gz"]:
+            write_if_changed(gz_path, asset["gz"])
+        elif os.path.isfile(gz_path):
+            os.remove(gz_path)
+        manifest["files"].append({
+            "path": "/" + asset["name"],
+            "etag": asset["etag"],
+            "gzEtag": asset["gzEtag"],
+            "version": asset["version"],
+        })
+    write_if_changed(os.path.join(out_dir, MANIFEST_NAME),
+                     json.dumps(manifest, separators=(",", ":")).encode("utf-8"))
+
+
+def content_type(name):
+    return CONTENT_TYPES.get(os.path.splitext(name)[1], "text/plain")
+
+
+def route_hash(path, seed):
+    # FNV-1a with a seed, must match webRouteHash() in the generated header
+    h = (2166136261 ^ seed) & 0xFFFFFFFF
+    for c in path.encode("utf-8"):
+        h ^= c
+        h = (h * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def perfect_hash(paths):
+    """Find a seed giving every path its own slot in a power of two table."""
+    size = 1
+    while size < 2 * len(paths):
+        size *= 2
+    for seed in range(1 << 16):
+        slots = [0xFF] * size
+        for index, path in enumerate(paths):
+            slot = route_hash(path, seed) & (size - 1)
+            if slots[slot] != 0xFF:
+                break
+            slots[slot] = index
+        else:
+            return seed, slots
+    raise RuntimeError("No perfect hash seed found for web assets")
+
+
+def c_identifier(name):
+    return re.sub(r"[^0-9A-Za-z]", "_", name)
+
+
+def c_bytes(data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return "\n".join(lines)
+
+
+def build_embedded_header(assets, path):
+    paths = ["/" + a["name"] for a in assets]
+    seed, slots = perfect_hash(paths)
+    out = [
+        "// Generated by scripts/web_assets.py from data/, do not edit",
+        "#pragma once",
+        "",
+        "#include <stddef.h>",
+        "#include <stdint.h>",
+        "#include <string.h>",
+        "",
+        "struct EmbeddedWebAsset",
+        "{",
+        "    const char *path;",
+        "    const uint8_t *data;",
+        "    uint32_t length;",
+        "    const uint8_t *gzData; // nullptr if there is no gzip variant",
+        "    uint32_t gzLength;",
+        "    const char *contentType;",
+        "    const char *etag;",
+        "    const char *gzEtag;",
+        "    const char *version; // v= that makes a request cacheable indefinitely, empty for none",
+        "};",
+        "",
+    ]
+    for asset in assets:
+        ident = c_identifier(asset["name"])
+        out.append("static constexpr uint8_t webAsset_%s[%d] = {" % (ident, len(asset["data"])))
+        out.append(c_bytes(asset["data"]))
+        out.append("};")
+        if asset["gz"]:
+            out.append("static constexpr uint8_t webAsset_%s_gz[%d] = {" % (ident, len(asset["gz"])))
+            out.append(c_bytes(asset["gz"]))
+            out.append("};")
+        out.append("")
+
+    out.append("static constexpr EmbeddedWebAsset embeddedWebAssets[%d] = {" % len(assets))
+    for asset in assets:
+        ident = c_identifier(asset["name"])
+        gz = asset["gz"]
+        out.append('    {"/%s", webAsset_%s, %d, %s, %d, "%s", %s, %s, "%s"},' % (
+            asset["name"], ident, len(asset["data"]),
+            "webAsset_%s_gz" % ident if gz else "nullptr", len(gz) if gz else 0,
+            content_type(asset["name"]),
+            json.dumps(asset["etag"]), json.dumps(asset["gzEtag"]), asset["version"]))
+    out.append("};")
+    out.append("")
+    out.append("// Perfect hash route table: slot -> index into embeddedWebAssets (0xFF = empty)")
+    out.append("static constexpr uint32_t webRouteSeed = %du;" % seed)
+    out.append("static constexpr uint8_t webRouteTable[%d] = {%s};" % (
+        len(slots), ", ".join("0x%02x" % s for s in slots)))
+    out.append("")
+    out.append("""static inline uint32_t webRouteHash(const char *path)
+{
+    uint32_t h = 2166136261u ^ webRouteSeed;
+    while (*path) {
+        h ^= (uint8_t)*path++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static inline const EmbeddedWebAsset *findEmbeddedWebAsset(const char *path)
+{
+    uint8_t index = webRouteTable[webRouteHash(path) & (sizeof(webRouteTable) - 1)];
+    if (index == 0xFF || strcmp(embeddedWebAssets[index].path, path) != 0) return nullptr;
+    return &embeddedWebAssets[index];
+}
+""")
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    write_if_changed(path, "\n".join(out).encode("utf-8"))
+
+
+def run(project_dir, out_dir):
+    assets = process_assets(os.path.join(project_dir, SOURCE_DIR))
+    build_filesystem(assets, out_dir)
+    build_embedded_header(assets, os.path.join(project_dir, EMBEDDED_HEADER))
+    raw = sum(len(a["data"]) for a in assets)
+    sent = sum(len(a["gz"] or a["data"]) for a in assets)
+    print("Web assets: %d files, %d bytes raw, %d bytes served compressed" % (len(assets), raw, sent))
+    return assets
+
+
+try:
+    Import("env")  # noqa: F821 (provided by PlatformIO/SCons)
+except NameError:
+    env = None
+
+if env is not None:
+    run(env.subst("$PROJECT_DIR"), env.subst("$PROJECT_DATA_DIR"))
+elif __name__ == "__main__":
+    project = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    run(project, os.path.join(project, ".pio", "webfs"))
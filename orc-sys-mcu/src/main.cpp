@@ -2,11 +2,40 @@
 
 // ---------------------- RTOS tasks ---------------------- //
 
+// Core 0 tasks
+void manageNetwork(void *param);
+void manageWebServer(void *param);
+void manageDebugOutput(void *param);
+void manageWatchdog(void *param);
+
 // Core 1 tasks
+void manageIPC(void *param);
 void statusLEDs(void *param);
 void manageRTC(void *param);
 void manageTerminal(void *param);
 void managePower(void *param);
+void manageLogger(void *param);
+void manageProfiler(void *param);
+
+// Tasks in the task table
+enum AppTask : uint8_t {
+  TASK_DEBUG_OUT,
+  TASK_NETWORK,
+  TASK_HTTP,
+  TASK_IPC,
+  TASK_LEDS,
+  TASK_RTC,
+  TASK_TERMINAL,
+  TASK_POWER,
+  TASK_LOGGER,
+  TASK_PROFILER,
+  TASK_WATCHDOG,
+  NUM_TASKS
+};
+extern TaskHandle_t taskHandles[NUM_TASKS];
+void startTask(AppTask task);
+void reportMemoryBudget(void);
+void runTerminalCommand(const char *command);
 
 // -------------------- Non-RTOS tasks -------------------- //
 
@@ -17,6 +46,12 @@ void setupWebServer(void);
 void handleWebServer(void);
 void handleRoot(void);
 void handleFile(const char *path);
+void sendJson(int code, const JsonDocument &doc);
+void setupLiveServer(void);
+void handleLiveServer(void);
+void loadWebAssetManifest(void);
+void setupApiRoutes(void);
+const char *getContentType(const char *path);
 
 
 
@@ -24,25 +59,46 @@ void handleFile(const char *path);
 bool updateGlobalDateTime(const DateTime &dt);
 bool getGlobalDateTime(DateTime &dt);
 bool setLEDcolour(uint8_t led, uint32_t colour);
+void getProcessImage(ProcessImage &image);
+template <typename UpdateFn> bool updateProcessImage(UpdateFn update);
+void updateLinkStatus(void);
+void serializeProcessImage(JsonObject root, const ProcessImage &image, uint8_t fields);
+bool parseImageFields(const char *list, uint8_t &fields);
 
 // Debug functions
-void debug_printf(uint8_t logLevel, const char* format, ...);
+void debug_flush(void);
 void osDebugPrint(void);
+const char *taskStateName(uint8_t state);
+size_t formatTop(char *screen, size_t size);
 
 // Function to convert epoch time to DateTime
 DateTime epochToDateTime(time_t epochTime)
 {
-  struct tm *timeinfo = gmtime(&epochTime);
+  struct tm timeinfo;
+  gmtime_r(&epochTime, &timeinfo);  // Called from several tasks
   DateTime dt = {
-      .year = (uint16_t)(timeinfo->tm_year + 1900),
-      .month = (uint8_t)(timeinfo->tm_mon + 1),
-      .day = (uint8_t)timeinfo->tm_mday,
-      .hour = (uint8_t)timeinfo->tm_hour,
-      .minute = (uint8_t)timeinfo->tm_min,
-      .second = (uint8_t)timeinfo->tm_sec};
+      .year = (uint16_t)(timeinfo.tm_year + 1900),
+      .month = (uint8_t)(timeinfo.tm_mon + 1),
+      .day = (uint8_t)timeinfo.tm_mday,
+      .hour = (uint8_t)timeinfo.tm_hour,
+      .minute = (uint8_t)timeinfo.tm_min,
+      .second = (uint8_t)timeinfo.tm_sec};
   return dt;
 }
 
+// Function to convert DateTime to epoch time (inverse of epochToDateTime)
+uint32_t dateTimeToEpoch(const DateTime &dt)
+{
+  // Days since 1970-01-01, counting years from March so leap days fall last
+  int32_t y = dt.year - (dt.month <= 2 ? 1 : 0);
+  int32_t era = y / 400;
+  int32_t yoe = y - era * 400;
+  int32_t doy = (153 * (dt.month + (dt.month > 2 ? -3 : 9)) + 2) / 5 + dt.day - 1;
+  int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  int32_t days = era * 146097 + doe - 719468;
+  return (uint32_t)days * 86400 + dt.hour * 3600 + dt.minute * 60 + dt.second;
+}
+
 // Carry out an NTP update
 void ntpUpdate(void)
 {
@@ -71,6 +127,7 @@ void ntpUpdate(void)
    }
     if (!updateSuccessful) {
       debug_printf(LOG_ERROR, "Failed to get time from NTP server, giving up\n");
+      ntpSyncFailure.inc();
       return;
     }
   }
@@ -90,10 +147,12 @@ void ntpUpdate(void)
   if (!updateGlobalDateTime(newTime))
   {
     debug_printf(LOG_ERROR, "Failed to update time from NTP\n");
+    ntpSyncFailure.inc();
   }
   else
   {
     debug_printf(LOG_INFO, "Time updated from NTP server\n");
+    ntpSyncSuccess.inc();
   }
 }
 
@@ -236,6 +295,7 @@ void setupEthernet()
                 eth.gatewayIP().toString().c_str());
     ethernetConnected = true;
   }
+  updateLinkStatus();
 }
 
 // API endpoint to get current network settings
@@ -273,9 +333,7 @@ void setupNetworkAPI()
         doc["ntp"] = networkConfig.ntpServer;
         doc["dst"] = networkConfig.dstEnabled;
         
-        String response;
-        serializeJson(doc, response);
-        server.send(200, "application/json", response); });
+        sendJson(200, doc); });
 
   server.on("/api/network", HTTP_POST, []()
             {
@@ -354,9 +412,7 @@ void setupMqttAPI()
         // Don't send the password back for security
         doc["mqttPassword"] = "";
         
-        String response;
-        serializeJson(doc, response);
-        server.send(200, "application/json", response);
+        sendJson(200, doc);
     });
 
     server.on("/api/mqtt", HTTP_POST, []() {
@@ -415,9 +471,7 @@ void setupTimeAPI()
             doc["ntpEnabled"] = networkConfig.ntpEnabled;
             doc["dst"] = networkConfig.dstEnabled;
             
-            String response;
-            serializeJson(doc, response);
-            server.send(200, "application/json", response);
+            sendJson(200, doc);
         } else {
             server.send(500, "application/json", "{\"error\": \"Failed to get current time\"}");
         }
@@ -468,7 +522,9 @@ void setupTimeAPI()
             if (doc.containsKey("dstEnabled")) {
               networkConfig.dstEnabled = doc["dstEnabled"];
             }
-            handleNTPUpdates(true);
+            // NTP runs in the network task, request an immediate sync there rather than blocking this task
+            bool forceUpdate = true;
+            xQueueOverwrite(ntpUpdateQueue, &forceUpdate);
             server.send(200, "application/json", "{\"status\": \"success\", \"message\": \"NTP enabled, manual time update ignored\"}");
             saveNetworkConfig(); // Save to EEPROM when NTP settings change
             return;
@@ -512,53 +568,54 @@ void setupTimeAPI()
 
 void setupWebServer()
 {
-  // Initialize LittleFS for serving web files
+  // Initialize LittleFS for serving web files (the API and any embedded
+  // assets are still served if it fails to mount)
   if (!LittleFS.begin())
   {
     debug_printf(LOG_ERROR, "LittleFS Mount Failed\n");
-    return;
   }
+  else loadWebAssetManifest();
 
   // Route handlers
   server.on("/", HTTP_GET, handleRoot);
   server.on("/api/sensors", HTTP_GET, []()
             {
-        DateTime dt;
-        if (!getGlobalDateTime(dt)) {
-            server.send(500, "application/json", "{\"error\":\"Failed to get time\"}");
-            return;
-        }
+        ProcessImage image;
+        getProcessImage(image);
+        const DateTime &dt = image.time;
 
         char json[128];
         snprintf(json, sizeof(json),
-                "{\"temp\":25.5,\"ph\":7.2,\"do\":6.8,\"timestamp\":\"%04d-%02d-%02dT%02d:%02d:%02d\"}",
+                "{\"temp\":%.2f,\"ph\":%.2f,\"do\":%.2f,\"timestamp\":\"%04d-%02d-%02dT%02d:%02d:%02d\"}",
+                image.sensors.temperature.celcius, image.sensors.ph.pH, image.sensors.dissolvedOxygen.oxygen,
                 dt.year, dt.month, dt.day, dt.hour, dt.minute, dt.second);
         server.send(200, "application/json", json); });
 
   // System status endpoints
   server.on("/api/power", HTTP_GET, []() {
         StaticJsonDocument<200> doc;
-        
-        xSemaphoreTake(statusMutex, portMAX_DELAY);
-        doc["mainVoltage"] = status.Vpsu;
-        doc["v20Voltage"] = status.V20;
-        doc["v5Voltage"] = status.V5;
-        doc["mainVoltageOK"] = status.psuOK;
-        doc["v20VoltageOK"] = status.V20OK;
-        doc["v5VoltageOK"] = status.V5OK;
-        xSemaphoreGive(statusMutex);
-        
-        String response;
-        serializeJson(doc, response);
-        server.send(200, "application/json", response);
+        StatusVariables current = status.read();
+        doc["mainVoltage"] = current.Vpsu;
+        doc["v20Voltage"] = current.V20;
+        doc["v5Voltage"] = current.V5;
+        doc["mainVoltageOK"] = current.psuOK;
+        doc["v20VoltageOK"] = current.V20OK;
+        doc["v5VoltageOK"] = current.V5OK;
+        sendJson(200, doc);
     });
 
   // Handle static files
   server.onNotFound([]()
                     { handleFile(server.uri().c_str()); });
 
+  // Request headers used by the handlers (WebServer discards all others)
+  static const char *headerKeys[] = {"If-None-Match", "Accept-Encoding", "Accept"};
+  server.collectHeaders(headerKeys, sizeof(headerKeys) / sizeof(headerKeys[0]));
+
   server.begin();
   debug_printf(LOG_INFO, "HTTP server started\n");
+
+  setupLiveServer();
   
   // Set Webserver Status LED
   setLEDcolour(LED_WEBSERVER_STATUS, LED_STATUS_OK);
@@ -570,34 +627,225 @@ void handleWebServer()
     return;
   }
   server.handleClient();
+  handleLiveServer();
   setLEDcolour(LED_WEBSERVER_STATUS, LED_STATUS_OK);
 }
 
+// Writes serialised output to the current client in fixed size chunks, so
+// responses never need a heap-allocated String holding the whole body.
+// Goes to the WebServer response unless a live port connection is given, in
+// which case chunked sets Transfer-Encoding: chunked framing for bodies whose
+// length is not known up front (the WebServer frames its own chunks).
+class ResponseWriter : public Print
+{
+public:
+  ResponseWriter(WiFiClient *client = nullptr, bool chunked = false) : _client(client), _chunked(chunked) {}
+
+  size_t write(uint8_t c) override
+  {
+    _buffer[_length++] = c;
+    if (_length == sizeof(_buffer)) flushChunk();
+    return 1;
+  }
+
+  size_t write(const uint8_t *data, size_t size) override
+  {
+    size_t remaining = size;
+    while (remaining > 0) {
+      size_t n = min(remaining, sizeof(_buffer) - _length);
+      memcpy(_buffer + _length, data, n);
+      _length += n;
+      data += n;
+      remaining -= n;
+      if (_length == sizeof(_buffer)) flushChunk();
+    }
+    return size;
+  }
+
+  void flushChunk(void)
+  {
+    if (_length == 0) return;
+    if (_client && _chunked) {
+      char size[8];
+      int len = snprintf(size, sizeof(size), "%x\r\n", (unsigned)_length);
+      _client->write((const uint8_t *)size, len);
+      _client->write((const uint8_t *)_buffer, _length);
+      _client->write((const uint8_t *)"\r\n", 2);
+    }
+    else if (_client) _client->write((const uint8_t *)_buffer, _length);
+    else server.sendContent(_buffer, _length);
+    _length = 0;
+  }
+
+  // Flush and, for chunked bodies, send the terminating chunk
+  void finish(void)
+  {
+    flushChunk();
+    if (_client && _chunked) _client->write((const uint8_t *)"0\r\n\r\n", 5);
+  }
+
+private:
+  WiFiClient *_client;
+  bool _chunked;
+  char _buffer[RESPONSE_CHUNK_SIZE];
+  size_t _length = 0;
+};
+
+// Counts output without sending it, to work out a Content-Length up front
+class CountingPrint : public Print
+{
+public:
+  size_t write(uint8_t c) override
+  {
+    (void)c;
+    _count++;
+    return 1;
+  }
+
+  size_t write(const uint8_t *data, size_t size) override
+  {
+    (void)data;
+    _count += size;
+    return size;
+  }
+
+  size_t count(void) const { return _count; }
+
+private:
+  size_t _count = 0;
+};
+
+// Send a JSON document with a precomputed Content-Length, serialised straight to the socket
+void sendJson(int code, const JsonDocument &doc)
+{
+  static ResponseWriter writer;
+  server.setContentLength(measureJson(doc));
+  server.send(code, "application/json", "");
+  serializeJson(doc, writer);
+  writer.flushChunk();
+}
+
 void handleRoot()
 {
   handleFile("/index.html");
 }
 
+// Content type lookup by file extension
+const char *getContentType(const char *path)
+{
+  static const struct {
+    const char *extension;
+    const char *contentType;
+  } mimeTypes[] = {
+    {".html", "text/html"},
+    {".css", "text/css"},
+    {".js", "application/javascript"},
+    {".json", "application/json"},
+    {".ico", "image/x-icon"},
+  };
+  size_t pathLen = strlen(path);
+  for (const auto &mime : mimeTypes) {
+    size_t extLen = strlen(mime.extension);
+    if (pathLen >= extLen && strcmp(path + pathLen - extLen, mime.extension) == 0) {
+      return mime.contentType;
+    }
+  }
+  return "text/plain";
+}
+
+// Load the web asset manifest so requests can be answered without probing the filesystem
+void loadWebAssetManifest(void)
+{
+  numWebAssets = 0;
+  File file = LittleFS.open(WEB_ASSET_MANIFEST, "r");
+  if (!file) {
+    debug_printf(LOG_WARNING, "Web asset manifest not found, static files will not be cached\n");
+    return;
+  }
+  DynamicJsonDocument doc(3072);
+  DeserializationError error = deserializeJson(doc, file);
+  file.close();
+  if (error) {
+    debug_printf(LOG_ERROR, "Web asset manifest invalid: %s\n", error.c_str());
+    return;
+  }
+
+  for (JsonObject entry : doc["files"].as<JsonArray>()) {
+    if (numWebAssets >= WEB_MAX_ASSETS) {
+      debug_printf(LOG_WARNING, "Web asset manifest has more than %d files, ignoring the rest\n", WEB_MAX_ASSETS);
+      break;
+    }
+    WebAsset &asset = webAssets[numWebAssets];
+    strlcpy(asset.path, entry["path"] | "", sizeof(asset.path));
+    strlcpy(asset.etag, entry["etag"] | "", sizeof(asset.etag));
+    strlcpy(asset.gzEtag, entry["gzEtag"] | "", sizeof(asset.gzEtag));
+    asset.contentType = getContentType(asset.path);
+    strlcpy(asset.version, entry["version"] | "", sizeof(asset.version));
+    if (asset.path[0] == '/' && asset.etag[0] == '"') numWebAssets++;
+  }
+  debug_printf(LOG_INFO, "Loaded %d web assets from manifest\n", numWebAssets);
+}
+
+const WebAsset *findWebAsset(const char *path)
+{
+  for (int i = 0; i < numWebAssets; i++) {
+    if (strcmp(webAssets[i].path, path) == 0) return &webAssets[i];
+  }
+  return nullptr;
+}
+
+// Check an If-None-Match header value (possibly a list) against an ETag
+bool etagMatches(const String &ifNoneMatch, const char *etag)
+{
+  if (ifNoneMatch.length() == 0) return false;
+  if (ifNoneMatch == "*") return true;
+  return strstr(ifNoneMatch.c_str(), etag) != nullptr;
+}
+
+bool clientAcceptsGzip(void)
+{
+  return server.header("Accept-Encoding").indexOf("gzip") >= 0;
+}
+
+// Only a request for the fingerprinted URL may be cached indefinitely, the
+// same file under any other URL (favicon.ico, no or an old v=) is revalidated
+void sendCacheHeaders(const char *etag, const char *version, bool hasGzip)
+{
+  bool immutable = version[0] != '\0' && server.arg("v") == version;
+  server.sendHeader("ETag", etag);
+  server.sendHeader("Cache-Control", immutable ? WEB_CACHE_IMMUTABLE : WEB_CACHE_REVALIDATE);
+  if (hasGzip) server.sendHeader("Vary", "Accept-Encoding");
+}
+
+#ifdef WEB_ASSETS_EMBEDDED
+// Serve an asset compiled into flash, written to the socket straight from XIP flash
+void serveEmbeddedAsset(const EmbeddedWebAsset &asset)
+{
+  bool useGzip = asset.gzData != nullptr && clientAcceptsGzip();
+  const char *etag = useGzip ? asset.gzEtag : asset.etag;
+  sendCacheHeaders(etag, asset.version, asset.gzData != nullptr);
+
+  if (etagMatches(server.header("If-None-Match"), etag)) {
+    server.send(304);
+    return;
+  }
+  const uint8_t *data = useGzip ? asset.gzData : asset.data;
+  size_t length = useGzip ? asset.gzLength : asset.length;
+  if (useGzip) server.sendHeader("Content-Encoding", "gzip");
+  server.setContentLength(length);
+  server.send(200, asset.contentType, "");
+  server.sendContent((const char *)data, length);
+}
+#endif
+
 void handleFile(const char *path)
 {
+  MetricsTimer timer(httpLatencyStatic);
   if(eth.status() != WL_CONNECTED) {
     setLEDcolour(LED_WEBSERVER_STATUS, LED_STATUS_OFF);
     return;
   }
   setLEDcolour(LED_WEBSERVER_STATUS, LED_STATUS_BUSY);
-  String contentType;
-  if (strstr(path, ".html"))
-    contentType = "text/html";
-  else if (strstr(path, ".css"))
-    contentType = "text/css";
-  else if (strstr(path, ".js"))
-    contentType = "application/javascript";
-  else if (strstr(path, ".json"))
-    contentType = "application/json";
-  else if (strstr(path, ".ico"))
-    contentType = "image/x-icon";
-  else
-    contentType = "text/plain";
 
   String filePath = path;
   if (filePath.endsWith("/"))
@@ -605,367 +853,2214 @@ void handleFile(const char *path)
   if (!filePath.startsWith("/"))
     filePath = "/" + filePath;
 
-  if (LittleFS.exists(filePath))
+#ifdef WEB_ASSETS_EMBEDDED
+  const EmbeddedWebAsset *embedded = findEmbeddedWebAsset(filePath.c_str());
+  if (embedded != nullptr)
   {
-    File file = LittleFS.open(filePath, "r");
-    server.streamFile(file, contentType);
-    file.close();
+    serveEmbeddedAsset(*embedded);
+    setLEDcolour(LED_WEBSERVER_STATUS, LED_STATUS_OK);
+    return;
   }
-  else
+#endif
+
+  const WebAsset *asset = findWebAsset(filePath.c_str());
+  if (asset == nullptr)
   {
-    server.send(404, "text/plain", "File not found");
+    // Not in the manifest, serve straight from the filesystem
+    if (LittleFS.exists(filePath))
+    {
+      File file = LittleFS.open(filePath, "r");
+      server.streamFile(file, getContentType(filePath.c_str()));
+      file.close();
+    }
+    else
+    {
+      server.send(404, "text/plain", "File not found");
+    }
+    setLEDcolour(LED_WEBSERVER_STATUS, LED_STATUS_OK);
+    return;
+  }
+
+  bool useGzip = asset->gzEtag[0] != '\0' && clientAcceptsGzip();
+  const char *etag = useGzip ? asset->gzEtag : asset->etag;
+  bool notModified = etagMatches(server.header("If-None-Match"), etag);
+
+  File file;
+  if (!notModified) {
+    if (useGzip) filePath += ".gz";
+    file = LittleFS.open(filePath, "r");
+    if (!file) {
+      server.send(404, "text/plain", "File not found");
+      setLEDcolour(LED_WEBSERVER_STATUS, LED_STATUS_OK);
+      return;
+    }
+  }
+
+  sendCacheHeaders(etag, asset->version, asset->gzEtag[0] != '\0');
+
+  if (notModified) {
+    server.send(304);
+  }
+  else {
+    // Headers are written here rather than by streamFile() so Content-Encoding
+    // does not depend on the file name heuristics in WebServer
+    if (useGzip) server.sendHeader("Content-Encoding", "gzip");
+    server.setContentLength(file.size());
+    server.send(200, asset->contentType, "");
+    server.client().write(file);
+    file.close();
   }
   setLEDcolour(LED_WEBSERVER_STATUS, LED_STATUS_OK);
 }
 
-// Inter-processor communication
-void setupIPC(void) {
-  Serial1.setRX(PIN_SI_RX);
-  Serial1.setTX(PIN_SI_TX);
-  ipc.begin(115200);
-  // Add in handshaking checks here...
-  debug_printf(LOG_INFO, "Inter-processor communication setup complete\n");
+// ---------------------- Sensor history ---------------------- //
+
+// Sensor values kept in the history and the IPC message each comes from.
+// Names match the sensor keys in /api/state.
+struct HistoryChannel {
+  const char *name;
+  uint8_t msgId;
+  size_t valueOffset;   // float in the message payload
+  size_t onlineOffset;  // bool in the message payload
+};
+#define HISTORY_CHANNEL(name, id, type, value) {name, id, offsetof(type, value), offsetof(type, online)}
+const HistoryChannel historyChannels[HISTORY_CHANNELS] = {
+  HISTORY_CHANNEL("power", MSG_POWER_SENSOR, PowerSensor, watts),
+  HISTORY_CHANNEL("temperature", MSG_TEMPERATURE_SENSOR, TemperatureSensor, celcius),
+  HISTORY_CHANNEL("ph", MSG_PH_SENSOR, PHSensor, pH),
+  HISTORY_CHANNEL("dissolvedOxygen", MSG_DO_SENSOR, DissolvedOxygenSensor, oxygen),
+  HISTORY_CHANNEL("opticalDensity", MSG_OD_SENSOR, OpticalDensitySensor, OD),
+  HISTORY_CHANNEL("gasFlow", MSG_GAS_FLOW_SENSOR, GasFlowSensor, mlPerMinute),
+  HISTORY_CHANNEL("pressure", MSG_PRESSURE_SENSOR, PressureSensor, kPa),
+  HISTORY_CHANNEL("stirrerSpeed", MSG_STIRRER_SPEED_SENSOR, StirrerSpeedSensor, rpm),
+  HISTORY_CHANNEL("weight", MSG_WEIGHT_SENSOR, WeightSensor, grams),
+};
+
+int8_t findHistoryChannel(const char *name)
+{
+  for (uint8_t ch = 0; ch < HISTORY_CHANNELS; ch++) {
+    if (strcmp(historyChannels[ch].name, name) == 0) return ch;
+  }
+  return -1;
 }
 
-// ---------------------- Utility functions ---------------------- //
-
-// Function to safely get the current DateTime
-bool getGlobalDateTime(DateTime &dt)
+// Add the value from an IPC sensor message to its channel's history and the SD card log
+void recordHistory(const Message &msg, uint32_t epoch)
 {
-  if (xSemaphoreTake(dateTimeMutex, pdMS_TO_TICKS(100)) == pdTRUE)
-  {
-    memcpy(&dt, &globalDateTime, sizeof(DateTime));
-    xSemaphoreGive(dateTimeMutex);
-    return true;
+  if (epoch == 0) return;  // RTC not read yet
+  for (uint8_t ch = 0; ch < HISTORY_CHANNELS; ch++) {
+    const HistoryChannel &hc = historyChannels[ch];
+    if (hc.msgId != msg.msgId) continue;
+    bool online;
+    float value;
+    memcpy(&online, msg.data + hc.onlineOffset, sizeof(online));
+    memcpy(&value, msg.data + hc.valueOffset, sizeof(value));
+    if (!online) return;
+    dataLogger.log(epoch, ch, value);
+    // Drop the sample rather than hold up IPC processing behind a query
+    if (xSemaphoreTake(historyMutex, pdMS_TO_TICKS(10)) != pdTRUE) return;
+    sensorHistory[ch].add(epoch, value);
+    xSemaphoreGive(historyMutex);
+    return;
   }
-  return false;
 }
 
-// Function to safely update the DateTime
-bool updateGlobalDateTime(const DateTime &dt) {
-    const int maxRetries = 3; // Maximum number of retries
-    const int retryDelayMs = 100; // Delay between retries (milliseconds)
-
-    if (xSemaphoreTake(dateTimeMutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-        bool success = false;
-        for (int retry = 0; retry < maxRetries; ++retry) {
-            debug_printf(LOG_INFO, "Attempt %d: Setting RTC to: %04d-%02d-%02d %02d:%02d:%02d\n",
-                          retry + 1, dt.year, dt.month, dt.day, dt.hour, dt.minute, dt.second);
-
-            rtc.setDateTime(dt); // Set RTC time
-
-            // Verify the time was set by reading it back
-            DateTime currentTime;
-            if (rtc.getDateTime(&currentTime)) {
-              // Check that time is correct before proceeding
-              if (currentTime.year == dt.year &&
-                  currentTime.month == dt.month &&
-                  currentTime.day == dt.day &&
-                  currentTime.hour == dt.hour &&
-                  currentTime.minute == dt.minute &&
-                  currentTime.second == dt.second) {
-                    debug_printf(LOG_INFO, "RTC verification successful after %d retries.\n", retry);
-                    memcpy(&globalDateTime, &dt, sizeof(DateTime)); // Update global time after successful write
-                    success = true;
-                    break; // Exit retry loop on success
-              } else {
-                debug_printf(LOG_ERROR, "RTC verification failed, current time: %04d-%02d-%02d %02d:%02d:%02d, expected time: %04d-%02d-%02d %02d:%02d:%02d\n", 
-                        currentTime.year, currentTime.month, currentTime.day,
-                        currentTime.hour, currentTime.minute, currentTime.second,
-                        dt.year, dt.month, dt.day, dt.hour, dt.minute, dt.second);
-              }
-            } else {
-                debug_printf(LOG_ERROR, "Failed to read time from RTC during verification.\n");
-            }
-             
-            if(retry < maxRetries - 1) {
-              vTaskDelay(pdMS_TO_TICKS(retryDelayMs)); // Delay if retrying
-            }
-        }
-
-        xSemaphoreGive(dateTimeMutex); // Release the mutex
-        if(success) {
-           debug_printf(LOG_INFO, "Time successfully set to: %04d-%02d-%02d %02d:%02d:%02d\n",
-                          dt.year, dt.month, dt.day, dt.hour, dt.minute, dt.second);
-           return true;
-        } else {
-            debug_printf(LOG_ERROR, "Failed to set RTC time after maximum retries.\n");
-            return false;
-        }
-
-    } else {
-        debug_printf(LOG_ERROR, "Failed to take dateTimeMutex in updateGlobalDateTime");
-        return false;
+// Columnar JSON keeps the response small: {"ch":..,"resolution":..,"t":[..],"mean":[..],"min":[..],"max":[..]}
+void writeHistoryJson(Print &out, uint8_t ch, uint32_t resolution, const HistoryPoint *points, size_t count)
+{
+  static const char *const columns[] = {"t", "mean", "min", "max"};
+  out.print("{\"ch\":\"");
+  out.print(historyChannels[ch].name);
+  out.print("\",\"resolution\":");
+  out.print(resolution);
+  for (uint8_t c = 0; c < 4; c++) {
+    out.print(",\"");
+    out.print(columns[c]);
+    out.print("\":[");
+    for (size_t i = 0; i < count; i++) {
+      if (i > 0) out.print(',');
+      const HistoryPoint &p = points[i];
+      if (c == 0) out.print(p.time);
+      else out.print(c == 1 ? p.mean : (c == 2 ? p.min : p.max), 3);
     }
+    out.print(']');
+  }
+  out.print('}');
 }
-// Thread-safe printf-like function
-void debug_printf(uint8_t logLevel, const char* format, ...) {
-    // Create a buffer to store the output
-    static char buffer[DEBUG_PRINTF_BUFFER_SIZE];
-    
-    // Acquire the Mutex: Blocks until the Mutex becomes available.
-    if (xSemaphoreTake(serialMutex, portMAX_DELAY) == pdTRUE) {
-      
-        // Prepare the log level string.
-        const char* logLevelStr = (logLevel < sizeof(logType) / sizeof(logType[0])) ? logType[logLevel] : "UNKNOWN";
-      
-        // Format the string into the buffer.
-        va_list args;
-        va_start(args, format);
-        int len = snprintf(buffer, DEBUG_PRINTF_BUFFER_SIZE, "[%s] ", logLevelStr); // Add log level pretext to buffer.
-
-        if (len < DEBUG_PRINTF_BUFFER_SIZE) {
-          len += vsnprintf(buffer + len, DEBUG_PRINTF_BUFFER_SIZE - len, format, args);
-        } else {
-           len = DEBUG_PRINTF_BUFFER_SIZE; //Ensure we don't write past buffer
-        }
-
-        va_end(args);
-        
-        // Check for errors or truncation.
-        if(len > 0) {
-            Serial.print(buffer);
-        } else {
-            Serial.println("Error during debug_printf: formatting error or buffer overflow");
-        }
 
-        // Release the mutex
-        xSemaphoreGive(serialMutex);
-    } else {
-        // Error: Failed to acquire the Mutex. Print error message on the unprotected port
-        Serial.println("Error: Failed to acquire Serial Mutex for debug_printf!");
-    }
-}
+// ---------------------- Binary telemetry ---------------------- //
 
-// Thread-safe LED colour setter
-bool setLEDcolour(uint8_t led, uint32_t colour) {
-  if (led > 3) {
-    debug_printf(LOG_ERROR, "Invalid LED number: %d\n", led);
-    return false;
+// Minimal CBOR (RFC 8949) encoder, enough for JSON-like data
+class CborWriter
+{
+public:
+  CborWriter(Print &out) : _out(out) {}
+
+  void map(size_t size) { head(5, size); }
+  void array(size_t size) { head(4, size); }
+  void boolean(bool value) { _out.write((uint8_t)(value ? 0xF5 : 0xF4)); }
+  void null(void) { _out.write((uint8_t)0xF6); }
+  void text(const char *value)
+  {
+    size_t len = strlen(value);
+    head(3, len);
+    _out.write((const uint8_t *)value, len);
   }
-  if (xSemaphoreTake(statusMutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-    status.LEDcolour[led] = colour;
-    xSemaphoreGive(statusMutex);
-    return true;
+  void integer(int64_t value)
+  {
+    if (value < 0) head(1, (uint64_t)(-1 - value));
+    else head(0, (uint64_t)value);
   }
-  return false;
-}
-void osDebugPrint(void)
-{
-  const char *taskStateName[5] = {
-      "Ready",
-      "Blocked",
-      "Suspended",
-      "Deleted",
-      "Invalid"};
-  int numberOfTasks = uxTaskGetNumberOfTasks();
-
-  DateTime current;
-  if (getGlobalDateTime(current))
+  void number(float value)
   {
-    // Use the current time safely
-    debug_printf(LOG_INFO, "Time: %02d:%02d:%02d\n",
-                  current.hour, current.minute, current.second);
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint8_t buf[5] = {0xFA, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16), (uint8_t)(bits >> 8), (uint8_t)bits};
+    _out.write(buf, sizeof(buf));
   }
 
-  TaskStatus_t *pxTaskStatusArray = new TaskStatus_t[numberOfTasks];
-  uint32_t runtime;
-  numberOfTasks = uxTaskGetSystemState(pxTaskStatusArray, numberOfTasks, &runtime);
-  debug_printf(LOG_INFO, "Tasks: %d\n", numberOfTasks);
-  for (int i = 0; i < numberOfTasks; i++)
+private:
+  void head(uint8_t major, uint64_t value)
   {
-    debug_printf(LOG_INFO, "ID: %d %s", i, pxTaskStatusArray[i].pcTaskName);
-    int currentState = pxTaskStatusArray[i].eCurrentState;
-    debug_printf(LOG_INFO, " Current state: %s", taskStateName[currentState]);
-    debug_printf(LOG_INFO, " Priority: %u\n", pxTaskStatusArray[i].uxBasePriority);
-    debug_printf(LOG_INFO, " Free stack: %u\n", pxTaskStatusArray[i].usStackHighWaterMark);
-    debug_printf(LOG_INFO, " Runtime: %u\n", pxTaskStatusArray[i].ulRunTimeCounter);
+    uint8_t buf[9];
+    size_t len = 0;
+    uint8_t bytes = value < 24 ? 0 : value <= 0xFF ? 1 : value <= 0xFFFF ? 2 : value <= 0xFFFFFFFF ? 4 : 8;
+    static const uint8_t info[] = {0, 24, 25, 0, 26, 0, 0, 0, 27};
+    buf[len++] = (major << 5) | (bytes == 0 ? (uint8_t)value : info[bytes]);
+    for (int i = bytes - 1; i >= 0; i--) buf[len++] = (uint8_t)(value >> (8 * i));
+    _out.write(buf, len);
+  }
+
+  Print &_out;
+};
+
+// Encode a JSON document as CBOR, floats as single precision
+void writeCborValue(CborWriter &cbor, JsonVariantConst value)
+{
+  if (value.is<JsonObjectConst>()) {
+    JsonObjectConst object = value.as<JsonObjectConst>();
+    cbor.map(object.size());
+    for (JsonPairConst kv : object) {
+      cbor.text(kv.key().c_str());
+      writeCborValue(cbor, kv.value());
+    }
   }
-  delete[] pxTaskStatusArray;
+  else if (value.is<JsonArrayConst>()) {
+    JsonArrayConst array = value.as<JsonArrayConst>();
+    cbor.array(array.size());
+    for (JsonVariantConst element : array) writeCborValue(cbor, element);
+  }
+  else if (value.is<bool>()) cbor.boolean(value.as<bool>());
+  else if (value.is<long>()) cbor.integer(value.as<long>());
+  else if (value.is<float>()) cbor.number(value.as<float>());
+  else if (value.is<const char *>()) cbor.text(value.as<const char *>());
+  else cbor.null();
 }
 
-void setup() // Eth interface (keep RTOS tasks out of core 0)
+void writeHistoryCbor(Print &out, uint8_t ch, uint32_t resolution, const HistoryPoint *points, size_t count)
 {
-  Serial.begin(115200);
-  while (!Serial)
-    ;
+  CborWriter cbor(out);
+  cbor.map(6);
+  cbor.text("ch");
+  cbor.text(historyChannels[ch].name);
+  cbor.text("resolution");
+  cbor.integer(resolution);
+  cbor.text("t");
+  cbor.array(count);
+  for (size_t i = 0; i < count; i++) cbor.integer(points[i].time);
+  cbor.text("mean");
+  cbor.array(count);
+  for (size_t i = 0; i < count; i++) cbor.number(points[i].mean);
+  cbor.text("min");
+  cbor.array(count);
+  for (size_t i = 0; i < count; i++) cbor.number(points[i].min);
+  cbor.text("max");
+  cbor.array(count);
+  for (size_t i = 0; i < count; i++) cbor.number(points[i].max);
+}
 
-  Serial.println("[INFO] Core 0 setup started");
+void writeTelemetryHeader(Print &out, uint8_t type, uint32_t length)
+{
+  TelemetryHeader header = {{'O', 'R'}, TELEMETRY_VERSION, type, length};
+  out.write((const uint8_t *)&header, sizeof(header));
+}
+
+void packTelemetryState(const ProcessImage &image, TelemetryState &state)
+{
+  const ReactorSensors &s = image.sensors;
+  const ReactorControls &c = image.controls;
+  state.version = image.version;
+  state.time = dateTimeToEpoch(image.time);
+  state.power = {s.power.volts, s.power.amps, s.power.watts, s.power.online};
+  state.temperature = {s.temperature.celcius, s.temperature.online};
+  state.ph = {s.ph.pH, s.ph.online};
+  state.dissolvedOxygen = {s.dissolvedOxygen.oxygen, s.dissolvedOxygen.online};
+  state.opticalDensity = {s.opticalDensity.OD, s.opticalDensity.online};
+  state.gasFlow = {s.gasFlow.mlPerMinute, s.gasFlow.online};
+  state.pressure = {s.pressure.kPa, s.pressure.online};
+  state.stirrerSpeed = {s.stirrerSpeed.rpm, s.stirrerSpeed.online};
+  state.weight = {s.weight.grams, s.weight.online};
+  state.temperatureControl = {c.temperature.sp_celcius, c.temperature.enabled, c.temperature.kp, c.temperature.ki, c.temperature.kd};
+  state.phControl = {c.ph.sp_pH, c.ph.enabled, c.ph.period, c.ph.max_dose_time};
+  state.dissolvedOxygenControl = {c.dissolvedOxygen.sp_oxygen, c.dissolvedOxygen.enabled};
+  state.gasFlowControl = {c.gasFlow.sp_mlPerMinute, c.gasFlow.enabled, c.gasFlow.kp, c.gasFlow.ki, c.gasFlow.kd};
+  state.stirrerSpeedControl = {c.stirrerSpeed.sp_rpm, c.stirrerSpeed.enabled, c.stirrerSpeed.kp, c.stirrerSpeed.ki, c.stirrerSpeed.kd};
+  state.pumpSpeed = c.pumpSpeed.percent;
+  state.feedControl = {c.feed.period, c.feed.duty, c.feed.enabled};
+  state.wasteControl = {c.waste.period, c.waste.duty, c.waste.enabled};
+  state.Vpsu = image.power.Vpsu;
+  state.V20 = image.power.V20;
+  state.V5 = image.power.V5;
+  state.powerOK = (image.power.psuOK ? 1 : 0) | (image.power.V20OK ? 2 : 0) | (image.power.V5OK ? 4 : 0);
+  state.connected = image.link.connected;
+  memcpy(state.ip, image.link.ip, sizeof(state.ip));
+}
 
-  // Create serial debug mutex
-  serialMutex = xSemaphoreCreateMutex();
-  if (serialMutex == NULL) {
-    Serial.println("[ERROR] Failed to create serial mutex");
+enum TelemetryFormat { TELEMETRY_NONE, TELEMETRY_PACKED, TELEMETRY_CBOR };
+
+// Pick a format from an Accept header: whichever of the two is listed
+// first, packed structs for */* or no header
+TelemetryFormat negotiateTelemetryFormat(const char *accept)
+{
+  if (accept[0] == '\0') return TELEMETRY_PACKED;
+  const char *packed = strstr(accept, TELEMETRY_MIME_PACKED);
+  const char *cbor = strstr(accept, TELEMETRY_MIME_CBOR);
+  if (cbor != nullptr && (packed == nullptr || cbor < packed)) return TELEMETRY_CBOR;
+  if (packed != nullptr || strstr(accept, "application/octet-stream") != nullptr || strstr(accept, "*/*") != nullptr) {
+    return TELEMETRY_PACKED;
   }
-  else serialReady = true;
+  return TELEMETRY_NONE;
+}
 
-  // Initialize hardware
-  setupEthernet();
-  setupWebServer();
-  setupNetworkAPI();
-  setupMqttAPI();
-  setupTimeAPI();
-  setupIPC();
+// ---------------------- Metrics ---------------------- //
+// Metrics updated where things happen are declared in sys_init.h. These
+// collectors add the ones that are read out at scrape time.
 
-  debug_printf(LOG_INFO, "Core 0 setup complete\n");
-  core0setupComplete = true;
-  while (!core1setupComplete) delay(100);
-  if (networkConfig.ntpEnabled) handleNTPUpdates(true);
-  debug_printf(LOG_INFO, "<---System initialisation complete --->\n\n");
+// Frame counters of the link to the I/O controller
+void writeIPCMetrics(Print &out)
+{
+  const IPCStats &stats = ipc.stats();
+  out.print("# HELP orc_ipc_frames_total IPC frames by direction and outcome\n"
+            "# TYPE orc_ipc_frames_total counter\n");
+  out.printf("orc_ipc_frames_total{direction=\"tx\",result=\"ok\"} %lu\n", (unsigned long)stats.framesSent);
+  out.printf("orc_ipc_frames_total{direction=\"rx\",result=\"ok\"} %lu\n", (unsigned long)stats.framesReceived);
+  out.printf("orc_ipc_frames_total{direction=\"rx\",result=\"crc_error\"} %lu\n", (unsigned long)stats.crcErrors);
+  out.printf("orc_ipc_frames_total{direction=\"rx\",result=\"oversized\"} %lu\n", (unsigned long)stats.oversized);
+  out.printf("orc_ipc_frames_total{direction=\"rx\",result=\"unhandled\"} %lu\n", (unsigned long)stats.unhandled);
 }
 
-void loop()
+// Lowest free stack each task has had since it started
+void writeTaskMetrics(Print &out)
 {
-  // Do network tasks if ethernet is connected
-  if (ethernetConnected) {
-    if (eth.linkStatus() == LinkOFF) {
-      ethernetConnected = false;
-      setLEDcolour(LED_WEBSERVER_STATUS, LED_STATUS_OFF);
-      setLEDcolour(LED_MQTT_STATUS, LED_STATUS_OFF);
-      debug_printf(LOG_INFO, "Ethernet disconnected, waiting for reconnect\n");
-    }
-    else {
-      handleWebServer();
-      handleNTPUpdates(false);  // Process any pending NTP updates
-    }
+  static TaskProfileSet profile;
+  taskProfiler.read(profile);
+  out.print("# HELP orc_task_stack_free_bytes Lowest free stack space since the task started\n"
+            "# TYPE orc_task_stack_free_bytes gauge\n");
+  for (uint8_t i = 0; i < profile.numTasks; i++) {
+    out.printf("orc_task_stack_free_bytes{task=\"%s\"} %u\n", profile.tasks[i].name,
+               (unsigned)profile.tasks[i].stackFree);
   }
-  else if (eth.linkStatus() == LinkON) {
-    ethernetConnected = true;
-    if(!applyNetworkConfig()) {
-      debug_printf(LOG_ERROR, "Failed to apply network configuration!\n");
-    }
-    else {
-      debug_printf(LOG_INFO, "Ethernet re-connected, IP address: %s, Gateway: %s\n",
-                eth.localIP().toString().c_str(),
-                eth.gatewayIP().toString().c_str());
-    }
+  if (profile.interval == 0) return;  // No CPU figures until the second sample
+  out.print("# HELP orc_task_cpu_percent CPU time used over the last profiler interval, percent of a core\n"
+            "# TYPE orc_task_cpu_percent gauge\n");
+  for (uint8_t i = 0; i < profile.numTasks; i++) {
+    out.printf("orc_task_cpu_percent{task=\"%s\"} %g\n", profile.tasks[i].name, profile.tasks[i].cpu / 100.0);
+  }
+  out.print("# HELP orc_core_cpu_percent Time not spent idle over the last profiler interval\n"
+            "# TYPE orc_core_cpu_percent gauge\n");
+  for (uint8_t c = 0; c < TASK_PROFILER_NUM_CORES; c++) {
+    out.printf("orc_core_cpu_percent{core=\"%u\"} %g\n", c, profile.cores[c].cpu / 100.0);
+  }
+  out.print("# HELP orc_context_switches_per_second Tasks switched in over the last profiler interval\n"
+            "# TYPE orc_context_switches_per_second gauge\n");
+  for (uint8_t c = 0; c < TASK_PROFILER_NUM_CORES; c++) {
+    out.printf("orc_context_switches_per_second{core=\"%u\"} %u\n", c, (unsigned)profile.cores[c].switches);
   }
-  ipc.update();
 }
 
-void setup1()
+void writeDeadlineMetrics(Print &out)
 {
-  while (!serialReady) delay(100);
-  debug_printf(LOG_INFO, "Core 1 setup started\n");
-
-  // Create synchronization primitives
-  dateTimeMutex = xSemaphoreCreateMutex();
-  if (dateTimeMutex == NULL) {
-    debug_printf(LOG_ERROR, "Failed to create dateTimeMutex!\n");
-    while (1);
+  DeadlineStats stats;
+  out.print("# HELP orc_task_passes_total Passes of the periodic tasks' loops\n"
+            "# TYPE orc_task_passes_total counter\n");
+  for (uint8_t task = 0; task < NUM_TASKS; task++) {
+    if (!deadlineMonitor.stats(task, stats)) continue;
+    out.printf("orc_task_passes_total{task=\"%s\"} %u\n", stats.name, (unsigned)stats.passes);
   }
-  statusMutex = xSemaphoreCreateMutex();
-  if (statusMutex == NULL) {
-    debug_printf(LOG_ERROR, "Failed to create statusMutex!\n");
-    while (1);
+  out.print("# HELP orc_task_deadline_missed_total Passes started late or run over budget\n"
+            "# TYPE orc_task_deadline_missed_total counter\n");
+  for (uint8_t task = 0; task < NUM_TASKS; task++) {
+    if (!deadlineMonitor.stats(task, stats)) continue;
+    out.printf("orc_task_deadline_missed_total{task=\"%s\",kind=\"late\"} %u\n", stats.name, (unsigned)stats.late);
+    out.printf("orc_task_deadline_missed_total{task=\"%s\",kind=\"overrun\"} %u\n", stats.name, (unsigned)stats.overruns);
+  }
+  out.print("# HELP orc_task_execution_max_seconds Longest pass since boot\n"
+            "# TYPE orc_task_execution_max_seconds gauge\n");
+  for (uint8_t task = 0; task < NUM_TASKS; task++) {
+    if (!deadlineMonitor.stats(task, stats)) continue;
+    out.printf("orc_task_execution_max_seconds{task=\"%s\"} %g\n", stats.name, stats.maxExecution * 1e-6);
+  }
+  out.print("# HELP orc_task_lateness_max_seconds Latest start of a pass after it was due, since boot\n"
+            "# TYPE orc_task_lateness_max_seconds gauge\n");
+  for (uint8_t task = 0; task < NUM_TASKS; task++) {
+    if (!deadlineMonitor.stats(task, stats)) continue;
+    out.printf("orc_task_lateness_max_seconds{task=\"%s\"} %g\n", stats.name, stats.maxLateness * 1e-6);
+  }
+  out.print("# HELP orc_task_stalled 1 while the task is overdue by more than its period and budget\n"
+            "# TYPE orc_task_stalled gauge\n");
+  for (uint8_t task = 0; task < NUM_TASKS; task++) {
+    if (!deadlineMonitor.stats(task, stats)) continue;
+    out.printf("orc_task_stalled{task=\"%s\"} %u\n", stats.name, stats.stalled ? 1u : 0u);
   }
-
-   // Set System Status
-  setLEDcolour(LED_SYSTEM_STATUS, LED_STATUS_STARTUP);
-  // Initialize Core 1 tasks
-  xTaskCreate(statusLEDs, "LED stat", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-  xTaskCreate(manageRTC, "RTC updt", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-  xTaskCreate(manageTerminal, "Term updt", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-  xTaskCreate(managePower, "Pwr updt", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-
-  // Modbus not yet implemented
-  setLEDcolour(LED_MODBUS_STATUS, LED_STATUS_OFF);
-  // MQTT not yet implemented
-  setLEDcolour(LED_MQTT_STATUS, LED_STATUS_OFF); 
-
-  debug_printf(LOG_INFO, "Core 1 setup complete\n");
-  core1setupComplete = true;
-  while (!core0setupComplete) delay(100);
 }
 
-void loop1() {
-  delay(100);
+// SD card logger throughput and losses
+// A LogLatency as the samples of a Prometheus histogram, in seconds
+void writeLogLatency(Print &out, const char *op, const LogLatency &latency)
+{
+  uint32_t cumulative = 0;
+  for (uint8_t b = 0; b <= LOG_LATENCY_BUCKETS; b++) {
+    cumulative += latency.counts[b];
+    if (b < LOG_LATENCY_BUCKETS) {
+      out.printf("orc_log_write_duration_seconds_bucket{op=\"%s\",le=\"%g\"} %lu\n",
+                 op, DataLogger::latencyBounds[b] * 1e-6, (unsigned long)cumulative);
+    }
+    else out.printf("orc_log_write_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %lu\n", op, (unsigned long)cumulative);
+  }
+  out.printf("orc_log_write_duration_seconds_sum{op=\"%s\"} %g\n"
+             "orc_log_write_duration_seconds_count{op=\"%s\"} %lu\n",
+             op, latency.sumUs * 1e-6, op, (unsigned long)cumulative);
 }
 
-// ---------------------- Core 0 tasks ---------------------- //
+void writeDebugLogMetrics(Print &out)
+{
+  DebugLogStats stats = debugLog.stats();
+  out.printf("# HELP orc_debug_lines_total Debug output lines\n"
+             "# TYPE orc_debug_lines_total counter\n"
+             "orc_debug_lines_total{result=\"queued\"} %lu\n"
+             "orc_debug_lines_total{result=\"dropped\"} %lu\n",
+             (unsigned long)stats.lines, (unsigned long)stats.dropped);
+  out.printf("# HELP orc_debug_queue_peak_bytes Most debug output queued on one core at once\n"
+             "# TYPE orc_debug_queue_peak_bytes gauge\n"
+             "orc_debug_queue_peak_bytes %lu\n",
+             (unsigned long)stats.maxUsed);
+}
 
+void writeLoggerMetrics(Print &out)
+{
+  const DataLoggerStats &stats = dataLogger.stats();
+  out.printf("# HELP orc_log_samples_total Samples offered to the SD card logger\n"
+             "# TYPE orc_log_samples_total counter\n"
+             "orc_log_samples_total{result=\"queued\"} %lu\n"
+             "orc_log_samples_total{result=\"dropped\"} %lu\n",
+             (unsigned long)stats.samples, (unsigned long)stats.dropped);
+  out.printf("# HELP orc_log_blocks_written_total Blocks written to the SD card\n"
+             "# TYPE orc_log_blocks_written_total counter\n"
+             "orc_log_blocks_written_total %lu\n",
+             (unsigned long)stats.blocksWritten);
+  out.printf("# HELP orc_log_write_errors_total Failed SD card writes\n"
+             "# TYPE orc_log_write_errors_total counter\n"
+             "orc_log_write_errors_total %lu\n",
+             (unsigned long)stats.writeErrors);
+  out.printf("# HELP orc_log_queued_samples Samples waiting to be written to the SD card\n"
+             "# TYPE orc_log_queued_samples gauge\n"
+             "orc_log_queued_samples %u\n",
+             (unsigned)dataLogger.queued());
+  out.printf("# HELP orc_log_write_duration_seconds SD card operations of the logger\n"
+             "# TYPE orc_log_write_duration_seconds histogram\n");
+  writeLogLatency(out, "data", stats.dataWrites);
+  writeLogLatency(out, "file", stats.fileUpdates);
+  out.printf("# HELP orc_log_write_max_seconds Slowest SD card operation of the logger since boot\n"
+             "# TYPE orc_log_write_max_seconds gauge\n"
+             "orc_log_write_max_seconds{op=\"data\"} %g\n"
+             "orc_log_write_max_seconds{op=\"file\"} %g\n",
+             stats.dataWrites.maxUs * 1e-6, stats.fileUpdates.maxUs * 1e-6);
+}
 
+// ---------------------- API routes ---------------------- //
+// Read-only API routes, served by the WebServer on port 80 and on persistent
+// connections on the live port. A handler fills in an ApiResponse whose body
+// is written twice, once to measure it for Content-Length and once to send it,
+// unless it is streamed, for bodies that change between the two passes.
 
-// ---------------------- Core 1 tasks ---------------------- //
-void statusLEDs(void *param)
+// URL decode the query value from start to end into value, false if it
+// doesn't fit or has a malformed %XX
+bool decodeQueryValue(const char *start, const char *end, char *value, size_t size)
 {
-  (void)param;
-
-  uint32_t loopCounter = 0;
-  uint32_t ledRefreshInterval = 20;
-  uint32_t loopCountsPerHalfSec = 500 / ledRefreshInterval;
-  bool blinkState = false;
+  size_t len = 0;
+  for (const char *p = start; p < end; p++) {
+    if (len + 1 >= size) return false;
+    char c = *p;
+    if (c == '+') c = ' ';
+    else if (c == '%') {
+      if (end - p < 3 || !isxdigit((unsigned char)p[1]) || !isxdigit((unsigned char)p[2])) return false;
+      char hex[3] = {p[1], p[2], '\0'};
+      c = (char)strtoul(hex, NULL, 16);
+      p += 2;
+    }
+    value[len++] = c;
+  }
+  value[len] = '\0';
+  return true;
+}
 
-  leds.begin();
-  leds.setBrightness(50);
-  leds.fill(LED_COLOR_OFF, 0, 4);
-  leds.show();
-  debug_printf(LOG_INFO, "LED status task started\n");
+struct ApiRequest
+{
+  const char *query;       // Raw query string on the live port, nullptr for the WebServer
+  TelemetryFormat format;  // Negotiated from the Accept header
+  mutable bool badArg;     // An argument didn't fit or wasn't valid URL encoding, answered with a 400
 
-  // Task loop
-  while (1) {
-    uint32_t statusLEDcolour = STATUS_WARNING;
-    if (xSemaphoreTake(statusMutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-      for (int i = 0; i < 3; i++) {
-        leds.setPixelColor(i, status.LEDcolour[i]);
+  // Look up a query argument, decoded as the WebServer does (%XX and +).
+  // False if it is missing, or if it doesn't fit in size, which also sets badArg.
+  bool arg(const char *name, char *value, size_t size) const
+  {
+    if (query == nullptr) {
+      if (!server.hasArg(name)) return false;
+      const String &s = server.arg(name);
+      if (s.length() >= size) {
+        badArg = true;
+        return false;
       }
-      statusLEDcolour = status.LEDcolour[3];
-      xSemaphoreGive(statusMutex);
+      memcpy(value, s.c_str(), s.length() + 1);
+      return true;
     }
-    leds.show();
-    vTaskDelay(pdMS_TO_TICKS(ledRefreshInterval));
-    loopCounter++;
-    // Things to do every half second
-    if (loopCounter >= loopCountsPerHalfSec) {
-      loopCounter = 0;
-      blinkState = !blinkState;
-
-      if (blinkState) {
-        leds.setPixelColor(LED_SYSTEM_STATUS, statusLEDcolour);
-        leds.show();
-      } else {
-        leds.setPixelColor(LED_SYSTEM_STATUS, LED_COLOR_OFF);
-        leds.show();
+    size_t nameLen = strlen(name);
+    const char *p = query;
+    while (*p) {
+      const char *end = strchr(p, '&');
+      if (end == nullptr) end = p + strlen(p);
+      if (strncmp(p, name, nameLen) == 0 && p[nameLen] == '=') {
+        if (decodeQueryValue(p + nameLen + 1, end, value, size)) return true;
+        badArg = true;
+        return false;
       }
+      p = (*end == '&') ? end + 1 : end;
     }
+    return false;
   }
-}
+};
 
-void manageRTC(void *param)
+struct ApiResponse
 {
-  (void)param;
-  Wire1.setSDA(PIN_RTC_SDA);
-  Wire1.setSCL(PIN_RTC_SCL);
+  int code;
+  const char *contentType;
+  std::function<void(Print &)> body;
+  bool streamed;  // Sent once with chunked encoding rather than with a Content-Length
+};
 
-  if (!rtc.begin())
-  {
-    debug_printf(LOG_ERROR, "RTC initialization failed!\n");
-    return;
-  }
+typedef void (*ApiHandler)(const ApiRequest &req, ApiResponse &res);
 
-  // Set initial time (24-hour format)
+void apiError(ApiResponse &res, int code, const char *message)
+{
+  res.code = code;
+  res.contentType = "application/json";
+  res.streamed = false;
+  res.body = [message](Print &out) {
+    out.print("{\"error\":\"");
+    out.print(message);
+    out.print("\"}");
+  };
+}
+
+// Process image selected with ?fields=sensors,power,... as a JSON document
+JsonDocument *buildStateDocument(const ApiRequest &req, ApiResponse &res)
+{
+  static StaticJsonDocument<2048> doc;
+  char list[64] = "";
+  req.arg("fields", list, sizeof(list));
+  uint8_t fields;
+  if (!parseImageFields(list, fields)) {
+    apiError(res, 400, "Invalid fields");
+    return nullptr;
+  }
+  ProcessImage image;
+  getProcessImage(image);
+  doc.clear();
+  serializeProcessImage(doc.to<JsonObject>(), image, fields);
+  return &doc;
+}
+
+struct HistoryResult
+{
+  uint8_t ch;
+  uint32_t resolution;
+  size_t count;
+  HistoryPoint points[HISTORY_MAX_POINTS];
+};
+
+// Run the history query described by the request arguments:
+// ch, from/to (RTC local time in seconds, default the last day), points
+const HistoryResult *runHistoryQuery(const ApiRequest &req, ApiResponse &res)
+{
+  static HistoryResult result;
+  char arg[24];
+  int8_t ch = req.arg("ch", arg, sizeof(arg)) ? findHistoryChannel(arg) : -1;
+  if (ch < 0) {
+    apiError(res, 400, "Unknown channel");
+    return nullptr;
+  }
+
+  uint32_t to = UINT32_MAX;
+  DateTime now;
+  if (req.arg("to", arg, sizeof(arg))) to = strtoul(arg, NULL, 10);
+  else if (getGlobalDateTime(now)) to = dateTimeToEpoch(now);
+  uint32_t from = 0;
+  if (req.arg("from", arg, sizeof(arg))) from = strtoul(arg, NULL, 10);
+  else if (to != UINT32_MAX && to > HISTORY_DEFAULT_SPAN) from = to - HISTORY_DEFAULT_SPAN;
+  long points = req.arg("points", arg, sizeof(arg)) ? strtol(arg, NULL, 10) : HISTORY_DEFAULT_POINTS;
+  if (points < 2 || points > HISTORY_MAX_POINTS || to < from) {
+    apiError(res, 400, "Invalid range");
+    return nullptr;
+  }
+
+  if (xSemaphoreTake(historyMutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+    apiError(res, 503, "History busy");
+    return nullptr;
+  }
+  result.ch = ch;
+  result.resolution = 0;
+  result.count = sensorHistory[ch].query(from, to, result.points, points, &result.resolution);
+  xSemaphoreGive(historyMutex);
+  return &result;
+}
+
+// Consistent snapshot of all reactor state, optionally limited with ?fields=sensors,power,...
+void apiState(const ApiRequest &req, ApiResponse &res)
+{
+  JsonDocument *doc = buildStateDocument(req, res);
+  if (doc == nullptr) return;
+  res.body = [doc](Print &out) { serializeJson(*doc, out); };
+}
+
+// Downsampled history of one channel, sized for the chart:
+// /api/history?ch=temperature&from=<epoch s>&to=<epoch s>&points=<n>
+void apiHistory(const ApiRequest &req, ApiResponse &res)
+{
+  const HistoryResult *result = runHistoryQuery(req, res);
+  if (result == nullptr) return;
+  res.body = [result](Print &out) {
+    writeHistoryJson(out, result->ch, result->resolution, result->points, result->count);
+  };
+}
+
+// Binary equivalents of /api/state and /api/history for high rate clients.
+// Accept: application/vnd.orc.telemetry gives packed little-endian records
+// (TelemetryHeader + TelemetryState/TelemetryHistory), application/cbor
+// gives the same content as the JSON endpoints.
+void apiBinState(const ApiRequest &req, ApiResponse &res)
+{
+  if (req.format == TELEMETRY_NONE) {
+    apiError(res, 406, "Not acceptable");
+    return;
+  }
+  if (req.format == TELEMETRY_PACKED) {
+    static TelemetryState state;
+    ProcessImage image;
+    getProcessImage(image);
+    packTelemetryState(image, state);
+    res.contentType = TELEMETRY_MIME_PACKED;
+    res.body = [](Print &out) {
+      writeTelemetryHeader(out, TELEMETRY_STATE, sizeof(state));
+      out.write((const uint8_t *)&state, sizeof(state));
+    };
+    return;
+  }
+  JsonDocument *doc = buildStateDocument(req, res);
+  if (doc == nullptr) return;
+  res.contentType = TELEMETRY_MIME_CBOR;
+  res.body = [doc](Print &out) {
+    CborWriter cbor(out);
+    writeCborValue(cbor, doc->as<JsonVariantConst>());
+  };
+}
+
+void apiBinHistory(const ApiRequest &req, ApiResponse &res)
+{
+  if (req.format == TELEMETRY_NONE) {
+    apiError(res, 406, "Not acceptable");
+    return;
+  }
+  const HistoryResult *result = runHistoryQuery(req, res);
+  if (result == nullptr) return;
+  if (req.format == TELEMETRY_PACKED) {
+    res.contentType = TELEMETRY_MIME_PACKED;
+    res.body = [result](Print &out) {
+      TelemetryHistory history = {result->ch, result->resolution, (uint16_t)result->count};
+      writeTelemetryHeader(out, TELEMETRY_HISTORY, sizeof(history) + result->count * sizeof(HistoryPoint));
+      out.write((const uint8_t *)&history, sizeof(history));
+      out.write((const uint8_t *)result->points, result->count * sizeof(HistoryPoint));
+    };
+  }
+  else {
+    res.contentType = TELEMETRY_MIME_CBOR;
+    res.body = [result](Print &out) {
+      writeHistoryCbor(out, result->ch, result->resolution, result->points, result->count);
+    };
+  }
+}
+
+// CSV of logged samples read straight from the SD card, streamed as it is read:
+// /api/log/export?ch=temperature&from=<epoch s>&to=<epoch s> (all channels without ch)
+// A response holds about LOG_EXPORT_MAX_ROWS rows, so one export can't hold
+// up the other connections of the HTTP task. When the range has more, it
+// stops at a whole second and ends with "# more from=<epoch s>", the from of
+// the request that carries on.
+void apiLogExport(const ApiRequest &req, ApiResponse &res)
+{
+  static LogReader reader(dataLogger);
+  char arg[24], channel[LOG_CHANNEL_NAME_SIZE] = "";
+  if (req.arg("ch", channel, sizeof(channel)) && findHistoryChannel(channel) < 0) {
+    apiError(res, 400, "Unknown channel");
+    return;
+  }
+
+  uint32_t to = UINT32_MAX;
+  DateTime now;
+  if (req.arg("to", arg, sizeof(arg))) to = strtoul(arg, NULL, 10);
+  else if (getGlobalDateTime(now)) to = dateTimeToEpoch(now);
+  uint32_t from = 0;
+  if (req.arg("from", arg, sizeof(arg))) from = strtoul(arg, NULL, 10);
+  else if (to != UINT32_MAX && to > LOG_EXPORT_DEFAULT_SPAN) from = to - LOG_EXPORT_DEFAULT_SPAN;
+  if (to < from) {
+    apiError(res, 400, "Invalid range");
+    return;
+  }
+
+  if (!reader.begin(from, to, channel[0] ? channel : nullptr)) {
+    apiError(res, 503, "SD card not available");
+    return;
+  }
+  res.contentType = "text/csv";
+  res.streamed = true;
+  res.body = [](Print &out) {
+    out.print("time,channel,value\n");
+    LogRecord record;
+    char line[64];
+    uint32_t rows = 0, lastTime = 0;
+    while (reader.next(record)) {
+      if (rows >= LOG_EXPORT_MAX_ROWS && record.time != lastTime) {
+        snprintf(line, sizeof(line), "# more from=%lu\n", (unsigned long)record.time);
+        out.print(line);
+        break;
+      }
+      rows++;
+      lastTime = record.time;
+      DateTime dt = epochToDateTime(record.time);
+      snprintf(line, sizeof(line), "%04d-%02d-%02dT%02d:%02d:%02d,%s,%g\n",
+               dt.year, dt.month, dt.day, dt.hour, dt.minute, dt.second,
+               reader.channelName(record.channel), (double)record.value);
+      out.print(line);
+    }
+    reader.end();
+  };
+}
+
+// JSON string with the characters JSON requires escaped
+void writeJsonString(Print &out, const char *s)
+{
+  out.print('"');
+  for (; *s; s++) {
+    char c = *s;
+    if (c == '"' || c == '\\') {
+      out.print('\\');
+      out.print(c);
+    }
+    else if (c == '\n') out.print("\\n");
+    else if ((uint8_t)c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out.print(escaped);
+    }
+    else out.print(c);
+  }
+  out.print('"');
+}
+
+// Recent debug output, newer than a cursor: /api/logs?since=<cursor>&level=warning
+// Answers {"entries":[{"seq":..,"time":<epoch ms>,"level":..,"text":..}],"first":..,"next":..,"missed":..};
+// pass next as since to get only the lines added after these. level is the
+// least severe level returned (debug, info, warning, error), default debug.
+void apiLogs(const ApiRequest &req, ApiResponse &res)
+{
+  static uint32_t since, levels, missed;
+  static uint64_t epochMs, uptimeUs;
+  char arg[16];
+  levels = 0xFFFFFFFF;
+  if (req.arg("level", arg, sizeof(arg))) {
+    int8_t level = -1;
+    for (uint8_t i = 0; i < sizeof(logType) / sizeof(logType[0]); i++) {
+      if (strcasecmp(arg, logType[i]) == 0) level = i;
+    }
+    if (level < 0) {
+      apiError(res, 400, "Unknown level");
+      return;
+    }
+    levels = 0;
+    for (uint8_t i = 0; i < sizeof(logType) / sizeof(logType[0]); i++) {
+      if (logSeverity[i] >= logSeverity[level]) levels |= 1u << i;
+    }
+  }
+
+  // A cursor past the end is from before a reboot, start over
+  uint32_t first = debugLog.historyFirst(), next = debugLog.historyNext();
+  since = req.arg("since", arg, sizeof(arg)) ? strtoul(arg, NULL, 10) : first;
+  if ((int32_t)(since - next) > 0) since = first;
+  missed = (int32_t)(first - since) > 0 ? first - since : 0;
+
+  // Line times are µs since boot, shifted to RTC time for the client (or
+  // left as ms since boot without the RTC)
+  uptimeUs = SystemClock::uptime();
+  epochMs = systemClock.valid() ? systemClock.at(uptimeUs) / 1000 : uptimeUs / 1000;
+
+  res.streamed = true;
+  res.body = [](Print &out) {
+    static DebugLogEntry entry;
+    char number[24];
+    uint32_t cursor = since;
+    bool firstEntry = true;
+    out.print("{\"entries\":[");
+    while (debugLog.readHistory(cursor, levels, entry)) {
+      size_t len = strlen(entry.text);
+      while (len > 0 && entry.text[len - 1] == '\n') entry.text[--len] = '\0';
+      out.print(firstEntry ? "{\"seq\":" : ",{\"seq\":");
+      out.print(entry.seq);
+      snprintf(number, sizeof(number), "%llu", (unsigned long long)(epochMs - (uptimeUs - entry.time) / 1000));
+      out.print(",\"time\":");
+      out.print(number);
+      out.print(",\"level\":\"");
+      out.print(entry.level < sizeof(logType) / sizeof(logType[0]) ? logType[entry.level] : "UNKNOWN");
+      out.print("\",\"text\":");
+      writeJsonString(out, entry.text);
+      out.print('}');
+      firstEntry = false;
+    }
+    out.print("],\"first\":");
+    out.print(debugLog.historyFirst());
+    out.print(",\"next\":");
+    out.print(cursor);
+    out.print(",\"missed\":");
+    out.print(missed);
+    out.print('}');
+  };
+}
+
+// Task CPU use and stack headroom from the profiler: /api/tasks
+// Answers {"interval":<ms>,"cores":[{"cpu":<%>,"switches":<per s>}],
+// "tasks":[{"name":..,"core":<0, 1 or null>,"priority":..,"state":..,"cpu":<% of a core>,
+// "stackFree":<bytes>,"stackDrop":<bytes>}]}. CPU figures are over the last
+// profiler interval; stackDrop is how far stackFree fell over the last minute.
+void apiTasks(const ApiRequest &req, ApiResponse &res)
+{
+  (void)req;
+  static TaskProfileSet profile;
+  taskProfiler.read(profile);
+  res.body = [](Print &out) {
+    out.printf("{\"interval\":%u,\"cores\":[", (unsigned)(profile.interval * portTICK_PERIOD_MS));
+    for (uint8_t c = 0; c < TASK_PROFILER_NUM_CORES; c++) {
+      out.printf("%s{\"cpu\":%.2f,\"switches\":%u}", c ? "," : "", profile.cores[c].cpu / 100.0,
+                 (unsigned)profile.cores[c].switches);
+    }
+    out.print("],\"tasks\":[");
+    for (uint8_t i = 0; i < profile.numTasks; i++) {
+      const TaskProfile &task = profile.tasks[i];
+      out.print(i ? ",{\"name\":" : "{\"name\":");
+      writeJsonString(out, task.name);
+      if (task.core < 0) out.print(",\"core\":null");
+      else out.printf(",\"core\":%d", task.core);
+      out.printf(",\"priority\":%u,\"state\":\"%s\",\"cpu\":%.2f,\"stackFree\":%u,\"stackDrop\":%u}",
+                 task.priority, taskStateName(task.state), task.cpu / 100.0,
+                 (unsigned)task.stackFree, (unsigned)task.stackDrop);
+    }
+    out.print("]}");
+  };
+}
+
+// Pass deadlines of the periodic tasks: /api/deadlines
+// Answers {"latenessBounds":[<ms>],"tasks":[{"name":..,"period":<ms>,"budget":<ms>,
+// "critical":..,"stalled":..,"failed":..,"passes":..,"late":..,"overruns":..,
+// "maxLateness":<ms>,"maxExecution":<ms>,"lateness":[..]}]}. lateness counts
+// passes started on time, then up to each bound, then later; the counts
+// and maxima are since boot.
+void apiDeadlines(const ApiRequest &req, ApiResponse &res)
+{
+  (void)req;
+  static DeadlineStats deadlines[NUM_TASKS];
+  static uint8_t count;
+  count = 0;
+  for (uint8_t task = 0; task < NUM_TASKS; task++) {
+    if (deadlineMonitor.stats(task, deadlines[count])) count++;
+  }
+  res.body = [](Print &out) {
+    out.print("{\"latenessBounds\":[0");
+    for (uint8_t b = 0; b < DEADLINE_BUCKETS - 2; b++) out.printf(",%g", deadlineBucketBounds[b] / 1000.0);
+    out.print("],\"tasks\":[");
+    for (uint8_t i = 0; i < count; i++) {
+      const DeadlineStats &task = deadlines[i];
+      out.print(i ? ",{\"name\":" : "{\"name\":");
+      writeJsonString(out, task.name);
+      out.printf(",\"period\":%u,\"budget\":%u,\"critical\":%s,\"stalled\":%s,\"failed\":%s,\"passes\":%u,"
+                 "\"late\":%u,\"overruns\":%u,\"maxLateness\":%.3f,\"maxExecution\":%.3f,\"lateness\":[",
+                 (unsigned)(task.period / 1000), (unsigned)(task.budget / 1000),
+                 task.critical ? "true" : "false", task.stalled ? "true" : "false", task.failed ? "true" : "false",
+                 (unsigned)task.passes, (unsigned)task.late, (unsigned)task.overruns,
+                 task.maxLateness / 1000.0, task.maxExecution / 1000.0);
+      for (uint8_t b = 0; b < DEADLINE_BUCKETS; b++) out.printf("%s%u", b ? "," : "", (unsigned)task.lateness[b]);
+      out.print("]}");
+    }
+    out.print("]}");
+  };
+}
+
+// Prometheus metrics. Values move while the body is written, so it is streamed.
+void apiMetrics(const ApiRequest &req, ApiResponse &res)
+{
+  (void)req;
+  res.contentType = METRICS_CONTENT_TYPE;
+  res.streamed = true;
+  res.body = [](Print &out) { Metric::writeAll(out); };
+}
+
+struct ApiRoute
+{
+  const char *path;
+  ApiHandler handler;
+  MetricsHistogram *latency;
+};
+
+const ApiRoute apiRoutes[] = {
+  {"/api/state", apiState, &httpLatencyState},
+  {"/api/history", apiHistory, &httpLatencyHistory},
+  {"/api/bin/state", apiBinState, &httpLatencyBinState},
+  {"/api/bin/history", apiBinHistory, &httpLatencyBinHistory},
+  {"/api/log/export", apiLogExport, &httpLatencyLogExport},
+  {"/api/logs", apiLogs, &httpLatencyLogs},
+  {"/api/tasks", apiTasks, &httpLatencyTasks},
+  {"/api/deadlines", apiDeadlines, &httpLatencyDeadlines},
+  {"/metrics", apiMetrics, &httpLatencyMetrics},
+};
+
+const ApiRoute *findApiRoute(const char *path)
+{
+  for (const auto &route : apiRoutes) {
+    if (strcmp(route.path, path) == 0) return &route;
+  }
+  return nullptr;
+}
+
+// Answer the current WebServer request with an API handler
+void serveApiRoute(const ApiRoute &route)
+{
+  static ResponseWriter writer;
+  MetricsTimer timer(*route.latency);
+  ApiRequest req = {nullptr, negotiateTelemetryFormat(server.header("Accept").c_str()), false};
+  ApiResponse res = {200, "application/json", nullptr, false};
+  route.handler(req, res);
+  if (req.badArg) apiError(res, 400, "Invalid argument");
+  if (res.streamed) {
+    // The WebServer sends chunked when the length is unknown
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(res.code, res.contentType, "");
+    res.body(writer);
+    writer.flushChunk();
+    server.sendContent("");
+    return;
+  }
+  CountingPrint counter;
+  res.body(counter);
+  server.setContentLength(counter.count());
+  server.send(res.code, res.contentType, "");
+  res.body(writer);
+  writer.flushChunk();
+}
+
+void setupApiRoutes(void)
+{
+  for (const auto &route : apiRoutes) {
+    const ApiRoute *r = &route;
+    server.on(route.path, HTTP_GET, [r]() { serveApiRoute(*r); });
+  }
+  Metric::addCollector(writeIPCMetrics);
+  Metric::addCollector(writeTaskMetrics);
+  Metric::addCollector(writeDeadlineMetrics);
+  Metric::addCollector(writeLoggerMetrics);
+  Metric::addCollector(writeDebugLogMetrics);
+}
+
+// ---------------------- Live connections ---------------------- //
+// The live port serves the event stream and the API routes on persistent
+// HTTP/1.1 connections, so polling clients do not open a TCP connection per
+// request, and pipelined requests are answered in order. Connections are
+// budgeted: event streams may hold EVENTS_MAX_SUBSCRIBERS slots, the rest
+// stay available for API requests, and when all are in use the longest idle
+// keep-alive connection is closed to make room.
+//
+// Dashboard state is pushed to subscribers as Server-Sent Events. Each push
+// is serialised once into a shared buffer and written to every subscriber,
+// and only carries the state groups that changed since the last push.
+
+enum EventGroup { EVENT_GROUP_TIME, EVENT_GROUP_SENSORS, EVENT_GROUP_POWER, EVENT_GROUP_NETWORK, EVENT_GROUP_COUNT };
+const char *eventGroupName[EVENT_GROUP_COUNT] = {"time", "sensors", "power", "network"};
+
+// Serialise one state group as a JSON object, returns the length or 0 on failure
+size_t buildEventGroup(uint8_t group, const ProcessImage &image, char *buf, size_t size)
+{
+  int len = 0;
+  switch (group) {
+    case EVENT_GROUP_TIME: {
+      const DateTime &dt = image.time;
+      len = snprintf(buf, size,
+                     "{\"date\":\"%04d-%02d-%02d\",\"time\":\"%02d:%02d:%02d\",\"timezone\":\"%s\",\"ntpEnabled\":%s,\"dst\":%s}",
+                     dt.year, dt.month, dt.day, dt.hour, dt.minute, dt.second, networkConfig.timezone,
+                     networkConfig.ntpEnabled ? "true" : "false", networkConfig.dstEnabled ? "true" : "false");
+      break;
+    }
+    case EVENT_GROUP_SENSORS: {
+      const ReactorSensors &s = image.sensors;
+      char temp[12] = "--", ph[12] = "--", dissolvedOxygen[12] = "--";
+      if (s.temperature.online) snprintf(temp, sizeof(temp), "%.1f", s.temperature.celcius);
+      if (s.ph.online) snprintf(ph, sizeof(ph), "%.2f", s.ph.pH);
+      if (s.dissolvedOxygen.online) snprintf(dissolvedOxygen, sizeof(dissolvedOxygen), "%.2f", s.dissolvedOxygen.oxygen);
+      len = snprintf(buf, size, "{\"temp\":\"%s\",\"ph\":\"%s\",\"do\":\"%s\"}", temp, ph, dissolvedOxygen);
+      break;
+    }
+    case EVENT_GROUP_POWER: {
+      const PowerStatus &p = image.power;
+      len = snprintf(buf, size,
+                     "{\"mainVoltage\":%.2f,\"v20Voltage\":%.2f,\"v5Voltage\":%.2f,\"mainVoltageOK\":%s,\"v20VoltageOK\":%s,\"v5VoltageOK\":%s}",
+                     p.Vpsu, p.V20, p.V5,
+                     p.psuOK ? "true" : "false", p.V20OK ? "true" : "false", p.V5OK ? "true" : "false");
+      break;
+    }
+    case EVENT_GROUP_NETWORK: {
+      const uint8_t *ip = image.link.ip;
+      len = snprintf(buf, size, "{\"ip\":\"%d.%d.%d.%d\",\"mac\":\"%s\"}",
+                     ip[0], ip[1], ip[2], ip[3], deviceMacAddress);
+      break;
+    }
+  }
+  return (len > 0 && (size_t)len < size) ? len : 0;
+}
+
+// Assemble an SSE "state" event from the groups selected in the mask
+size_t buildEventPayload(char *buf, size_t size, char groups[][EVENTS_GROUP_SIZE], uint8_t mask)
+{
+  size_t len = strlcpy(buf, "event: state\ndata: {", size);
+  bool first = true;
+  for (int g = 0; g < EVENT_GROUP_COUNT; g++) {
+    if (!(mask & (1 << g)) || groups[g][0] == '\0') continue;
+    int n = snprintf(buf + len, size - len, "%s\"%s\":%s", first ? "" : ",", eventGroupName[g], groups[g]);
+    if (n < 0 || (size_t)n >= size - len) return 0;
+    len += n;
+    first = false;
+  }
+  int n = snprintf(buf + len, size - len, "}\n\n");
+  if (n < 0 || (size_t)n >= size - len) return 0;
+  return len + n;
+}
+
+void releaseLiveConnection(LiveConnection &lc)
+{
+  lc.client.stop();
+  lc.state = LIVE_FREE;
+}
+
+// Feed received bytes through the request parser without blocking, returns
+// true once a complete request header has arrived. A request line too long
+// for requestLine is answered 414, an Accept or Connection header too long
+// to read 400; other headers are ignored, so only their start is kept.
+bool readLiveRequest(LiveConnection &lc)
+{
+  while (lc.client.available()) {
+    char c = lc.client.read();
+    if (!lc.inRequest) {
+      if (c == '\r' || c == '\n') continue;  // Stray line ends between requests
+      lc.inRequest = true;
+      lc.lastActivity = millis();
+      lc.lineLen = 0;
+      lc.lineOverflow = false;
+      lc.rejectCode = 0;
+      lc.requestLine[0] = '\0';
+      lc.accept[0] = '\0';
+    }
+    if (c == '\r') continue;
+    if (c != '\n') {
+      if (lc.lineLen < sizeof(lc.line) - 1) lc.line[lc.lineLen++] = c;
+      else lc.lineOverflow = true;
+      continue;
+    }
+    lc.line[lc.lineLen] = '\0';
+    if (lc.lineLen == 0) {
+      lc.inRequest = false;  // Blank line ends the headers
+      return true;
+    }
+    lc.lineLen = 0;
+    bool overflow = lc.lineOverflow;
+    lc.lineOverflow = false;
+    if (lc.requestLine[0] == '\0') {
+      if (strlcpy(lc.requestLine, lc.line, sizeof(lc.requestLine)) >= sizeof(lc.requestLine)) overflow = true;
+      if (overflow && lc.rejectCode == 0) lc.rejectCode = 414;
+    }
+    else if (overflow && (strncasecmp(lc.line, "Accept:", 7) == 0 || strncasecmp(lc.line, "Connection:", 11) == 0)) {
+      if (lc.rejectCode == 0) lc.rejectCode = 400;
+    }
+    else if (strncasecmp(lc.line, "Accept:", 7) == 0) {
+      const char *value = lc.line + 7;
+      while (*value == ' ') value++;
+      strlcpy(lc.accept, value, sizeof(lc.accept));
+    }
+    else if (strncasecmp(lc.line, "Connection:", 11) == 0 && strcasestr(lc.line + 11, "close") != nullptr) {
+      lc.closeAfter = true;
+    }
+  }
+  return false;
+}
+
+const char *httpStatusText(int code)
+{
+  switch (code) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 406: return "Not Acceptable";
+    case 414: return "URI Too Long";
+    case 503: return "Service Unavailable";
+    default: return "Error";
+  }
+}
+
+void sendLiveResponse(LiveConnection &lc, const ApiResponse &res)
+{
+  char header[256];
+  int len = snprintf(header, sizeof(header),
+                     "HTTP/1.1 %d %s\r\n"
+                     "Content-Type: %s\r\n"
+                     "Access-Control-Allow-Origin: *\r\n",
+                     res.code, httpStatusText(res.code), res.contentType);
+  if (res.streamed) {
+    len += snprintf(header + len, sizeof(header) - len, "Transfer-Encoding: chunked\r\n");
+  }
+  else {
+    CountingPrint counter;
+    res.body(counter);
+    len += snprintf(header + len, sizeof(header) - len, "Content-Length: %u\r\n", (unsigned)counter.count());
+  }
+  if (lc.closeAfter) {
+    len += snprintf(header + len, sizeof(header) - len, "Connection: close\r\n\r\n");
+  }
+  else {
+    len += snprintf(header + len, sizeof(header) - len, "Connection: keep-alive\r\nKeep-Alive: timeout=%d, max=%d\r\n\r\n",
+                    LIVE_KEEPALIVE_TIMEOUT / 1000, LIVE_MAX_REQUESTS - lc.requests);
+  }
+  lc.client.write((const uint8_t *)header, len);
+  ResponseWriter writer(&lc.client, res.streamed);
+  res.body(writer);
+  writer.finish();
+}
+
+// Turn the connection into an event stream, if the subscriber budget allows
+void startEventStream(LiveConnection &lc)
+{
+  uint8_t subscribers = 0;
+  for (int i = 0; i < LIVE_MAX_CONNECTIONS; i++) {
+    if (liveConnections[i].state == LIVE_STREAM) subscribers++;
+  }
+  if (subscribers >= EVENTS_MAX_SUBSCRIBERS) {
+    ApiResponse res;
+    apiError(res, 503, "Too many event streams");
+    lc.closeAfter = true;
+    sendLiveResponse(lc, res);
+    releaseLiveConnection(lc);
+    return;
+  }
+  lc.client.print("HTTP/1.1 200 OK\r\n"
+                  "Content-Type: text/event-stream\r\n"
+                  "Cache-Control: no-cache\r\n"
+                  "Connection: keep-alive\r\n"
+                  "Access-Control-Allow-Origin: *\r\n"
+                  "\r\n"
+                  "retry: 2000\n\n");
+  lc.state = LIVE_STREAM;
+  lc.needsSnapshot = true;
+}
+
+// Answer one request. The connection stays open for the next one unless the
+// client asked to close it, it is not HTTP/1.1 or it has used its request budget.
+void handleLiveRequest(LiveConnection &lc)
+{
+  lc.requests++;
+  ApiResponse res = {200, "application/json", nullptr, false};
+
+  // Split "GET /path?query HTTP/1.1"
+  char *target = strchr(lc.requestLine, ' ');
+  char *version = target ? strchr(target + 1, ' ') : nullptr;
+  if (lc.rejectCode != 0 || version == nullptr) {
+    if (lc.rejectCode == 414) apiError(res, 414, "Request line too long");
+    else apiError(res, 400, "Bad request");
+    lc.closeAfter = true;
+    sendLiveResponse(lc, res);
+    releaseLiveConnection(lc);
+    return;
+  }
+  *target++ = '\0';
+  *version++ = '\0';
+  if (strcmp(version, "HTTP/1.1") != 0 || lc.requests >= LIVE_MAX_REQUESTS) lc.closeAfter = true;
+  char *query = strchr(target, '?');
+  if (query != nullptr) *query++ = '\0';
+
+  const ApiRoute *route = findApiRoute(target);
+  uint32_t start = micros();
+  if (strcmp(lc.requestLine, "GET") != 0) {
+    // Request bodies are not read, so the connection can't be reused
+    apiError(res, 405, "Method not allowed");
+    lc.closeAfter = true;
+  }
+  else if (strcmp(target, "/events") == 0) {
+    startEventStream(lc);
+    return;
+  }
+  else if (route == nullptr) {
+    apiError(res, 404, "Not found");
+  }
+  else {
+    ApiRequest req = {query ? query : "", negotiateTelemetryFormat(lc.accept), false};
+    route->handler(req, res);
+    if (req.badArg) apiError(res, 400, "Invalid argument");
+  }
+
+  sendLiveResponse(lc, res);
+  if (route != nullptr) route->latency->observe((micros() - start) * 1e-6f);
+  lc.lastActivity = millis();
+  if (lc.closeAfter) releaseLiveConnection(lc);
+}
+
+// Take a new connection, closing the longest idle keep-alive connection if all slots are in use
+void acceptLiveConnection(void)
+{
+  WiFiClient newClient = liveServer.accept();
+  if (!newClient) return;
+
+  int slot = -1;
+  uint32_t longestIdle = 0;
+  for (int i = 0; i < LIVE_MAX_CONNECTIONS; i++) {
+    LiveConnection &lc = liveConnections[i];
+    if (lc.state == LIVE_FREE) {
+      slot = i;
+      break;
+    }
+    uint32_t idle = millis() - lc.lastActivity;
+    if (lc.state == LIVE_REQUEST && !lc.inRequest && idle >= longestIdle) {
+      slot = i;
+      longestIdle = idle;
+    }
+  }
+  if (slot < 0) {
+    newClient.print("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    newClient.stop();
+    return;
+  }
+
+  LiveConnection &lc = liveConnections[slot];
+  if (lc.state != LIVE_FREE) releaseLiveConnection(lc);
+  lc.client = newClient;
+  lc.client.setNoDelay(true);
+  lc.state = LIVE_REQUEST;
+  lc.lastActivity = millis();
+  lc.requests = 0;
+  lc.inRequest = false;
+  lc.closeAfter = false;
+}
+
+void setupLiveServer(void)
+{
+  for (int i = 0; i < LIVE_MAX_CONNECTIONS; i++) liveConnections[i].state = LIVE_FREE;
+  liveServer.begin();
+  debug_printf(LOG_INFO, "Live server started on port %d\n", LIVE_PORT);
+}
+
+void handleLiveServer(void)
+{
+  static char groups[EVENT_GROUP_COUNT][EVENTS_GROUP_SIZE];
+  static char payload[EVENTS_PAYLOAD_SIZE];
+  static char snapshot[EVENTS_PAYLOAD_SIZE];
+  static uint32_t lastPush = 0;
+
+  acceptLiveConnection();
+
+  bool anyStream = false, anySnapshot = false;
+  for (int i = 0; i < LIVE_MAX_CONNECTIONS; i++) {
+    LiveConnection &lc = liveConnections[i];
+    if (lc.state == LIVE_FREE) continue;
+    if (!lc.client.connected()) {
+      releaseLiveConnection(lc);
+      continue;
+    }
+    if (lc.state == LIVE_REQUEST) {
+      // Pipelined requests are answered in order, a few per pass so one
+      // client can't hold up the others
+      for (int n = 0; n < LIVE_PIPELINE_DEPTH && lc.state == LIVE_REQUEST && readLiveRequest(lc); n++) {
+        handleLiveRequest(lc);
+      }
+      uint32_t timeout = lc.inRequest ? LIVE_REQUEST_TIMEOUT : LIVE_KEEPALIVE_TIMEOUT;
+      if (lc.state == LIVE_REQUEST && millis() - lc.lastActivity > timeout) releaseLiveConnection(lc);
+    }
+    if (lc.state == LIVE_STREAM) {
+      anyStream = true;
+      anySnapshot |= lc.needsSnapshot;
+    }
+  }
+
+  if (!anyStream || millis() - lastPush < EVENTS_PUSH_INTERVAL) return;
+  lastPush = millis();
+
+  // Rebuild each group from one snapshot and note which ones changed since the last push
+  ProcessImage image;
+  getProcessImage(image);
+  uint8_t changed = 0;
+  for (int g = 0; g < EVENT_GROUP_COUNT; g++) {
+    char current[EVENTS_GROUP_SIZE];
+    if (buildEventGroup(g, image, current, sizeof(current)) == 0) continue;
+    if (strcmp(current, groups[g]) != 0) {
+      strcpy(groups[g], current);
+      changed |= 1 << g;
+    }
+  }
+
+  // Both payloads are built once and shared by all subscribers
+  size_t deltaLen = changed ? buildEventPayload(payload, sizeof(payload), groups, changed) : 0;
+  size_t snapshotLen = anySnapshot ? buildEventPayload(snapshot, sizeof(snapshot), groups, 0xFF) : 0;
+
+  for (int i = 0; i < LIVE_MAX_CONNECTIONS; i++) {
+    LiveConnection &lc = liveConnections[i];
+    if (lc.state != LIVE_STREAM) continue;
+    const char *data = lc.needsSnapshot ? snapshot : payload;
+    size_t len = lc.needsSnapshot ? snapshotLen : deltaLen;
+    if (len == 0) continue;
+    // Never block on a slow subscriber, it gets a full snapshot once it catches up
+    if ((size_t)lc.client.availableForWrite() < len) {
+      lc.needsSnapshot = true;
+      continue;
+    }
+    lc.client.write((const uint8_t *)data, len);
+    lc.needsSnapshot = false;
+  }
+}
+
+// Inter-processor communication
+
+// Where each sensor and control object from the IO MCU lands in the process
+// image. A message carries the whole object, except for the DO control: its
+// stirrer and gas lookup tables don't fit in a message (MAX_PAYLOAD_SIZE) and
+// are never sent over IPC, so only the leading setpoint and enabled flag are
+// mapped and the tables in the image stay zero.
+struct IPCImageMapping {
+  uint8_t msgId;
+  size_t offset;
+  size_t size;
+};
+#define IPC_IMAGE_MAP(id, member) {id, offsetof(ProcessImage, member), sizeof(ProcessImage::member)}
+#define IPC_IMAGE_MAP_PREFIX(id, member, size) {id, offsetof(ProcessImage, member), size}
+#define DO_CONTROL_IPC_SIZE offsetof(DissolvedOxygenControl, DOstirrerLUT)  // sp_oxygen, enabled
+constexpr IPCImageMapping ipcImageMap[] = {
+  IPC_IMAGE_MAP(MSG_POWER_SENSOR, sensors.power),
+  IPC_IMAGE_MAP(MSG_TEMPERATURE_SENSOR, sensors.temperature),
+  IPC_IMAGE_MAP(MSG_PH_SENSOR, sensors.ph),
+  IPC_IMAGE_MAP(MSG_DO_SENSOR, sensors.dissolvedOxygen),
+  IPC_IMAGE_MAP(MSG_OD_SENSOR, sensors.opticalDensity),
+  IPC_IMAGE_MAP(MSG_GAS_FLOW_SENSOR, sensors.gasFlow),
+  IPC_IMAGE_MAP(MSG_PRESSURE_SENSOR, sensors.pressure),
+  IPC_IMAGE_MAP(MSG_STIRRER_SPEED_SENSOR, sensors.stirrerSpeed),
+  IPC_IMAGE_MAP(MSG_WEIGHT_SENSOR, sensors.weight),
+  IPC_IMAGE_MAP(MSG_TEMPERATURE_CONTROL, controls.temperature),
+  IPC_IMAGE_MAP(MSG_PH_CONTROL, controls.ph),
+  IPC_IMAGE_MAP_PREFIX(MSG_DO_CONTROL, controls.dissolvedOxygen, DO_CONTROL_IPC_SIZE),
+  IPC_IMAGE_MAP(MSG_GAS_FLOW_CONTROL, controls.gasFlow),
+  IPC_IMAGE_MAP(MSG_STIRRER_SPEED_CONTROL, controls.stirrerSpeed),
+  IPC_IMAGE_MAP(MSG_PUMP_SPEED_CONTROL, controls.pumpSpeed),
+  IPC_IMAGE_MAP(MSG_FEED_CONTROL, controls.feed),
+  IPC_IMAGE_MAP(MSG_WASTE_CONTROL, controls.waste),
+};
+
+// A mapping larger than a message payload could never match a frame
+constexpr bool ipcImageMapFits(void)
+{
+  for (const auto &map : ipcImageMap) {
+    if (map.size > MAX_PAYLOAD_SIZE) return false;
+  }
+  return true;
+}
+static_assert(ipcImageMapFits(), "Every IPC image mapping must fit in MAX_PAYLOAD_SIZE");
+
+void storeIPCObject(const Message &msg, const IPCImageMapping &map)
+{
+  // The process image holds one object of each type for now
+  if (msg.objId != 0 || msg.dataLength != map.size) return;
+  updateProcessImage([&](ProcessImage &image) {
+    memcpy((uint8_t *)&image + map.offset, msg.data, map.size);
+  });
+  recordHistory(msg, (uint32_t)(systemClock.now() / 1000000));
+}
+
+void setupIPC(void) {
+  Serial1.setRX(PIN_SI_RX);
+  Serial1.setTX(PIN_SI_TX);
+  ipc.begin(115200);
+  for (const auto &map : ipcImageMap) {
+    ipc.registerCallback(map.msgId, [&map](const Message &msg) { storeIPCObject(msg, map); });
+  }
+  // Add in handshaking checks here...
+  debug_printf(LOG_INFO, "Inter-processor communication setup complete\n");
+}
+
+// ---------------------- Utility functions ---------------------- //
+
+// Update the process image. Readers never see a partial update and never
+// wait for a writer (see Snapshot). update runs with interrupts masked, so
+// it should only assign fields.
+template <typename UpdateFn>
+bool updateProcessImage(UpdateFn update)
+{
+  processImage.update([&](ProcessImage &image) {
+    update(image);
+    image.version++;
+  });
+  return true;
+}
+
+// Take a consistent snapshot of the process image without locking
+void getProcessImage(ProcessImage &image)
+{
+  processImage.read(image);
+  // Not stored, so nothing has to wake up every second to update it
+  if (!getGlobalDateTime(image.time)) image.time = {};
+}
+
+void updateLinkStatus(void)
+{
+  IPAddress ip = eth.localIP();
+  bool connected = ethernetConnected;
+  updateProcessImage([&](ProcessImage &image) {
+    image.link.connected = connected;
+    for (int i = 0; i < 4; i++) image.link.ip[i] = ip[i];
+  });
+}
+
+// Serialise the selected process image groups into a JSON object
+void serializeProcessImage(JsonObject root, const ProcessImage &image, uint8_t fields)
+{
+  root["version"] = image.version;
+  if (fields & IMAGE_TIME) {
+    char timeStr[20];
+    snprintf(timeStr, sizeof(timeStr), "%04d-%02d-%02dT%02d:%02d:%02d",
+             image.time.year, image.time.month, image.time.day,
+             image.time.hour, image.time.minute, image.time.second);
+    root["time"] = timeStr;
+  }
+  if (fields & IMAGE_SENSORS) {
+    const ReactorSensors &s = image.sensors;
+    JsonObject sensors = root.createNestedObject("sensors");
+    JsonObject power = sensors.createNestedObject("power");
+    power["volts"] = s.power.volts;
+    power["amps"] = s.power.amps;
+    power["watts"] = s.power.watts;
+    power["online"] = s.power.online;
+    JsonObject temperature = sensors.createNestedObject("temperature");
+    temperature["celcius"] = s.temperature.celcius;
+    temperature["online"] = s.temperature.online;
+    JsonObject ph = sensors.createNestedObject("ph");
+    ph["pH"] = s.ph.pH;
+    ph["online"] = s.ph.online;
+    JsonObject dissolvedOxygen = sensors.createNestedObject("dissolvedOxygen");
+    dissolvedOxygen["oxygen"] = s.dissolvedOxygen.oxygen;
+    dissolvedOxygen["online"] = s.dissolvedOxygen.online;
+    JsonObject opticalDensity = sensors.createNestedObject("opticalDensity");
+    opticalDensity["OD"] = s.opticalDensity.OD;
+    opticalDensity["online"] = s.opticalDensity.online;
+    JsonObject gasFlow = sensors.createNestedObject("gasFlow");
+    gasFlow["mlPerMinute"] = s.gasFlow.mlPerMinute;
+    gasFlow["online"] = s.gasFlow.online;
+    JsonObject pressure = sensors.createNestedObject("pressure");
+    pressure["kPa"] = s.pressure.kPa;
+    pressure["online"] = s.pressure.online;
+    JsonObject stirrerSpeed = sensors.createNestedObject("stirrerSpeed");
+    stirrerSpeed["rpm"] = s.stirrerSpeed.rpm;
+    stirrerSpeed["online"] = s.stirrerSpeed.online;
+    JsonObject weight = sensors.createNestedObject("weight");
+    weight["grams"] = s.weight.grams;
+    weight["online"] = s.weight.online;
+  }
+  if (fields & IMAGE_CONTROLS) {
+    // DO lookup tables are configuration rather than state and are left out
+    const ReactorControls &c = image.controls;
+    JsonObject controls = root.createNestedObject("controls");
+    JsonObject temperature = controls.createNestedObject("temperature");
+    temperature["setpoint"] = c.temperature.sp_celcius;
+    temperature["enabled"] = c.temperature.enabled;
+    temperature["kp"] = c.temperature.kp;
+    temperature["ki"] = c.temperature.ki;
+    temperature["kd"] = c.temperature.kd;
+    JsonObject ph = controls.createNestedObject("ph");
+    ph["setpoint"] = c.ph.sp_pH;
+    ph["enabled"] = c.ph.enabled;
+    ph["period"] = c.ph.period;
+    ph["maxDoseTime"] = c.ph.max_dose_time;
+    JsonObject dissolvedOxygen = controls.createNestedObject("dissolvedOxygen");
+    dissolvedOxygen["setpoint"] = c.dissolvedOxygen.sp_oxygen;
+    dissolvedOxygen["enabled"] = c.dissolvedOxygen.enabled;
+    JsonObject gasFlow = controls.createNestedObject("gasFlow");
+    gasFlow["setpoint"] = c.gasFlow.sp_mlPerMinute;
+    gasFlow["enabled"] = c.gasFlow.enabled;
+    gasFlow["kp"] = c.gasFlow.kp;
+    gasFlow["ki"] = c.gasFlow.ki;
+    gasFlow["kd"] = c.gasFlow.kd;
+    JsonObject stirrerSpeed = controls.createNestedObject("stirrerSpeed");
+    stirrerSpeed["setpoint"] = c.stirrerSpeed.sp_rpm;
+    stirrerSpeed["enabled"] = c.stirrerSpeed.enabled;
+    stirrerSpeed["kp"] = c.stirrerSpeed.kp;
+    stirrerSpeed["ki"] = c.stirrerSpeed.ki;
+    stirrerSpeed["kd"] = c.stirrerSpeed.kd;
+    controls["pumpSpeed"]["percent"] = c.pumpSpeed.percent;
+    JsonObject feed = controls.createNestedObject("feed");
+    feed["period"] = c.feed.period;
+    feed["duty"] = c.feed.duty;
+    feed["enabled"] = c.feed.enabled;
+    JsonObject waste = controls.createNestedObject("waste");
+    waste["period"] = c.waste.period;
+    waste["duty"] = c.waste.duty;
+    waste["enabled"] = c.waste.enabled;
+  }
+  if (fields & IMAGE_POWER) {
+    JsonObject power = root.createNestedObject("power");
+    power["mainVoltage"] = image.power.Vpsu;
+    power["v20Voltage"] = image.power.V20;
+    power["v5Voltage"] = image.power.V5;
+    power["mainVoltageOK"] = image.power.psuOK;
+    power["v20VoltageOK"] = image.power.V20OK;
+    power["v5VoltageOK"] = image.power.V5OK;
+  }
+  if (fields & IMAGE_LINK) {
+    JsonObject link = root.createNestedObject("link");
+    char ipStr[16];
+    snprintf(ipStr, sizeof(ipStr), "%d.%d.%d.%d", image.link.ip[0], image.link.ip[1], image.link.ip[2], image.link.ip[3]);
+    link["connected"] = image.link.connected;
+    link["ip"] = ipStr;
+    link["mac"] = deviceMacAddress;
+  }
+}
+
+// Parse a comma separated field list ("sensors,power") into image group flags
+bool parseImageFields(const char *list, uint8_t &fields)
+{
+  static const struct {
+    const char *name;
+    uint8_t flag;
+  } groups[] = {
+    {"time", IMAGE_TIME},
+    {"sensors", IMAGE_SENSORS},
+    {"controls", IMAGE_CONTROLS},
+    {"power", IMAGE_POWER},
+    {"link", IMAGE_LINK},
+  };
+  if (list[0] == '\0') {
+    fields = IMAGE_ALL;
+    return true;
+  }
+  // Tokenized in a stack copy, no heap
+  char buf[64];
+  if (strlcpy(buf, list, sizeof(buf)) >= sizeof(buf)) return false;
+  fields = 0;
+  char *savePtr;
+  for (char *name = strtok_r(buf, ",", &savePtr); name != nullptr; name = strtok_r(nullptr, ",", &savePtr)) {
+    bool found = false;
+    for (const auto &group : groups) {
+      if (strcmp(name, group.name) == 0) {
+        fields |= group.flag;
+        found = true;
+        break;
+      }
+    }
+    if (!found) return false;
+  }
+  return fields != 0;
+}
+
+// Get the current DateTime, without locking. False until the RTC has been read.
+bool getGlobalDateTime(DateTime &dt)
+{
+  int64_t now = systemClock.now();
+  if (now <= 0) return false;
+  dt = epochToDateTime((time_t)(now / 1000000));
+  return true;
+}
+
+// Set the date and time. The system clock follows the new time at once and
+// the RTC task writes it to the RTC and checks it, so this never waits for
+// I2C. False if dt isn't a valid date and time.
+bool updateGlobalDateTime(const DateTime &dt) {
+  if (dt.year < 2000 || dt.year > 2099 || dt.month < 1 || dt.month > 12 ||
+      dt.day < 1 || dt.day > 31 || dt.hour > 23 || dt.minute > 59 || dt.second > 59) {
+    debug_printf(LOG_ERROR, "Invalid date and time: %04d-%02d-%02d %02d:%02d:%02d\n",
+                  dt.year, dt.month, dt.day, dt.hour, dt.minute, dt.second);
+    return false;
+  }
+  systemClock.set((int64_t)dateTimeToEpoch(dt) * 1000000, SystemClock::uptime());
+  bool write = true;
+  xQueueOverwrite(rtcWriteQueue, &write);
+  debug_printf(LOG_INFO, "Time set to: %04d-%02d-%02d %02d:%02d:%02d\n",
+                dt.year, dt.month, dt.day, dt.hour, dt.minute, dt.second);
+  return true;
+}
+
+// Give the debug output task a moment to write out what is queued, e.g.
+// before a reboot
+void debug_flush(void) {
+  uint32_t start = millis();
+  while (!debugLog.empty() && millis() - start < DEBUG_FLUSH_TIMEOUT) delay(10);
+}
+
+// Thread-safe LED colour setter
+bool setLEDcolour(uint8_t led, uint32_t colour) {
+  if (led > 3) {
+    debug_printf(LOG_ERROR, "Invalid LED number: %d\n", led);
+    return false;
+  }
+  bool changed = false;
+  status.update([&](StatusVariables &s) {
+    changed = s.LEDcolour[led] != colour;
+    s.LEDcolour[led] = colour;
+  });
+  // The LED task only redraws when told to
+  if (changed && taskHandles[TASK_LEDS] != NULL) xTaskNotifyGive(taskHandles[TASK_LEDS]);
+  return true;
+}
+const char *taskStateName(uint8_t state)
+{
+  static const char *const names[] = {"Running", "Ready", "Blocked", "Suspended", "Deleted", "Invalid"};
+  return state < sizeof(names) / sizeof(names[0]) ? names[state] : "Invalid";
+}
+
+// One line per task from the profiler's last sample
+void osDebugPrint(void)
+{
+  static TaskProfileSet profile;
+  taskProfiler.read(profile);
+
+  DateTime current;
+  if (getGlobalDateTime(current))
+  {
+    // Use the current time safely
+    debug_printf(LOG_INFO, "Time: %02d:%02d:%02d\n",
+                  current.hour, current.minute, current.second);
+  }
+
+  debug_printf(LOG_INFO, "Tasks: %d\n", profile.numTasks);
+  for (uint8_t i = 0; i < profile.numTasks; i++)
+  {
+    const TaskProfile &task = profile.tasks[i];
+    debug_printf(LOG_INFO, "%-16s %-9s pri %u core %d cpu %u.%02u%% stack free %u\n",
+                  task.name, taskStateName(task.state), task.priority, task.core,
+                  task.cpu / 100, task.cpu % 100, task.stackFree);
+  }
+}
+
+// The terminal "top" screen: cores, then tasks by CPU use. Starts with the
+// ANSI codes to clear the screen. Returns the length.
+size_t formatTop(char *screen, size_t size)
+{
+  static TaskProfileSet profile;
+  taskProfiler.read(profile);
+  size_t len = 0;
+  auto append = [&](const char *format, auto... args) {
+    if (len < size) len += snprintf(screen + len, size - len, format, args...);
+  };
+
+  unsigned long up = millis() / 1000;
+  append("\033[H\033[2Jtop - up %lu:%02lu:%02lu, %u tasks%s\r\n", up / 3600, up / 60 % 60, up % 60,
+         profile.numTasks, profile.truncated ? " (too many to list)" : "");
+  for (uint8_t c = 0; c < TASK_PROFILER_NUM_CORES; c++) {
+    append("core %u: %3u.%02u%% busy, %lu switches/s\r\n", c, profile.cores[c].cpu / 100,
+           profile.cores[c].cpu % 100, (unsigned long)profile.cores[c].switches);
+  }
+  append("\r\n%-16s %4s %3s %-9s %7s %10s %6s\r\n", "TASK", "CORE", "PRI", "STATE", "CPU%", "STACK FREE", "DROP");
+
+  uint8_t order[TASK_PROFILER_MAX_TASKS];
+  for (uint8_t i = 0; i < profile.numTasks; i++) {
+    uint8_t j = i;
+    while (j > 0 && profile.tasks[order[j - 1]].cpu < profile.tasks[i].cpu) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = i;
+  }
+  for (uint8_t i = 0; i < profile.numTasks; i++) {
+    const TaskProfile &task = profile.tasks[order[i]];
+    char core[4] = "-";
+    if (task.core >= 0) snprintf(core, sizeof(core), "%d", task.core);
+    append("%-16s %4s %3u %-9s %4u.%02u %10lu %6lu\r\n", task.name, core, task.priority,
+           taskStateName(task.state), task.cpu / 100, task.cpu % 100,
+           (unsigned long)task.stackFree, (unsigned long)task.stackDrop);
+  }
+  append("\r\nPress enter to stop\r\n");
+  return len < size ? len : size - 1;
+}
+
+// ---------------------- Task table ---------------------- //
+// Every application task: stack size in words, priority, the cores it may
+// run on, and for the periodic ones the deadlines the watchdog task holds
+// them to. Stacks and task control blocks are allocated from this table at
+// link time, so RAM use doesn't change at run time and starting a task
+// can't fail. setup() starts the core 0 tasks, setup1() the rest.
+//
+// Core 0 does the network work, core 1 the control work, so HTTP load can
+// only delay IPC through the locks they share (the process image and
+// history), never by holding the CPU. On each core a task only waits for
+// higher priority ones:
+//
+//   PRIORITY_WATCHDOG      Deadline checks, feeding the hardware watchdog
+//   PRIORITY_IPC           IPC receive, polled every IPC_POLL_INTERVAL
+//   PRIORITY_TIMING        Network link and NTP, RTC tick polling
+//   PRIORITY_SERVICE       HTTP server, LEDs, terminal, power, profiler
+//   PRIORITY_LOGGING       SD card and debug output, which yield to everything
+//
+// Debug output and the watchdog are not pinned (see manageDebugOutput()
+// and manageWatchdog()). loop() and loop1() block once setup is done.
+//
+// A periodic task is due a pass period ms after its previous pass ended and
+// should finish it within budget ms (see DeadlineMonitor). If a critical
+// one stalls, the hardware watchdog resets the board. Tasks with period 0
+// aren't watched: the terminal, whose "top" stays in one pass, and the
+// watchdog itself.
+
+enum TaskPriority : UBaseType_t {
+  PRIORITY_LOGGING = 1,
+  PRIORITY_SERVICE,
+  PRIORITY_TIMING,
+  PRIORITY_IPC,
+  PRIORITY_WATCHDOG,
+};
+static_assert(PRIORITY_WATCHDOG < configMAX_PRIORITIES, "Task priorities must fit configMAX_PRIORITIES");
+static_assert(NUM_TASKS <= DEADLINE_MAX_TASKS, "Every task needs a deadline monitor entry");
+
+#define CORE_NETWORK (1 << 0)
+#define CORE_CONTROL (1 << 1)
+
+struct TaskConfig
+{
+  TaskFunction_t function;
+  const char *name;
+  uint32_t stackWords;
+  UBaseType_t priority;
+  UBaseType_t cores;  // Affinity mask
+  uint32_t period;    // ms, 0 if not watched
+  uint32_t budget;    // ms
+  bool critical;      // Stalling resets the board
+};
+
+constexpr TaskConfig taskTable[NUM_TASKS] = {
+  {manageDebugOutput, "Debug out", 512, PRIORITY_LOGGING, tskNO_AFFINITY, DEBUG_DRAIN_INTERVAL, 250, false},
+  {manageNetwork, "Network", 1024, PRIORITY_TIMING, CORE_NETWORK, NETWORK_POLL_INTERVAL, 10000, false},  // DHCP, NTP
+  {manageWebServer, "HTTP srv", 2048, PRIORITY_SERVICE, CORE_NETWORK, HTTP_TASK_POLL_INTERVAL, 1000, false},
+  {manageIPC, "IPC rx", 512, PRIORITY_IPC, CORE_CONTROL, IPC_POLL_INTERVAL, 10, true},
+  {statusLEDs, "LED stat", 256, PRIORITY_SERVICE, CORE_CONTROL, LED_BLINK_INTERVAL, 10, false},
+  {manageRTC, "RTC updt", 256, PRIORITY_TIMING, CORE_CONTROL, CLOCK_SYNC_MAX_INTERVAL * 1000, 3000, true},  // Write, then sync
+  {manageTerminal, "Term updt", 512, PRIORITY_SERVICE, CORE_CONTROL, 0, 0, false},  // Room to format the top screen
+  {managePower, "Pwr updt", 256, PRIORITY_SERVICE, CORE_CONTROL, 1000, 250, true},
+  {manageLogger, "SD log", 1024, PRIORITY_LOGGING, CORE_CONTROL, LOGGER_TASK_INTERVAL, 1000, false},
+  {manageProfiler, "Profiler", 256, PRIORITY_SERVICE, CORE_CONTROL, PROFILER_INTERVAL, 50, false},
+  {manageWatchdog, "Watchdog", 512, PRIORITY_WATCHDOG, tskNO_AFFINITY, 0, 0, false},
+};
+
+constexpr uint32_t taskStackOffset(uint8_t task)
+{
+  uint32_t words = 0;
+  for (uint8_t i = 0; i < task; i++) words += taskTable[i].stackWords;
+  return words;
+}
+
+// The profiler has to list the system's own tasks too (see TaskProfiler.h)
+#define SYSTEM_TASK_ALLOWANCE 12
+static_assert(NUM_TASKS + SYSTEM_TASK_ALLOWANCE <= TASK_PROFILER_MAX_TASKS,
+              "Raise TASK_PROFILER_MAX_TASKS for the tasks in the table");
+
+StackType_t taskStacks[taskStackOffset(NUM_TASKS)];
+StaticTask_t taskBlocks[NUM_TASKS];
+TaskHandle_t taskHandles[NUM_TASKS];
+
+void startTask(AppTask task)
+{
+  const TaskConfig &config = taskTable[task];
+  if (config.period > 0) deadlineMonitor.watch(task, config.name, config.period * 1000, config.budget * 1000, config.critical);
+  taskHandles[task] = xTaskCreateStaticAffinitySet(config.function, config.name, config.stackWords, NULL,
+                                                   config.priority, taskStacks + taskStackOffset(task),
+                                                   &taskBlocks[task], config.cores);
+}
+
+// Largest block malloc() can hand out now, found by trying
+size_t largestFreeBlock(void)
+{
+  size_t low = 0, high = rp2040.getFreeHeap();
+  while (low < high) {
+    size_t size = (low + high + 1) / 2;
+    void *block = malloc(size);
+    if (block != nullptr) {
+      free(block);
+      low = size;
+    }
+    else high = size - 1;
+  }
+  return low;
+}
+
+// Where the RAM goes: statically allocated (task stacks, the largest part,
+// shown separately), the heap, and the per-task stack table
+void reportMemoryBudget(void)
+{
+  extern char __data_start__[], __bss_end__[];
+  uint32_t ram = (uint32_t)(__bss_end__ - __data_start__);
+  uint32_t stacks = sizeof(taskStacks);
+  debug_printf(LOG_INFO, "RAM: %u bytes static (%u task stacks, %u task blocks, %u other)\n",
+                ram, stacks, (uint32_t)sizeof(taskBlocks), ram - stacks - (uint32_t)sizeof(taskBlocks));
+  debug_printf(LOG_INFO, "Heap: %u of %u bytes free, largest free block %u\n",
+                rp2040.getFreeHeap(), rp2040.getTotalHeap(), (uint32_t)largestFreeBlock());
+  for (uint8_t task = 0; task < NUM_TASKS; task++) {
+    const TaskConfig &config = taskTable[task];
+    UBaseType_t unused = taskHandles[task] != NULL ? uxTaskGetStackHighWaterMark(taskHandles[task]) : 0;
+    debug_printf(LOG_INFO, "  %-10s stack %5u bytes, %5u never used\n", config.name,
+                  (uint32_t)(config.stackWords * sizeof(StackType_t)), (uint32_t)(unused * sizeof(StackType_t)));
+  }
+}
+
+// Say if the watchdog reset the board, and which task had stalled
+void reportWatchdogReset(void)
+{
+  uint32_t stall = watchdog_hw->scratch[0];
+  watchdog_hw->scratch[0] = 0;
+  if (!watchdog_enable_caused_reboot()) return;
+  uint8_t task = stall & 0xFF;
+  if ((stall & ~0xFFu) == WATCHDOG_STALL_MAGIC && task < NUM_TASKS) {
+    debug_printf(LOG_ERROR, "Reset by the watchdog, task %s had stalled\n", taskTable[task].name);
+  }
+  else debug_printf(LOG_ERROR, "Reset by the watchdog, the watchdog task had stopped\n");
+}
+
+void setup() // Eth interface (keep RTOS tasks out of core 0)
+{
+  Serial.begin(115200);
+  while (!Serial)
+    ;
+
+  Serial.println("[INFO] Core 0 setup started");
+
+  // Debug output is queued by debug_printf and written out by its own task
+  debugLog.setLevelNames(logType, sizeof(logType) / sizeof(logType[0]));
+  startTask(TASK_DEBUG_OUT);
+  serialReady = true;
+  reportWatchdogReset();
+
+  // Queues and locks are static, so creating them cannot fail
+  // NTP sync requests from the HTTP server task
+  ntpUpdateQueue = xQueueCreateStatic(1, sizeof(bool), ntpUpdateQueueStorage, &ntpUpdateQueueBuffer);
+  // Requests to copy the system clock to the RTC, for the RTC task
+  rtcWriteQueue = xQueueCreateStatic(1, sizeof(bool), rtcWriteQueueStorage, &rtcWriteQueueBuffer);
+  // Sensor history lock (the IPC task writes, the HTTP server task reads)
+  historyMutex = xSemaphoreCreateMutexStatic(&historyMutexBuffer);
+
+  // Initialize hardware
+  setupEthernet();
+  setupWebServer();
+  setupNetworkAPI();
+  setupMqttAPI();
+  setupTimeAPI();
+  setupApiRoutes();
+  setupIPC();
+
+  // Network work runs in core 0 tasks, see the task table
+  startTask(TASK_NETWORK);
+  startTask(TASK_HTTP);
+
+  debug_printf(LOG_INFO, "Core 0 setup complete\n");
+  core0setupComplete = true;
+  while (!core1setupComplete) delay(100);
+  reportMemoryBudget();
+  if (uxTaskGetNumberOfTasks() > TASK_PROFILER_MAX_TASKS) {
+    debug_printf(LOG_WARNING, "%u tasks, more than the profiler can list (TASK_PROFILER_MAX_TASKS %u)\n",
+                  (unsigned)uxTaskGetNumberOfTasks(), (unsigned)TASK_PROFILER_MAX_TASKS);
+  }
+  debug_printf(LOG_INFO, "<---System initialisation complete --->\n\n");
+}
+
+void loop()
+{
+  // Everything on core 0 runs in tasks, so just stay blocked
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+void setup1()
+{
+  while (!serialReady) delay(100);
+  debug_printf(LOG_INFO, "Core 1 setup started\n");
+
+   // Set System Status
+  setLEDcolour(LED_SYSTEM_STATUS, LED_STATUS_STARTUP);
+  // Initialize Core 1 tasks
+  for (uint8_t task = TASK_IPC; task < NUM_TASKS; task++) startTask((AppTask)task);
+
+  // Modbus not yet implemented
+  setLEDcolour(LED_MODBUS_STATUS, LED_STATUS_OFF);
+  // MQTT not yet implemented
+  setLEDcolour(LED_MQTT_STATUS, LED_STATUS_OFF); 
+
+  debug_printf(LOG_INFO, "Core 1 setup complete\n");
+  core1setupComplete = true;
+  while (!core0setupComplete) delay(100);
+}
+
+void loop1() {
+  // Everything on core 1 runs in tasks, so just stay blocked
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+// ---------------------- Core 0 tasks ---------------------- //
+// Ethernet link changes and NTP. Wakes every NETWORK_POLL_INTERVAL to check
+// the link, or at once for a sync requested from the web UI.
+void manageNetwork(void *param)
+{
+  (void)param;
+  while (!core1setupComplete || !core0setupComplete) vTaskDelay(pdMS_TO_TICKS(100));
+
+  debug_printf(LOG_INFO, "Network task started\n");
+  if (ethernetConnected) handleNTPUpdates(true);
+
+  // Task loop
+  while (1) {
+    bool forceUpdate = false;
+    xQueueReceive(ntpUpdateQueue, &forceUpdate, pdMS_TO_TICKS(NETWORK_POLL_INTERVAL));
+    deadlineMonitor.start(TASK_NETWORK);
+    if (ethernetConnected) {
+      if (eth.linkStatus() == LinkOFF) {
+        ethernetConnected = false;
+        setLEDcolour(LED_WEBSERVER_STATUS, LED_STATUS_OFF);
+        setLEDcolour(LED_MQTT_STATUS, LED_STATUS_OFF);
+        debug_printf(LOG_INFO, "Ethernet disconnected, waiting for reconnect\n");
+        updateLinkStatus();
+      }
+      else handleNTPUpdates(forceUpdate);
+    }
+    else if (eth.linkStatus() == LinkON) {
+      // Interface is reconfigured before the HTTP server task sees the link as up
+      if(!applyNetworkConfig()) {
+        debug_printf(LOG_ERROR, "Failed to apply network configuration!\n");
+      }
+      else {
+        debug_printf(LOG_INFO, "Ethernet re-connected, IP address: %s, Gateway: %s\n",
+                  eth.localIP().toString().c_str(),
+                  eth.gatewayIP().toString().c_str());
+      }
+      ethernetConnected = true;
+      updateLinkStatus();
+    }
+    deadlineMonitor.end(TASK_NETWORK);
+  }
+}
+
+void manageWebServer(void *param)
+{
+  (void)param;
+  while (!core0setupComplete) vTaskDelay(pdMS_TO_TICKS(100));
+
+  debug_printf(LOG_INFO, "HTTP server task started\n");
+
+  // Task loop
+  while (1) {
+    deadlineMonitor.start(TASK_HTTP);
+    handleWebServer();
+    deadlineMonitor.end(TASK_HTTP);
+    vTaskDelay(pdMS_TO_TICKS(HTTP_TASK_POLL_INTERVAL));
+  }
+}
+
+// Writes queued debug output to USB serial. Not pinned, so it also runs
+// while a core is stuck in a fatal error loop after reporting it.
+void manageDebugOutput(void *param)
+{
+  (void)param;
+
+  // Task loop
+  while (1) {
+    deadlineMonitor.start(TASK_DEBUG_OUT);
+    debugLog.drain(Serial);
+    deadlineMonitor.end(TASK_DEBUG_OUT);
+    vTaskDelay(pdMS_TO_TICKS(DEBUG_DRAIN_INTERVAL));
+  }
+}
+
+
+// ---------------------- Core 1 tasks ---------------------- //
+// IPC receive. Polls every IPC_POLL_INTERVAL, at the highest application
+// priority on the control core. Each pass records how long after it was due
+// its frames were handled, which is the dispatch latency on top of the poll
+// interval itself (orc_ipc_dispatch_latency_seconds).
+void manageIPC(void *param)
+{
+  (void)param;
+  while (!core0setupComplete) vTaskDelay(pdMS_TO_TICKS(100));
+
+  debug_printf(LOG_INFO, "IPC task started\n");
+
+  // Task loop. The schedule starts just after a tick, so due tracks the
+  // ticks the task is woken at. When it falls behind, vTaskDelayUntil()
+  // runs the missed passes straight away and each is counted as late.
+  vTaskDelay(1);
+  TickType_t lastWake = xTaskGetTickCount();
+  uint64_t due = SystemClock::uptime();
+  while (1) {
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(IPC_POLL_INTERVAL));
+    due += IPC_POLL_INTERVAL * 1000;
+    deadlineMonitor.start(TASK_IPC);
+    ipc.update();
+    uint64_t done = SystemClock::uptime();
+    ipcDispatchLatency.observe(done > due ? (done - due) * 1e-6f : 0);
+    deadlineMonitor.end(TASK_IPC);
+  }
+}
+
+void statusLEDs(void *param)
+{
+  (void)param;
+
+  leds.begin();
+  leds.setBrightness(50);
+  leds.fill(LED_COLOR_OFF, 0, 4);
+  leds.show();
+  debug_printf(LOG_INFO, "LED status task started\n");
+
+  // Task loop. Redraws when setLEDcolour() changes a colour and when the
+  // system status LED blinks, and sleeps in between.
+  bool blinkState = false;
+  TickType_t nextBlink = xTaskGetTickCount();
+  while (1) {
+    deadlineMonitor.start(TASK_LEDS);
+    TickType_t now = xTaskGetTickCount();
+    if ((int32_t)(now - nextBlink) >= 0) {
+      blinkState = !blinkState;
+      nextBlink += pdMS_TO_TICKS(LED_BLINK_INTERVAL);
+      if ((int32_t)(now - nextBlink) >= 0) nextBlink = now + pdMS_TO_TICKS(LED_BLINK_INTERVAL);
+    }
+    StatusVariables current = status.read();
+    for (int i = 0; i < 3; i++) {
+      leds.setPixelColor(i, current.LEDcolour[i]);
+    }
+    leds.setPixelColor(LED_SYSTEM_STATUS, blinkState ? current.LEDcolour[LED_SYSTEM_STATUS] : LED_COLOR_OFF);
+    leds.show();
+    deadlineMonitor.end(TASK_LEDS);
+    int32_t wait = (int32_t)(nextBlink - xTaskGetTickCount());
+    ulTaskNotifyTake(pdTRUE, wait > 0 ? (TickType_t)wait : 0);
+  }
+}
+
+// Time the start of an RTC second and steer the system clock onto it. The
+// MFP square wave output isn't wired, so the seconds register is polled
+// across the tick every millisecond, starting just before the clock expects
+// it. Good to about a millisecond; takes a few ms once the clock is synced,
+// up to a second before. True if the clock was synced, or the time was set
+// meanwhile so the reading was out of date anyway.
+bool syncClockToRtc(void)
+{
+  uint32_t generation = systemClock.generation();
+  int64_t now = systemClock.now();
+  if (now > 0) {
+    uint32_t toTick = (1000000 - (uint32_t)(now % 1000000)) / 1000;
+    if (toTick > CLOCK_SYNC_LEAD) vTaskDelay(pdMS_TO_TICKS(toTick - CLOCK_SYNC_LEAD));
+  }
+
+  uint8_t first, second;
+  uint64_t before = SystemClock::uptime();
+  if (!rtc.getSeconds(first)) return false;
+  uint64_t edge = 0;
+  while (SystemClock::uptime() - before < 1100000) {
+    vTaskDelay(1);
+    uint64_t polled = SystemClock::uptime();
+    if (!rtc.getSeconds(second)) return false;
+    if (second != first) {
+      edge = before + (polled - before) / 2;  // Between the last two reads
+      break;
+    }
+    before = polled;
+  }
+  if (edge == 0) return false;  // RTC not running
+
+  // Still within the second that just started
+  DateTime dt;
+  bool valid;
+  {
+    MetricsTimer timer(rtcReadLatency);
+    valid = rtc.getDateTime(&dt);
+  }
+  if (!valid || dt.second != second) return false;
+  if (!systemClock.discipline((int64_t)dateTimeToEpoch(dt) * 1000000, edge, generation)) return true;
+
+  ClockStats stats = systemClock.stats();
+  clockOffset.set(stats.offset / 1e6f);
+  clockFrequency.set(stats.frequency / 1000.0f);
+  return true;
+}
+
+// Copy the system clock to the RTC, in one I2C write at the start of a
+// second so the RTC's seconds tick lines up with the clock's, then read it
+// back. Only called from the RTC task, which owns the I2C bus.
+bool writeRtcFromClock(void)
+{
+  int64_t now = systemClock.now();
+  if (now <= 0) return false;
+  vTaskDelay(pdMS_TO_TICKS((1000000 - (uint32_t)(now % 1000000)) / 1000));
+
+  uint32_t epoch = (uint32_t)(systemClock.now() / 1000000);
+  DateTime dt = epochToDateTime((time_t)epoch);
+  if (!rtc.setDateTime(dt)) return false;
+  DateTime check;
+  if (!rtc.getDateTime(&check)) return false;
+  uint32_t readBack = dateTimeToEpoch(check);
+  if (readBack - epoch > 1) {  // It may have ticked since
+    debug_printf(LOG_ERROR, "RTC verification failed, read back %04d-%02d-%02d %02d:%02d:%02d, expected %04d-%02d-%02d %02d:%02d:%02d\n",
+                  check.year, check.month, check.day, check.hour, check.minute, check.second,
+                  dt.year, dt.month, dt.day, dt.hour, dt.minute, dt.second);
+    return false;
+  }
+  return true;
+}
+
+void manageRTC(void *param)
+{
+  (void)param;
+  Wire1.setSDA(PIN_RTC_SDA);
+  Wire1.setSCL(PIN_RTC_SCL);
+
+  if (!rtc.begin())
+  {
+    // A task must not return. Park it, reported as failed rather than left
+    // for the watchdog to reset the board over and over.
+    debug_printf(LOG_ERROR, "RTC initialization failed!\n");
+    deadlineMonitor.fail(TASK_RTC);
+    while (1) vTaskDelay(portMAX_DELAY);
+  }
+
+  // Start from a plain read, then line up with the RTC's next tick
   DateTime now;
-  rtc.getDateTime(&now);
-  memcpy(&globalDateTime, &now, sizeof(DateTime)); // Initialize global DateTime directly
-  debug_printf(LOG_INFO, "Current date and time is: %04d-%02d-%02d %02d:%02d:%02d\n",
-                now.year, now.month, now.day, now.hour, now.minute, now.second);
+  if (rtc.getDateTime(&now)) systemClock.set((int64_t)dateTimeToEpoch(now) * 1000000, SystemClock::uptime());
+  if (!syncClockToRtc()) debug_printf(LOG_WARNING, "Failed to sync the clock to the RTC\n");
+  if (getGlobalDateTime(now)) {
+    debug_printf(LOG_INFO, "Current date and time is: %04d-%02d-%02d %02d:%02d:%02d\n",
+                  now.year, now.month, now.day, now.hour, now.minute, now.second);
+  }
                 
   debug_printf(LOG_INFO, "RTC update task started\n");
 
-  // Task loop
+  // Task loop. The time comes from the system clock, the RTC is only read to
+  // keep it in step, less often as the frequency estimate settles, and
+  // written when the time is set. Nothing to do in between.
+  uint32_t interval = CLOCK_SYNC_MIN_INTERVAL;
+  uint64_t nextSync = SystemClock::uptime() + interval * 1000000ull;
+  uint8_t writeAttempts = 0;
   while (1)
   {
-    DateTime currentTime;
-    if (rtc.getDateTime(&currentTime))
-    {
-      // Only update global time if it hasn't been modified recently
-      if (xSemaphoreTake(dateTimeMutex, pdMS_TO_TICKS(100)) == pdTRUE)
-      {
-        memcpy(&globalDateTime, &currentTime, sizeof(DateTime));
-        xSemaphoreGive(dateTimeMutex);
+    deadlineMonitor.start(TASK_RTC);
+    if (writeAttempts > 0) {
+      if (writeRtcFromClock()) {
+        debug_printf(LOG_INFO, "RTC written and verified\n");
+        rtcWriteSuccess.inc();
+        writeAttempts = 0;
       }
+      else if (--writeAttempts == 0) {
+        debug_printf(LOG_ERROR, "Failed to set RTC time after %d attempts\n", RTC_WRITE_ATTEMPTS);
+        rtcWriteFailure.inc();
+      }
+      // Then sync back to the RTC's tick, from the shortest interval
+      interval = CLOCK_SYNC_MIN_INTERVAL;
+      nextSync = 0;
     }
-    vTaskDelay(pdMS_TO_TICKS(1000));
+    if (writeAttempts == 0 && SystemClock::uptime() >= nextSync) {
+      if (syncClockToRtc()) {
+        nextSync = SystemClock::uptime() + interval * 1000000ull;
+        if (interval < CLOCK_SYNC_MAX_INTERVAL) interval *= 2;
+      }
+      else {
+        debug_printf(LOG_WARNING, "Failed to sync the clock to the RTC\n");
+        nextSync = SystemClock::uptime() + CLOCK_SYNC_MIN_INTERVAL * 1000000ull;
+      }
+    }
+
+    deadlineMonitor.end(TASK_RTC);
+
+    // Sleep until the next sync, or until the time is set. A write that
+    // failed is tried again straight away (at the next second).
+    TickType_t wait = 0;
+    uint64_t uptime = SystemClock::uptime();
+    if (writeAttempts == 0 && nextSync > uptime) wait = pdMS_TO_TICKS((nextSync - uptime) / 1000 + 1);
+    bool write;
+    if (xQueueReceive(rtcWriteQueue, &write, wait) == pdTRUE) writeAttempts = RTC_WRITE_ATTEMPTS;
+  }
+}
+
+// USB serial receive callback, from TinyUSB in the USB task or interrupt:
+// wake the terminal task
+extern "C" void tud_cdc_rx_cb(uint8_t itf)
+{
+  (void)itf;
+  TaskHandle_t terminal = taskHandles[TASK_TERMINAL];
+  if (terminal == NULL) return;
+  if (portCHECK_IF_IN_ISR()) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(terminal, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+  else xTaskNotifyGive(terminal);
+}
+
+void runTerminalCommand(const char *command)
+{
+  debug_printf(LOG_INFO, "Received:  %s\n", command);
+  if (strcmp(command, "ps") == 0) {
+    osDebugPrint();
+  }
+  else if (strcmp(command, "top") == 0) {
+    // Redrawn in place each profiler sample, written straight to the
+    // port in one go so debug lines only land between redraws. Input wakes
+    // the task, so enter stops it at once.
+    static char screen[TOP_SCREEN_SIZE];
+    while (Serial.available()) Serial.read();
+    while (!Serial.available()) {
+      size_t len = formatTop(screen, sizeof(screen));
+      Serial.write((const uint8_t *)screen, len);
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PROFILER_INTERVAL));
+    }
+    while (Serial.available()) Serial.read();
+  }
+  else if (strcmp(command, "mem") == 0) {
+    reportMemoryBudget();
+  }
+  else if (strcmp(command, "reboot") == 0) {
+    debug_printf(LOG_INFO, "Rebooting now...\n");
+    debug_flush();
+    rp2040.restart();
+  }
+  else if (strcmp(command, "sdeject") == 0) {
+    debug_printf(LOG_INFO, "Closing the SD card log, wait for logging to stop before removing the card\n");
+    dataLogger.eject();
+  }
+  else if (strcmp(command, "binlog on") == 0 || strcmp(command, "binlog off") == 0) {
+    // Frames for scripts/decode_debug_log.py instead of text
+    debug_printf(LOG_INFO, "Binary debug output %s\n", command + 7);
+    debug_flush();
+    debugLog.setBinary(command[8] == 'n');
+  }
+  else if (strcmp(command, "ip") == 0) {
+    debug_printf(LOG_INFO, "Ethernet connected, IP address: %s, Gateway: %s\n",
+        eth.localIP().toString().c_str(),
+        eth.gatewayIP().toString().c_str());
+  }
+  else {
+    debug_printf(LOG_INFO, "Unknown command: %s\n", command);
+    debug_printf(LOG_INFO, "Available commands: ps (print OS processes), top (live task CPU and stack use), mem (RAM budget), ip (print IP address), sdeject (close the SD card log), binlog on|off (binary debug output), reboot\n");
   }
 }
 
@@ -976,37 +3071,22 @@ void manageTerminal(void *param)
 
   debug_printf(LOG_INFO, "Terminal task started\n");
 
-  // Task loop
+  // Task loop. Sleeps until USB serial input arrives (tud_cdc_rx_cb()), then
+  // runs each complete line. Overlong lines are cut short.
+  char line[TERMINAL_LINE_SIZE];
+  size_t length = 0;
   while (1) {
-    if (Serial.available())
-    {
-      char serialString[10];  // Buffer for incoming serial data
-      memset(serialString, 0, sizeof(serialString));
-      int bytesRead = Serial.readBytesUntil('\n', serialString, sizeof(serialString) - 1); // Leave room for null terminator
-      if (bytesRead > 0 ) {
-          serialString[bytesRead] = '\0'; // Add null terminator
-          debug_printf(LOG_INFO, "Received:  %s\n", serialString);
-          if (strcmp(serialString, "ps") == 0) {
-            osDebugPrint();
-          }
-          else if (strcmp(serialString, "reboot") == 0) {
-            debug_printf(LOG_INFO, "Rebooting now...\n");
-            rp2040.restart();
-          }
-          else if (strcmp(serialString, "ip") == 0) {
-            debug_printf(LOG_INFO, "Ethernet connected, IP address: %s, Gateway: %s\n",
-                eth.localIP().toString().c_str(),
-                eth.gatewayIP().toString().c_str());
-          }
-          else {
-            debug_printf(LOG_INFO, "Unknown command: %s\n", serialString);
-            debug_printf(LOG_INFO, "Available commands: ps (print OS processes), ip (print IP address), reboot\n");
-          }
-        }
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TERMINAL_IDLE_TIMEOUT));
+    while (Serial.available()) {
+      int c = Serial.read();
+      if (c == '\r' || c == '\n') {
+        if (length == 0) continue;
+        line[length] = '\0';
+        length = 0;
+        runTerminalCommand(line);
+      }
+      else if (length < sizeof(line) - 1) line[length++] = (char)c;
     }
-    // Clear the serial buffer each loop.
-    while(Serial.available()) Serial.read();
-    vTaskDelay(pdMS_TO_TICKS(100));
   }
 }
 
@@ -1022,6 +3102,7 @@ void managePower(void *param) {
 
   // Task loop
   while (1) {
+    deadlineMonitor.start(TASK_POWER);
     Vpsu = V20 = V5 = 0.0;
     for (int i = 0; i < 10; i++) {
       Vpsu += (float)analogRead(PIN_PS_24V_FB) * V_PSU_MUL_V;
@@ -1051,15 +3132,107 @@ void managePower(void *param) {
       setLEDcolour(LED_SYSTEM_STATUS, LED_STATUS_WARNING);
     }
     else setLEDcolour(LED_SYSTEM_STATUS, LED_STATUS_OK);
-    if (xSemaphoreTake(statusMutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-      status.Vpsu = Vpsu;
-      status.V20 = V20;
-      status.V5 = V5;
-      status.psuOK = psuOK;
-      status.V20OK = V20OK;
-      status.V5OK = V5OK;
-      xSemaphoreGive(statusMutex);
-    };
+    psuVoltage24.set(Vpsu);
+    psuVoltage20.set(V20);
+    psuVoltage5.set(V5);
+    status.update([&](StatusVariables &s) {
+      s.Vpsu = Vpsu;
+      s.V20 = V20;
+      s.V5 = V5;
+      s.psuOK = psuOK;
+      s.V20OK = V20OK;
+      s.V5OK = V5OK;
+    });
+    updateProcessImage([&](ProcessImage &image) {
+      image.power = {Vpsu, V20, V5, psuOK, V20OK, V5OK};
+    });
+    deadlineMonitor.end(TASK_POWER);
     vTaskDelay(pdMS_TO_TICKS(1000));
   }
-}
\ No newline at end of file
+}
+
+// Sample task CPU and stack use for top, /api/tasks and /metrics
+void manageProfiler(void *param)
+{
+  (void)param;
+  TickType_t lastWake = xTaskGetTickCount();
+  while (1) {
+    deadlineMonitor.start(TASK_PROFILER);
+    taskProfiler.sample();
+    deadlineMonitor.end(TASK_PROFILER);
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(PROFILER_INTERVAL));
+  }
+}
+
+// Checks the task deadlines every DEADLINE_CHECK_INTERVAL and feeds the
+// hardware watchdog while the critical tasks keep to them. Once one has
+// stalled the board resets WATCHDOG_TIMEOUT later, unless it recovers
+// first; the stalled task is left in watchdog scratch 0 for the next boot to
+// report. Runs above every other application task on whichever core is
+// free, so a task spinning on one core doesn't stop the checks.
+void manageWatchdog(void *param)
+{
+  (void)param;
+  while (!core1setupComplete || !core0setupComplete) vTaskDelay(pdMS_TO_TICKS(100));
+
+  rp2040.wdt_begin(WATCHDOG_TIMEOUT);
+  debug_printf(LOG_INFO, "Watchdog task started, hardware watchdog %u ms\n", WATCHDOG_TIMEOUT);
+
+  // Task loop
+  bool wasStalled[NUM_TASKS] = {};
+  bool escalated = false;
+  while (1) {
+    uint8_t stalled;
+    bool healthy = deadlineMonitor.check(stalled);
+    if (healthy) rp2040.wdt_reset();
+
+    // Report tasks as they stall and recover
+    for (uint8_t task = 0; task < NUM_TASKS; task++) {
+      DeadlineStats stats;
+      if (!deadlineMonitor.stats(task, stats) || stats.stalled == wasStalled[task]) continue;
+      wasStalled[task] = stats.stalled;
+      if (stats.failed) debug_printf(LOG_ERROR, "Task %s failed and stopped\n", stats.name);
+      else if (stats.stalled) debug_printf(stats.critical ? LOG_ERROR : LOG_WARNING, "Task %s stalled\n", stats.name);
+      else debug_printf(LOG_INFO, "Task %s running again\n", stats.name);
+    }
+    if (!healthy && !escalated) {
+      watchdog_hw->scratch[0] = WATCHDOG_STALL_MAGIC | stalled;
+      debug_printf(LOG_ERROR, "Watchdog no longer fed, resetting in %u ms\n", WATCHDOG_TIMEOUT);
+    }
+    else if (healthy && escalated) watchdog_hw->scratch[0] = 0;
+    escalated = !healthy;
+    vTaskDelay(pdMS_TO_TICKS(DEADLINE_CHECK_INTERVAL));
+  }
+}
+
+void manageLogger(void *param) {
+  (void)param;
+  SPI1.setSCK(PIN_SD_SCK);
+  SPI1.setTX(PIN_SD_MOSI);
+  SPI1.setRX(PIN_SD_MISO);
+  static const char *channelNames[HISTORY_CHANNELS];
+  for (uint8_t ch = 0; ch < HISTORY_CHANNELS; ch++) channelNames[ch] = historyChannels[ch].name;
+  dataLogger.begin(channelNames, HISTORY_CHANNELS);
+  while (!core1setupComplete || !core0setupComplete) vTaskDelay(pdMS_TO_TICKS(100));
+
+  debug_printf(LOG_INFO, "SD card logger task started\n");
+
+  // Task loop
+  bool logging = false;
+  uint32_t writeErrors = 0;
+  while (1) {
+    deadlineMonitor.start(TASK_LOGGER);
+    dataLogger.service();
+    if (dataLogger.logging() != logging) {
+      logging = dataLogger.logging();
+      if (logging) debug_printf(LOG_INFO, "Logging to SD card: %s\n", dataLogger.fileName());
+      else debug_printf(LOG_WARNING, "SD card logging stopped\n");
+    }
+    if (dataLogger.stats().writeErrors != writeErrors) {
+      writeErrors = dataLogger.stats().writeErrors;
+      debug_printf(LOG_ERROR, "SD card write failed\n");
+    }
+    deadlineMonitor.end(TASK_LOGGER);
+    vTaskDelay(pdMS_TO_TICKS(LOGGER_TASK_INTERVAL));
+  }
+}
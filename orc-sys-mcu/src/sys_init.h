@@ -1,5 +1,6 @@
 // Include libraries
 #include <Arduino.h>
+#include <hardware/watchdog.h>
 #include "FreeRTOS.h"
 #include "task.h"
 #include "semphr.h"
@@ -13,6 +14,18 @@
 #include <NTPClient.h>
 #include "IPCProtocol.h"
 #include "IPCDataStructs.h"
+#include "TimeSeries.h"
+#include "Metrics.h"
+#include "DebugLog.h"
+#include "Snapshot.h"
+#include "SystemClock.h"
+#include "TaskProfiler.h"
+#include "DeadlineMonitor.h"
+#include "DataLogger.h"
+#include "LogReader.h"
+#ifdef WEB_ASSETS_EMBEDDED
+#include "web_assets_embedded.h"  // Generated by scripts/web_assets.py
+#endif
 
 // Hardware pin definitions
 
@@ -77,6 +90,7 @@
 #define LED_WEBSERVER_STATUS 1
 #define LED_MODBUS_STATUS 2
 #define LED_SYSTEM_STATUS 3
+#define LED_BLINK_INTERVAL 500  // ms, system status LED on and off
 
 // LED status numbers
 #define STATUS_STARTUP 0
@@ -101,9 +115,70 @@
 // Timing defines
 #define NTP_MIN_SYNC_INTERVAL 70000
 #define NTP_UPDATE_INTERVAL 600000  // 10 minutes - 1 day = 86400000ms
+#define CLOCK_SYNC_MIN_INTERVAL 16  // Seconds between syncs to the RTC, doubling from the first up to the second
+#define CLOCK_SYNC_MAX_INTERVAL 64
+#define CLOCK_SYNC_LEAD 20          // ms before the expected RTC tick to start polling for it
+#define RTC_WRITE_ATTEMPTS 3        // Seconds in a row to try writing the RTC before giving up
+#define NETWORK_POLL_INTERVAL 100   // ms between Ethernet link checks
+#define IPC_POLL_INTERVAL 1         // ms between IPC receive polls (about 12 bytes arrive per ms at 115200 baud)
 
-// Buffer sizes
-#define DEBUG_PRINTF_BUFFER_SIZE 256
+// Debug output
+#define DEBUG_DRAIN_INTERVAL 10         // ms between checks for queued lines
+#define DEBUG_FLUSH_TIMEOUT 500         // ms to let queued lines out before a reboot
+
+// Web server
+#define WEB_MAX_ASSETS 16
+#define WEB_ASSET_MANIFEST "/manifest.json"
+#define WEB_CACHE_IMMUTABLE "public, max-age=31536000, immutable"
+#define WEB_CACHE_REVALIDATE "no-cache"
+#define RESPONSE_CHUNK_SIZE 512
+#define HTTP_TASK_POLL_INTERVAL 1     // ms between WebServer polls
+
+// Live port: event stream (Server-Sent Events) and API routes on persistent connections
+#define LIVE_PORT 81
+#define LIVE_MAX_CONNECTIONS 6
+#define LIVE_REQUEST_TIMEOUT 2000     // ms to receive a complete request header
+#define LIVE_KEEPALIVE_TIMEOUT 5000   // ms an idle connection is kept open
+#define LIVE_MAX_REQUESTS 100         // Requests per connection before it is closed
+#define LIVE_PIPELINE_DEPTH 4         // Pipelined requests answered per connection per pass
+#define EVENTS_MAX_SUBSCRIBERS 3      // Connections event streams may use, the rest are kept for API requests
+#define EVENTS_PUSH_INTERVAL 1000
+#define EVENTS_GROUP_SIZE 192
+#define EVENTS_PAYLOAD_SIZE 900
+
+// Sensor history
+#define HISTORY_CHANNELS 9
+#define HISTORY_DEFAULT_SPAN 86400    // Seconds covered when the request has no from
+#define HISTORY_DEFAULT_POINTS 300
+#define HISTORY_MAX_POINTS 400
+
+// Binary telemetry (/api/bin/...)
+#define TELEMETRY_MIME_PACKED "application/vnd.orc.telemetry"
+#define TELEMETRY_MIME_CBOR "application/cbor"
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_STATE 1
+#define TELEMETRY_HISTORY 2
+
+// SD card data logger
+#define LOGGER_TASK_INTERVAL 100      // ms between queue drains
+#define LOG_EXPORT_DEFAULT_SPAN 3600  // Seconds exported when the request has no from
+#define LOG_EXPORT_MAX_ROWS 1000      // CSV rows per export response, see apiLogExport()
+
+// Metrics (/metrics, Prometheus text format)
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+
+// Serial terminal
+#define TERMINAL_LINE_SIZE 16
+#define TERMINAL_IDLE_TIMEOUT 1000    // ms, checks for input even without a USB receive notification
+
+// Task profiler (terminal "top", /api/tasks)
+#define PROFILER_INTERVAL 1000        // ms between samples
+#define TOP_SCREEN_SIZE 1536
+
+// Deadline monitor and watchdog (/api/deadlines)
+#define DEADLINE_CHECK_INTERVAL 100   // ms between checks, each feeding the hardware watchdog
+#define WATCHDOG_TIMEOUT 2000         // ms without feeding before the hardware watchdog resets
+#define WATCHDOG_STALL_MAGIC 0x57444700 // In watchdog scratch 0 with the stalled task, across the reset
 
 // Log entry types
 #define LOG_INFO 0
@@ -116,7 +191,9 @@ Adafruit_NeoPixel leds(4, PIN_LED_DAT, NEO_GRB + NEO_KHZ800);
 MCP79410 rtc(Wire1);
 Wiznet5500lwIP eth(PIN_ETH_CS, SPI, PIN_ETH_IRQ);
 WebServer server(80);
+WiFiServer liveServer(LIVE_PORT);
 IPCProtocol ipc(Serial1);
+DataLogger dataLogger(SPI1, PIN_SD_CS, PIN_SD_CD);
 
 // FreeRTOS defines
 
@@ -154,30 +231,286 @@ struct StatusVariables
     bool V5OK;
 };
 
+// Static web asset (from the manifest written by scripts/web_assets.py)
+struct WebAsset
+{
+    char path[32];
+    char etag[20];   // Quoted content hash of the file
+    char gzEtag[20]; // Quoted content hash of the .gz variant, empty if there is none
+    const char *contentType;
+    char version[9]; // v= of fingerprinted references, empty if it is never cacheable indefinitely
+};
+
+// Process image: a consistent copy of all reactor state, double buffered so
+// readers can take a snapshot while a writer prepares the next one
+struct ReactorSensors
+{
+    PowerSensor power;
+    TemperatureSensor temperature;
+    PHSensor ph;
+    DissolvedOxygenSensor dissolvedOxygen;
+    OpticalDensitySensor opticalDensity;
+    GasFlowSensor gasFlow;
+    PressureSensor pressure;
+    StirrerSpeedSensor stirrerSpeed;
+    WeightSensor weight;
+};
+
+struct ReactorControls
+{
+    TemperatureControl temperature;
+    PHControl ph;
+    DissolvedOxygenControl dissolvedOxygen;
+    GasFlowControl gasFlow;
+    StirrerSpeedControl stirrerSpeed;
+    PumpSpeedControl pumpSpeed;
+    FeedControl feed;
+    WasteControl waste;
+};
+
+struct PowerStatus
+{
+    float Vpsu;
+    float V20;
+    float V5;
+    bool psuOK;
+    bool V20OK;
+    bool V5OK;
+};
+
+struct LinkStatus
+{
+    bool connected;
+    uint8_t ip[4];
+};
+
+struct ProcessImage
+{
+    uint32_t version; // Incremented on every update
+    DateTime time;    // Filled in from the system clock by getProcessImage()
+    ReactorSensors sensors;
+    ReactorControls controls;
+    PowerStatus power;
+    LinkStatus link;
+};
+
+// Process image groups, used for field selection
+#define IMAGE_TIME     (1 << 0)
+#define IMAGE_SENSORS  (1 << 1)
+#define IMAGE_CONTROLS (1 << 2)
+#define IMAGE_POWER    (1 << 3)
+#define IMAGE_LINK     (1 << 4)
+#define IMAGE_ALL      0x1F
+
+// Binary telemetry records, packed little-endian. The layout of a given
+// TELEMETRY_VERSION never changes, fields follow IPCDataStructs.h.
+struct __attribute__((packed)) TelemetryHeader
+{
+    uint8_t magic[2];   // 'O', 'R'
+    uint8_t version;    // TELEMETRY_VERSION
+    uint8_t type;       // TELEMETRY_STATE or TELEMETRY_HISTORY
+    uint32_t length;    // Bytes following the header
+};
+
+struct __attribute__((packed)) TelemetryPowerSensor
+{
+    float volts;
+    float amps;
+    float watts;
+    uint8_t online;
+};
+
+// Sensors with a single value (temperature, pH, DO, OD, gas flow, pressure, stirrer speed, weight)
+struct __attribute__((packed)) TelemetrySensor
+{
+    float value;
+    uint8_t online;
+};
+
+// Temperature, gas flow and stirrer speed loops
+struct __attribute__((packed)) TelemetryPIDControl
+{
+    float setpoint;
+    uint8_t enabled;
+    float kp;
+    float ki;
+    float kd;
+};
+
+struct __attribute__((packed)) TelemetryPHControl
+{
+    float setpoint;
+    uint8_t enabled;
+    float period;
+    float maxDoseTime;
+};
+
+// DO lookup tables are configuration and are left out, as in /api/state
+struct __attribute__((packed)) TelemetryDOControl
+{
+    float setpoint;
+    uint8_t enabled;
+};
+
+// Feed and waste pumps
+struct __attribute__((packed)) TelemetryDutyControl
+{
+    float period;
+    float duty;
+    uint8_t enabled;
+};
+
+struct __attribute__((packed)) TelemetryState
+{
+    uint32_t version;   // Process image version
+    uint32_t time;      // RTC local time, seconds since 1970
+    TelemetryPowerSensor power;
+    TelemetrySensor temperature;
+    TelemetrySensor ph;
+    TelemetrySensor dissolvedOxygen;
+    TelemetrySensor opticalDensity;
+    TelemetrySensor gasFlow;
+    TelemetrySensor pressure;
+    TelemetrySensor stirrerSpeed;
+    TelemetrySensor weight;
+    TelemetryPIDControl temperatureControl;
+    TelemetryPHControl phControl;
+    TelemetryDOControl dissolvedOxygenControl;
+    TelemetryPIDControl gasFlowControl;
+    TelemetryPIDControl stirrerSpeedControl;
+    float pumpSpeed;    // Percent
+    TelemetryDutyControl feedControl;
+    TelemetryDutyControl wasteControl;
+    float Vpsu;
+    float V20;
+    float V5;
+    uint8_t powerOK;    // Bit 0: PSU, bit 1: 20V, bit 2: 5V
+    uint8_t connected;
+    uint8_t ip[4];
+};
+static_assert(sizeof(TelemetryState) == 170, "TelemetryState layout changed, bump TELEMETRY_VERSION");
+
+// History record: channel, resolution, then HistoryPoint {u32 time, f32 mean, f32 min, f32 max} per point
+struct __attribute__((packed)) TelemetryHistory
+{
+    uint8_t channel;
+    uint32_t resolution;
+    uint16_t count;
+};
+static_assert(sizeof(HistoryPoint) == 16, "HistoryPoint is sent as-is in binary history records");
+
+// Connection on the live port
+enum LiveConnectionState { LIVE_FREE, LIVE_REQUEST, LIVE_STREAM };
+struct LiveConnection
+{
+    WiFiClient client;
+    LiveConnectionState state;
+    uint32_t lastActivity; // Start of the current request or end of the last response
+    uint16_t requests;     // Requests answered on this connection
+    bool inRequest;        // Part of a request header has been received
+    bool closeAfter;       // Close once the current request is answered
+    bool needsSnapshot;    // Event stream: send the full state rather than a delta on the next push
+    uint8_t lineLen;
+    bool lineOverflow;     // The line being received didn't fit
+    uint16_t rejectCode;   // Answer the request with this error, 0 if it parsed
+    char line[128];        // Header line being received
+    char requestLine[128]; // "GET /path?query HTTP/1.1"
+    char accept[48];       // Start of the Accept header, for binary telemetry
+};
+static_assert(sizeof(LiveConnection::line) >= sizeof(LiveConnection::requestLine),
+              "A request line that fits requestLine must fit line");
+static_assert(sizeof(LiveConnection::line) <= 256, "lineLen is 8 bits");
+
 // Status variables
-StatusVariables status;
-SemaphoreHandle_t statusMutex = NULL;
+Snapshot<StatusVariables> status;
+
+// Debug output queue, written to USB serial by the debug output task
+DebugLog debugLog;
 
-// Serial port mutex
-SemaphoreHandle_t serialMutex = NULL;
+// Thread-safe printf-like logging. Only the format string's address and the
+// argument values are queued, formatting happens in the debug output task
+// (or on the host, see "binlog"), and if the queue is full the line is
+// dropped (and counted) rather than waiting. format must be a string literal.
+template <typename... Args>
+void debug_printf(uint8_t logLevel, const char *format, const Args &...args) {
+  debugLog.log(logLevel, format, args...);
+}
 
-// Global DateTime protection
-SemaphoreHandle_t dateTimeMutex = NULL;
-DateTime globalDateTime;
+// Current date and time, the RP2040 timer disciplined by the RTC
+SystemClock systemClock;
+QueueHandle_t rtcWriteQueue;  // Time set, copy the clock to the RTC (processed by the RTC task)
+StaticQueue_t rtcWriteQueueBuffer;
+uint8_t rtcWriteQueueStorage[sizeof(bool)];
 
-// NTP update queue
+// NTP update queue (forced sync requests, processed by the network task)
 QueueHandle_t ntpUpdateQueue;
+StaticQueue_t ntpUpdateQueueBuffer;
+uint8_t ntpUpdateQueueStorage[sizeof(bool)];
 uint32_t ntpUpdateTimestamp = 0 - NTP_MIN_SYNC_INTERVAL;
 
 // Global variables
 NetworkConfig networkConfig;
 
+// Web assets loaded from the manifest at startup
+WebAsset webAssets[WEB_MAX_ASSETS];
+uint8_t numWebAssets = 0;
+
+// Process image
+Snapshot<ProcessImage> processImage;
+
+// Live port connections
+LiveConnection liveConnections[LIVE_MAX_CONNECTIONS];
+
+// Per-task CPU and stack use, sampled by the profiler task
+TaskProfiler taskProfiler;
+
+// Pass deadlines of the periodic tasks, checked by the watchdog task
+DeadlineMonitor deadlineMonitor;
+
+// Sensor history, fed from IPC sensor messages
+TimeSeries sensorHistory[HISTORY_CHANNELS];
+SemaphoreHandle_t historyMutex = NULL;
+StaticSemaphore_t historyMutexBuffer;
+
+// Metrics. Histogram bounds are in seconds.
+const float httpLatencyBounds[] = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1};
+const float rtcLatencyBounds[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.1};
+const float ipcLatencyBounds[] = {0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.1};
+#define HTTP_LATENCY_METRIC(var, route) \
+  MetricsHistogram var("orc_http_request_duration_seconds", "Time to handle and answer an HTTP request", \
+                       "route=\"" route "\"", httpLatencyBounds, sizeof(httpLatencyBounds) / sizeof(float))
+HTTP_LATENCY_METRIC(httpLatencyState, "/api/state");
+HTTP_LATENCY_METRIC(httpLatencyHistory, "/api/history");
+HTTP_LATENCY_METRIC(httpLatencyBinState, "/api/bin/state");
+HTTP_LATENCY_METRIC(httpLatencyBinHistory, "/api/bin/history");
+HTTP_LATENCY_METRIC(httpLatencyLogExport, "/api/log/export");
+HTTP_LATENCY_METRIC(httpLatencyLogs, "/api/logs");
+HTTP_LATENCY_METRIC(httpLatencyTasks, "/api/tasks");
+HTTP_LATENCY_METRIC(httpLatencyDeadlines, "/api/deadlines");
+HTTP_LATENCY_METRIC(httpLatencyMetrics, "/metrics");
+HTTP_LATENCY_METRIC(httpLatencyStatic, "static");
+MetricsCounter ntpSyncSuccess("orc_ntp_sync_total", "NTP synchronisation attempts", "result=\"success\"");
+MetricsCounter ntpSyncFailure("orc_ntp_sync_total", "NTP synchronisation attempts", "result=\"failure\"");
+MetricsCounter rtcWriteSuccess("orc_rtc_write_total", "RTC writes after the time was set", "result=\"success\"");
+MetricsCounter rtcWriteFailure("orc_rtc_write_total", "RTC writes after the time was set", "result=\"failure\"");
+MetricsHistogram rtcReadLatency("orc_rtc_read_duration_seconds", "Time to read the date and time from the RTC", nullptr,
+                                rtcLatencyBounds, sizeof(rtcLatencyBounds) / sizeof(float));
+MetricsHistogram ipcDispatchLatency("orc_ipc_dispatch_latency_seconds",
+                                    "Time from each due IPC receive poll until its frames are handled", nullptr,
+                                    ipcLatencyBounds, sizeof(ipcLatencyBounds) / sizeof(float));
+MetricsGauge clockOffset("orc_clock_offset_seconds", "RTC minus system clock at the last sync");
+MetricsGauge clockFrequency("orc_clock_frequency_ppm", "Estimated RP2040 timer frequency error against the RTC");
+MetricsGauge psuVoltage24("orc_psu_voltage_volts", "Power supply rail voltage", "rail=\"24v\"");
+MetricsGauge psuVoltage20("orc_psu_voltage_volts", "Power supply rail voltage", "rail=\"20v\"");
+MetricsGauge psuVoltage5("orc_psu_voltage_volts", "Power supply rail voltage", "rail=\"5v\"");
+
 // Device MAC address (stored as string)
 char deviceMacAddress[18];
 
-bool ethernetConnected = false;
+volatile bool ethernetConnected = false; // Written by the network task, read by the HTTP server task
 bool serialReady = false;
 bool core0setupComplete = false, core1setupComplete = false;
 
 // Log entry types
-const char *logType[] = {"INFO", "WARNING", "ERROR", "DEBUG"};
\ No newline at end of file
+const char *logType[] = {"INFO", "WARNING", "ERROR", "DEBUG"};
+const uint8_t logSeverity[] = {1, 2, 3, 0}; // Of each type, for filtering
\ No newline at end of file
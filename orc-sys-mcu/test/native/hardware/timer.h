@@ -0,0 +1,13 @@
+#ifndef NATIVE_HARDWARE_TIMER_H
+#define NATIVE_HARDWARE_TIMER_H
+
+// The RP2040's µs timer, for the host tests: a count the tests set
+
+#include <stdint.h>
+
+inline volatile uint64_t nativeMicros = 0;
+
+inline uint32_t time_us_32() { return (uint32_t)nativeMicros; }
+inline uint64_t time_us_64() { return nativeMicros; }
+
+#endif /* NATIVE_HARDWARE_TIMER_H */
@@ -0,0 +1,134 @@
+// DeadlineMonitor on the host, with the µs counter wrapping part way: late
+// starts and overruns are counted, check() only reports critical tasks that
+// have stalled, and a failed task shows as stalled without escalating.
+
+#include <unity.h>
+#include <hardware/timer.h>
+#include "DeadlineMonitor.h"
+
+enum { TASK_SLOW = 1, TASK_RTC = 2, TASK_LEDS = 3 };
+
+static DeadlineMonitor *monitor;
+
+void setUp(void) {
+    static DeadlineMonitor instance;
+    instance = DeadlineMonitor();
+    monitor = &instance;
+    nativeMicros = 0xFFFF0000u;  // Wraps within the first passes
+}
+
+void tearDown(void) {}
+
+static void pass(uint8_t id, uint32_t execution, uint32_t gap) {
+    monitor->start(id);
+    nativeMicros += execution;
+    monitor->end(id);
+    nativeMicros += gap;
+}
+
+void test_only_known_ids_are_watched(void) {
+    TEST_ASSERT_FALSE(monitor->watch(DEADLINE_MAX_TASKS, "none", 1000, 100, true));
+    DeadlineStats stats;
+    TEST_ASSERT_FALSE(monitor->stats(TASK_RTC, stats));
+    monitor->start(TASK_RTC);  // Ignored, not watched
+    uint8_t stalled = 0xFF;
+    TEST_ASSERT_TRUE(monitor->check(stalled));
+    TEST_ASSERT_EQUAL_UINT8(0xFF, stalled);
+}
+
+void test_lateness_and_overruns_across_wrap(void) {
+    monitor->watch(TASK_RTC, "rtc", 100000, 10000, true);
+    for (int i = 0; i < 10; i++) pass(TASK_RTC, 2000, 100000);
+    pass(TASK_RTC, 20000, 100000 + 5000);   // Overrun, then the next starts 5 ms late
+    pass(TASK_RTC, 1000, 100000 + 200000);  // Then 200 ms late
+    monitor->start(TASK_RTC);
+
+    DeadlineStats stats;
+    TEST_ASSERT_TRUE(monitor->stats(TASK_RTC, stats));
+    TEST_ASSERT_EQUAL_STRING("rtc", stats.name);
+    TEST_ASSERT_EQUAL_UINT32(12, stats.passes);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.overruns);
+    TEST_ASSERT_EQUAL_UINT32(20000, stats.maxExecution);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.late);
+    TEST_ASSERT_EQUAL_UINT32(200000, stats.maxLateness);
+    TEST_ASSERT_EQUAL_UINT32(10, stats.lateness[0]);  // On time
+    TEST_ASSERT_EQUAL_UINT32(1, stats.lateness[2]);   // Up to 10 ms
+    TEST_ASSERT_EQUAL_UINT32(1, stats.lateness[4]);   // Up to 1 s
+}
+
+// A task counts as stalled once it is overdue by more than its period and
+// budget together, and at least DEADLINE_MIN_STALL
+void test_stalled_critical_task_is_reported(void) {
+    monitor->watch(TASK_RTC, "rtc", 100000, 10000, true);
+    monitor->watch(TASK_LEDS, "leds", 500000, 1000, false);
+    uint8_t stalled = 0xFF;
+    TEST_ASSERT_TRUE(monitor->check(stalled));  // Not started yet
+
+    pass(TASK_LEDS, 100, 0);
+    pass(TASK_RTC, 1000, 100000);  // Due now
+    nativeMicros += DEADLINE_MIN_STALL;
+    TEST_ASSERT_TRUE(monitor->check(stalled));
+    nativeMicros += 1;
+    TEST_ASSERT_FALSE(monitor->check(stalled));
+    TEST_ASSERT_EQUAL_UINT8(TASK_RTC, stalled);
+
+    DeadlineStats stats;
+    monitor->stats(TASK_RTC, stats);
+    TEST_ASSERT_TRUE(stats.stalled);
+    monitor->stats(TASK_LEDS, stats);
+    TEST_ASSERT_FALSE(stats.stalled);  // Overdue, but by less than its limit
+
+    // Stalled as well once past it, but it isn't critical
+    nativeMicros += 500000;
+    TEST_ASSERT_FALSE(monitor->check(stalled));
+    TEST_ASSERT_EQUAL_UINT8(TASK_RTC, stalled);
+    monitor->stats(TASK_LEDS, stats);
+    TEST_ASSERT_TRUE(stats.stalled);
+
+    // Recovers on its next pass
+    monitor->start(TASK_RTC);
+    TEST_ASSERT_TRUE(monitor->check(stalled));
+    monitor->stats(TASK_RTC, stats);
+    TEST_ASSERT_FALSE(stats.stalled);
+}
+
+// Stuck in a pass: measured from the start of the pass against the budget
+void test_stuck_in_pass_stalls(void) {
+    monitor->watch(TASK_SLOW, "slow", 5000000, 3000000, true);
+    monitor->start(TASK_SLOW);
+    uint8_t stalled;
+    nativeMicros += 3000000 + 8000000;
+    TEST_ASSERT_TRUE(monitor->check(stalled));
+    nativeMicros += 1;
+    TEST_ASSERT_FALSE(monitor->check(stalled));
+    TEST_ASSERT_EQUAL_UINT8(TASK_SLOW, stalled);
+}
+
+void test_failed_task_does_not_escalate(void) {
+    monitor->watch(TASK_SLOW, "rtc", 64000000, 3000000, true);
+    monitor->watch(TASK_RTC, "ipc", 1000, 10000, true);
+    monitor->fail(TASK_SLOW);
+    pass(TASK_RTC, 10, 0);
+    uint8_t stalled = 0xFF;
+    TEST_ASSERT_TRUE(monitor->check(stalled));
+
+    DeadlineStats stats;
+    monitor->stats(TASK_SLOW, stats);
+    TEST_ASSERT_TRUE(stats.stalled);
+    TEST_ASSERT_TRUE(stats.failed);
+
+    // Other critical tasks are still watched
+    nativeMicros += 1000 + DEADLINE_MIN_STALL + 1;
+    TEST_ASSERT_FALSE(monitor->check(stalled));
+    TEST_ASSERT_EQUAL_UINT8(TASK_RTC, stalled);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_only_known_ids_are_watched);
+    RUN_TEST(test_lateness_and_overruns_across_wrap);
+    RUN_TEST(test_stalled_critical_task_is_reported);
+    RUN_TEST(test_stuck_in_pass_stalls);
+    RUN_TEST(test_failed_task_does_not_escalate);
+    return UNITY_END();
+}
@@ -0,0 +1,206 @@
+// DebugLog rings and history, on the host: lines come out whole and in
+// order, a full ring drops rather than overwrites, and history readers skip
+// what drain() overwrote, also while a producer and drain() run alongside.
+
+#include <unity.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "DebugLog.h"
+
+static const char *const levelNames[] = {"INFO", "WARNING", "ERROR", "DEBUG"};
+static const char padding[] = "padpadpadpadpadpad";
+
+struct StringPrint : Print {
+    std::string text;
+    size_t write(uint8_t c) override {
+        text.push_back((char)c);
+        return 1;
+    }
+};
+
+// Line numbers from "[INFO] line <n> ..." lines, false if one is out of order
+static bool linesInOrder(const std::string &text, int &count) {
+    int previous = -1;
+    count = 0;
+    for (size_t pos = text.find("[INFO] line "); pos != std::string::npos; pos = text.find("[INFO] line ", pos + 1)) {
+        int n = atoi(text.c_str() + pos + 12);
+        if (n <= previous) return false;
+        previous = n;
+        count++;
+    }
+    return true;
+}
+
+void setUp(void) {
+    nativeMicros = 1000;
+}
+
+void tearDown(void) {}
+
+void test_lines_come_out_in_order(void) {
+    static DebugLog log;
+    log.setLevelNames(levelNames, 4);
+    StringPrint out;
+    int queued = 0;
+    for (int round = 0; round < 200; round++) {
+        for (int i = 0; i < round % 37; i++) {
+            nativeMicros += 3;
+            if (i & 1) log.printf(0, "line %d %.*s\n", queued++, round % 17, padding);
+            else log.log(0, "line %d %s\n", queued++, padding + round % 17);
+        }
+        log.drain(out);
+    }
+    int count;
+    TEST_ASSERT_TRUE(linesInOrder(out.text, count));
+    TEST_ASSERT_EQUAL_INT(queued, count);
+    DebugLogStats stats = log.stats();
+    TEST_ASSERT_EQUAL_UINT32(queued, stats.lines);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.dropped);
+    TEST_ASSERT_TRUE(log.empty());
+}
+
+void test_full_ring_drops_and_counts(void) {
+    static DebugLog log;
+    log.setLevelNames(levelNames, 4);
+    int queued = 0, dropped = 0;
+    for (int i = 0; i < 1000; i++) {
+        if (log.log(0, "line %d %s\n", i, padding)) queued++;
+        else dropped++;
+    }
+    TEST_ASSERT_GREATER_THAN(0, dropped);
+    TEST_ASSERT_EQUAL_UINT32(dropped, log.stats().dropped);
+    TEST_ASSERT_LESS_OR_EQUAL(DEBUG_LOG_RING_SIZE, log.stats().maxUsed);
+
+    // What was queued comes out whole, and the ring takes lines again
+    StringPrint out;
+    log.drain(out);
+    int count;
+    TEST_ASSERT_TRUE(linesInOrder(out.text, count));
+    TEST_ASSERT_EQUAL_INT(queued, count);
+    TEST_ASSERT_TRUE(log.log(0, "line %d\n", 1000));
+}
+
+void test_long_printf_is_truncated(void) {
+    static DebugLog log;
+    log.setLevelNames(levelNames, 4);
+    char text[DEBUG_LOG_MAX_LINE * 2];
+    memset(text, 'a', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    TEST_ASSERT_TRUE(log.printf(2, "%s", text));
+    StringPrint out;
+    log.drain(out);
+    TEST_ASSERT_EQUAL(strlen("[ERROR] ") + DEBUG_LOG_MAX_LINE - 2, out.text.size());
+}
+
+void test_history_skips_overwritten_lines(void) {
+    static DebugLog log;
+    log.setLevelNames(levelNames, 4);
+    StringPrint out;
+    for (int i = 0; i < 2000; i++) {
+        log.log(i % 4, "%d %s\n", i, padding + i % 17);
+        if (i % 7 == 0) log.drain(out);
+    }
+    log.drain(out);
+    TEST_ASSERT_EQUAL_UINT32(2000, log.historyNext());
+    TEST_ASSERT_GREATER_THAN(0, log.historyFirst());
+
+    // A cursor from before the oldest line starts at the oldest line
+    uint32_t cursor = 5;
+    DebugLogEntry entry;
+    TEST_ASSERT_TRUE(log.readHistory(cursor, 0xF, entry));
+    TEST_ASSERT_EQUAL_UINT32(log.historyFirst(), entry.seq);
+    uint32_t expected = entry.seq + 1;
+    while (log.readHistory(cursor, 0xF, entry)) {
+        TEST_ASSERT_EQUAL_UINT32(expected, entry.seq);
+        TEST_ASSERT_EQUAL_INT(entry.seq, atoi(entry.text));
+        TEST_ASSERT_EQUAL_UINT8(entry.seq % 4, entry.level);
+        expected++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(log.historyNext(), expected);
+
+    // Only the levels asked for
+    cursor = 0;
+    while (log.readHistory(cursor, 1u << 2, entry)) TEST_ASSERT_EQUAL_UINT8(2, entry.level);
+}
+
+// Records of every size, so the free space at the end of the history takes
+// every value, and nothing is read from past it
+void test_history_wraps_at_every_offset(void) {
+    static DebugLog log;
+    log.setLevelNames(levelNames, 4);
+    StringPrint out;
+    for (int i = 0; i < 5000; i++) {
+        log.printf(0, "%d %.*s\n", i, i * 7 % (DEBUG_LOG_MAX_LINE - 16), "");
+        log.printf(0, "%d %s\n", i, padding + i % 17);
+        log.drain(out);
+        out.text.clear();
+        uint32_t cursor = 0, lines = 0;
+        DebugLogEntry entry;
+        while (log.readHistory(cursor, 0xF, entry)) {
+            TEST_ASSERT_EQUAL_INT(entry.seq / 2, atoi(entry.text));
+            lines++;
+        }
+        TEST_ASSERT_EQUAL_UINT32(log.historyNext() - log.historyFirst(), lines);
+    }
+}
+
+// A producer, drain() and a history reader at the same time, as the tasks
+// would be. Every line is checked for tearing against what was logged.
+static DebugLog stressLog;
+static std::atomic<bool> producing{false}, draining{false};
+
+void test_concurrent_producer_drain_and_reader(void) {
+    stressLog.setLevelNames(levelNames, 4);
+    producing = true;
+    draining = true;
+    std::thread producer([] {
+        for (int i = 0; i < 200000; i++) {
+            if (i & 1) stressLog.log(0, "%d %s\n", i, padding + i % 17);
+            else stressLog.printf(0, "%d %s\n", i, padding + i % 17);
+        }
+        producing = false;
+    });
+    std::thread drainer([] {
+        StringPrint out;
+        while (producing || !stressLog.empty()) {
+            stressLog.drain(out);
+            out.text.clear();
+        }
+        draining = false;
+    });
+
+    uint32_t cursor = 0, previousSeq = 0, lines = 0, bad = 0;
+    int previous = -1;
+    DebugLogEntry entry;
+    while (draining || stressLog.readHistory(cursor, 0xF, entry)) {
+        while (stressLog.readHistory(cursor, 0xF, entry)) {
+            int n = atoi(entry.text);
+            char expected[64];
+            snprintf(expected, sizeof(expected), "%d %s\n", n, padding + n % 17);
+            if (strcmp(entry.text, expected) != 0 || n <= previous || (lines > 0 && entry.seq <= previousSeq)) bad++;
+            previous = n;
+            previousSeq = entry.seq;
+            lines++;
+        }
+    }
+    producer.join();
+    drainer.join();
+
+    TEST_ASSERT_EQUAL_UINT32(0, bad);
+    TEST_ASSERT_GREATER_THAN(0, lines);
+    DebugLogStats stats = stressLog.stats();
+    TEST_ASSERT_EQUAL_UINT32(200000, stats.lines + stats.dropped);
+    TEST_ASSERT_EQUAL_UINT32(stats.lines, stressLog.historyNext());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_lines_come_out_in_order);
+    RUN_TEST(test_full_ring_drops_and_counts);
+    RUN_TEST(test_long_printf_is_truncated);
+    RUN_TEST(test_history_skips_overwritten_lines);
+    RUN_TEST(test_history_wraps_at_every_offset);
+    RUN_TEST(test_concurrent_producer_drain_and_reader);
+    return UNITY_END();
+}
@@ -0,0 +1,165 @@
+// DebugLog formatting and binary frames, on the host: tokenized lines print
+// as printf would (and as scripts/decode_debug_log.py renders them), specs
+// too long for the device's buffer print "(?)", and binary mode frames
+// decode back to the text mode lines.
+
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "DebugLog.h"
+
+static const char *const levelNames[] = {"INFO", "WARNING", "ERROR", "DEBUG"};
+
+struct StringPrint : Print {
+    std::string text;
+    size_t write(uint8_t c) override {
+        text.push_back((char)c);
+        return 1;
+    }
+};
+
+static DebugLog debugLog;
+
+// Drain what was logged as text
+static std::string drained(void) {
+    StringPrint out;
+    debugLog.drain(out);
+    return out.text;
+}
+
+// COBS decoding as in scripts/decode_debug_log.py, false if the frame is malformed
+static bool cobsDecode(const std::string &frame, std::string &data) {
+    data.clear();
+    size_t i = 0;
+    while (i < frame.size()) {
+        uint8_t code = frame[i];
+        if (code == 0 || i + code > frame.size() + 1) return false;
+        data.append(frame, i + 1, code - 1);
+        i += code;
+        if (code != 0xFF && i < frame.size()) data.push_back('\0');
+    }
+    return true;
+}
+
+// Zero terminated frames
+static std::vector<std::string> splitFrames(const std::string &stream) {
+    std::vector<std::string> frames;
+    size_t start = 0;
+    for (size_t end = stream.find('\0'); end != std::string::npos; end = stream.find('\0', start)) {
+        frames.push_back(stream.substr(start, end - start));
+        start = end + 1;
+    }
+    return frames;
+}
+
+void setUp(void) {
+    debugLog.setLevelNames(levelNames, 4);
+    debugLog.setBinary(false);
+    nativeMicros = 1000;
+}
+
+void tearDown(void) {
+    drained();
+}
+
+void test_tokenized_arguments_keep_their_types(void) {
+    uint8_t u8 = 200;
+    int16_t s16 = -5;
+    uint64_t u64 = 12345678901234ull;
+    float f = 3.25f;
+    double d = -1.5;
+    const char *null = nullptr;
+    char buffer[] = "buf";
+    debugLog.log(2, "u8=%u s16=%d u64=%llu f=%.2f d=%g s=%s n=%s b=%s|%5d|%-4s|%*d|%%|%x\n",
+                 u8, s16, u64, f, d, "str", null, buffer, 42, "ab", 6, 7, 255u);
+    TEST_ASSERT_EQUAL_STRING("[ERROR] u8=200 s16=-5 u64=12345678901234 f=3.25 d=-1.5 s=str n= b=buf|   42|ab  |     7|%|ff\n",
+                             drained().c_str());
+}
+
+void test_mismatched_conversions_print_the_value(void) {
+    debugLog.log(1, "%d %f %s %d\n", 2.7f, 3, 5);
+    TEST_ASSERT_EQUAL_STRING("[WARNING] 2 3.000000 (?) (?)\n", drained().c_str());
+}
+
+void test_char_conversion(void) {
+    debugLog.log(0, "[%c] [%3c] [%-2c]\n", 'x', 'y', 65);
+    TEST_ASSERT_EQUAL_STRING("[INFO] [x] [  y] [A ]\n", drained().c_str());
+}
+
+void test_star_width_and_precision(void) {
+    debugLog.log(0, "[%*d] [%-*d] [%.*f] [%*.*s]\n", 4, 1, 3, 2, 2, 3.14159, 5, 2, "abcdef");
+    TEST_ASSERT_EQUAL_STRING("[INFO] [   1] [2  ] [3.14] [   ab]\n", drained().c_str());
+}
+
+// The device builds each conversion's spec in a 24 byte buffer
+void test_spec_too_long_prints_placeholder(void) {
+    debugLog.log(0, "[%-+ #0-+*.*d] [%d]\n", -1000000000, -1000000000, 5, 6);
+    TEST_ASSERT_EQUAL_STRING("[INFO] [(?)] [6]\n", drained().c_str());
+    TEST_ASSERT_TRUE(debugLog.log(0, "[%123456789012345678901234d] [%d]\n", 5, 6));
+    TEST_ASSERT_EQUAL_STRING("[INFO] [(?)] [6]\n", drained().c_str());
+}
+
+void test_missing_arguments_and_unknown_level(void) {
+    debugLog.log(9, "%d %d\n", 1);
+    TEST_ASSERT_EQUAL_STRING("[UNKNOWN] 1 (?)\n", drained().c_str());
+}
+
+// Lines whose format isn't in flash go out as text frames, which decode to
+// the text mode line. Time and text both contain zero bytes and blocks of
+// more than 254 bytes, so every COBS case comes up.
+void test_binary_frames_decode_to_text_lines(void) {
+    char longText[251];
+    memset(longText, 'z', sizeof(longText) - 1);
+    longText[sizeof(longText) - 1] = '\0';
+
+    std::vector<std::string> expected;
+    std::vector<uint32_t> times = {0x00010000, 0x01000001, 0x00000000};
+    for (size_t i = 0; i < times.size(); i++) {
+        nativeMicros = times[i];
+        debugLog.log(i, "tok %u %s\n", (unsigned)i, "x");
+        nativeMicros = times[i];
+        debugLog.printf(i, "%s\n", longText + i * 50);
+    }
+    std::string text = drained();
+    for (size_t pos = 0; pos < text.size();) {
+        size_t end = text.find('\n', pos);
+        expected.push_back(text.substr(pos, end + 1 - pos));
+        pos = end + 1;
+    }
+
+    debugLog.setBinary(true);
+    for (size_t i = 0; i < times.size(); i++) {
+        nativeMicros = times[i];
+        debugLog.log(i, "tok %u %s\n", (unsigned)i, "x");
+        nativeMicros = times[i];
+        debugLog.printf(i, "%s\n", longText + i * 50);
+    }
+    StringPrint out;
+    size_t written = debugLog.drain(out);
+    TEST_ASSERT_EQUAL(out.text.size(), written);
+
+    std::vector<std::string> frames = splitFrames(out.text);
+    TEST_ASSERT_EQUAL(expected.size(), frames.size());
+    for (size_t i = 0; i < frames.size(); i++) {
+        std::string data;
+        TEST_ASSERT_TRUE(cobsDecode(frames[i], data));
+        TEST_ASSERT_GREATER_THAN(5, data.size());
+        TEST_ASSERT_EQUAL_UINT8(DEBUG_FRAME_TEXT, data[0]);
+        uint32_t time;
+        memcpy(&time, data.data() + 1, 4);
+        TEST_ASSERT_EQUAL_UINT32(times[i / 2], time);
+        TEST_ASSERT_EQUAL_STRING(expected[i].c_str(), data.c_str() + 5);
+    }
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_tokenized_arguments_keep_their_types);
+    RUN_TEST(test_mismatched_conversions_print_the_value);
+    RUN_TEST(test_char_conversion);
+    RUN_TEST(test_star_width_and_precision);
+    RUN_TEST(test_spec_too_long_prints_placeholder);
+    RUN_TEST(test_missing_arguments_and_unknown_level);
+    RUN_TEST(test_binary_frames_decode_to_text_lines);
+    return UNITY_END();
+}
@@ -0,0 +1,68 @@
+// Metrics rendered in the Prometheus text format, on the host: families are
+// written once with their labelled members, histogram buckets are
+// cumulative, and the histogram sum adds up the observed values.
+
+#include <unity.h>
+#include <string>
+#include "Metrics.h"
+
+struct StringPrint : Print {
+    std::string text;
+    size_t write(uint8_t c) override {
+        text.push_back((char)c);
+        return 1;
+    }
+};
+
+static const float bounds[] = {0.001f, 0.01f, 0.1f};
+
+MetricsCounter requests("test_requests_total", "Requests", "route=\"/a\"");
+MetricsCounter requestsB("test_requests_total", "Requests", "route=\"/b\"");
+MetricsGauge temperature("test_temperature_celsius", "Temperature");
+MetricsHistogram latency("test_latency_seconds", "Latency", nullptr, bounds, 3);
+
+static std::string rendered(void) {
+    StringPrint out;
+    Metric::writeAll(out);
+    return out.text;
+}
+
+static bool contains(const std::string &text, const char *line) {
+    return text.find(line) != std::string::npos;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_families_are_written_once(void) {
+    requests.inc();
+    requestsB.inc(3);
+    temperature.set(21.5f);
+    std::string text = rendered();
+    TEST_ASSERT_EQUAL_size_t(text.find("# TYPE test_requests_total counter\n"),
+                             text.rfind("# TYPE test_requests_total counter\n"));
+    TEST_ASSERT_TRUE(contains(text, "test_requests_total{route=\"/a\"} 1\n"));
+    TEST_ASSERT_TRUE(contains(text, "test_requests_total{route=\"/b\"} 3\n"));
+    TEST_ASSERT_TRUE(contains(text, "test_temperature_celsius 21.5\n"));
+}
+
+void test_histogram_buckets_sum_and_count(void) {
+    const float values[] = {0.0005f, 0.002f, 0.003f, 0.05f, 2.0f};
+    for (float value : values) latency.observe(value);
+    std::string text = rendered();
+    TEST_ASSERT_TRUE(contains(text, "# TYPE test_latency_seconds histogram\n"));
+    TEST_ASSERT_TRUE(contains(text, "test_latency_seconds_bucket{le=\"0.001\"} 1\n"));
+    TEST_ASSERT_TRUE(contains(text, "test_latency_seconds_bucket{le=\"0.01\"} 3\n"));
+    TEST_ASSERT_TRUE(contains(text, "test_latency_seconds_bucket{le=\"0.1\"} 4\n"));
+    TEST_ASSERT_TRUE(contains(text, "test_latency_seconds_bucket{le=\"+Inf\"} 5\n"));
+    TEST_ASSERT_TRUE(contains(text, "test_latency_seconds_sum 2.0555\n"));
+    TEST_ASSERT_TRUE(contains(text, "test_latency_seconds_count 5\n"));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_families_are_written_once);
+    RUN_TEST(test_histogram_buckets_sum_and_count);
+    return UNITY_END();
+}
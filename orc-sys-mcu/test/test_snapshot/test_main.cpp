@@ -0,0 +1,103 @@
+// Snapshot on the host: updates see the published value, and readers on
+// other threads never see a partial update. On the host there is no spin
+// lock, so there is one writer at a time, as the lock makes it on the device.
+
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "Snapshot.h"
+
+// Large enough that a copy is many stores, every word the same
+struct Block {
+    uint32_t sequence;
+    uint32_t words[1023];
+};
+
+static bool consistent(const Block &block) {
+    for (uint32_t word : block.words) {
+        if (word != block.sequence) return false;
+    }
+    return true;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_update_starts_from_the_published_value(void) {
+    static Snapshot<Block> snapshot;
+    for (uint32_t i = 1; i <= 10; i++) {
+        snapshot.update([](Block &block) {
+            block.sequence++;
+            for (uint32_t &word : block.words) word++;
+        });
+    }
+    Block block = snapshot.read();
+    TEST_ASSERT_EQUAL_UINT32(10, block.sequence);
+    TEST_ASSERT_TRUE(consistent(block));
+}
+
+void test_write_replaces_the_value(void) {
+    static Snapshot<Block> snapshot;
+    Block block;
+    block.sequence = 7;
+    for (uint32_t &word : block.words) word = 7;
+    snapshot.write(block);
+    snapshot.update([](Block &current) { current.sequence = 8; current.words[0] = 8; });
+    Block result = snapshot.read();
+    TEST_ASSERT_EQUAL_UINT32(8, result.sequence);
+    TEST_ASSERT_EQUAL_UINT32(8, result.words[0]);
+    TEST_ASSERT_EQUAL_UINT32(7, result.words[1]);
+}
+
+// A writer alternating update() and write() while readers copy as fast as
+// they can. Each copy must be whole and no older than the one before.
+void test_readers_never_see_a_partial_update(void) {
+    static Snapshot<Block> snapshot;
+    std::atomic<bool> writing{true};
+    std::atomic<uint32_t> bad{0}, reads{0};
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; r++) {
+        readers.emplace_back([&] {
+            uint32_t previous = 0;
+            Block block;
+            while (writing) {
+                snapshot.read(block);
+                if (!consistent(block) || block.sequence < previous) bad++;
+                previous = block.sequence;
+                reads++;
+            }
+        });
+    }
+
+    Block next;
+    for (uint32_t i = 1; i <= 200000; i++) {
+        if (i & 1) {
+            snapshot.update([i](Block &block) {
+                block.sequence = i;
+                for (uint32_t &word : block.words) word = i;
+            });
+        }
+        else {
+            next.sequence = i;
+            for (uint32_t &word : next.words) word = i;
+            snapshot.write(next);
+        }
+    }
+    writing = false;
+    for (auto &reader : readers) reader.join();
+
+    TEST_ASSERT_EQUAL_UINT32(0, bad.load());
+    TEST_ASSERT_GREATER_THAN(0, reads.load());
+    TEST_ASSERT_EQUAL_UINT32(200000, snapshot.read().sequence);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_update_starts_from_the_published_value);
+    RUN_TEST(test_write_replaces_the_value);
+    RUN_TEST(test_readers_never_see_a_partial_update);
+    return UNITY_END();
+}
@@ -0,0 +1,147 @@
+// SystemClock disciplined by a simulated RTC, on the host: the RP2040 timer
+// runs fast or slow against the RTC, the RTC tick is timestamped with some
+// jitter, and the clock has to stay monotonic, learn the frequency error and
+// hold the offset down. Steps only happen where they should.
+
+#include <unity.h>
+#include <math.h>
+#include <random>
+#include <hardware/timer.h>
+#include "SystemClock.h"
+
+static const int64_t EPOCH = 1700000000LL * 1000000;
+static const uint64_t BOOT = 5000000;  // Timer at true time 0
+
+// Timer reading at true time t (µs since the start of the simulation)
+static uint64_t timerAt(double t, double ppm) {
+    return BOOT + (uint64_t)(t * (1 + ppm * 1e-6));
+}
+
+void setUp(void) {
+    nativeMicros = BOOT;
+}
+
+void tearDown(void) {}
+
+void test_invalid_until_set(void) {
+    SystemClock clock;
+    TEST_ASSERT_FALSE(clock.valid());
+    TEST_ASSERT_EQUAL_INT64(0, clock.now());
+    clock.set(EPOCH, BOOT);
+    TEST_ASSERT_TRUE(clock.valid());
+    TEST_ASSERT_EQUAL_UINT32(1, clock.generation());
+    nativeMicros = BOOT + 1500000;
+    TEST_ASSERT_EQUAL_INT64(EPOCH + 1500000, clock.now());
+    TEST_ASSERT_EQUAL_INT64(EPOCH - 1000, clock.at(BOOT - 1000));
+}
+
+void test_stale_reading_is_discarded(void) {
+    SystemClock clock;
+    clock.set(EPOCH, BOOT);
+    uint32_t generation = clock.generation();
+    clock.set(EPOCH + 3600000000LL, BOOT);
+    TEST_ASSERT_FALSE(clock.discipline(EPOCH, BOOT, generation));
+    TEST_ASSERT_EQUAL_UINT32(0, clock.stats().syncs);
+}
+
+void test_large_offset_steps(void) {
+    SystemClock clock;
+    clock.set(EPOCH, BOOT);
+    nativeMicros = BOOT + 1000000;
+    TEST_ASSERT_TRUE(clock.discipline(EPOCH + 1000000, BOOT + 1000000, clock.generation()));  // First after set() steps
+
+    nativeMicros = BOOT + 2000000;
+    TEST_ASSERT_TRUE(clock.discipline(EPOCH + 2000000 + 2 * CLOCK_STEP_THRESHOLD, nativeMicros, clock.generation()));
+    TEST_ASSERT_EQUAL_UINT32(2, clock.stats().steps);
+    TEST_ASSERT_EQUAL_INT64(EPOCH + 2000000 + 2 * CLOCK_STEP_THRESHOLD, clock.now());
+}
+
+// An offset under the step threshold is slewed out rather than stepped:
+// the clock never goes backwards and runs at most CLOCK_MAX_SLEW plus
+// CLOCK_MAX_FREQUENCY off, here as part of the offset is also put down
+// to frequency error
+void test_small_offset_is_slewed(void) {
+    SystemClock clock;
+    clock.set(EPOCH, BOOT);
+    clock.discipline(EPOCH, BOOT, clock.generation());
+
+    int64_t offset = -CLOCK_STEP_THRESHOLD / 2;
+    nativeMicros = BOOT + 64000000;
+    TEST_ASSERT_TRUE(clock.discipline(EPOCH + 64000000 + offset, nativeMicros, clock.generation()));
+    TEST_ASSERT_EQUAL_UINT32(1, clock.stats().steps);  // Only the first, after set()
+    TEST_ASSERT_EQUAL_INT32(offset, clock.stats().offset);
+
+    const int64_t step = 100000;
+    const int64_t maxError = step * (CLOCK_MAX_SLEW + CLOCK_MAX_FREQUENCY) / 1000000000 + 1;
+    int64_t previous = clock.now();
+    uint64_t end = nativeMicros + 2 * (-offset * 1000000000 / CLOCK_MAX_SLEW + CLOCK_SLEW_TIME);
+    int64_t slowest = step;
+    while (nativeMicros < end) {
+        nativeMicros += step;
+        int64_t now = clock.now();
+        TEST_ASSERT_INT64_WITHIN(maxError, step, now - previous);
+        if (now - previous < slowest) slowest = now - previous;
+        previous = now;
+    }
+    TEST_ASSERT_LESS_THAN(step, slowest);  // It did slow down
+}
+
+// A timer off by ppm, synced at growing intervals with ±500 µs jitter on
+// the tick timestamp, as the RTC task does
+static void runDiscipline(double ppm) {
+    SystemClock clock;
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> jitter(-500, 500);
+
+    nativeMicros = timerAt(0, ppm);
+    clock.set(EPOCH - 300000, nativeMicros);  // Read from the RTC without waiting for a tick
+    double t = 700000;
+    int interval = 16;
+    int64_t previous = 0;
+    double worst = 0;
+    for (int sync = 0; sync < 60; sync++) {
+        nativeMicros = timerAt(t, ppm);
+        clock.discipline(EPOCH + (int64_t)t, nativeMicros + jitter(rng), clock.generation());
+        double next = t + interval * 1e6;
+        for (double u = t; u < next; u += 100000) {
+            nativeMicros = timerAt(u, ppm);
+            int64_t now = clock.now();
+            TEST_ASSERT_GREATER_OR_EQUAL(previous, now);
+            previous = now;
+            if (sync > 10) worst = fmax(worst, fabs((double)(now - (EPOCH + (int64_t)u))));
+        }
+        t = next;
+        if (interval < 64) interval *= 2;
+    }
+
+    ClockStats stats = clock.stats();
+    TEST_ASSERT_EQUAL_UINT32(60, stats.syncs);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.steps);  // The first, after set()
+    // The timer runs ppm fast, so the correction is about -ppm
+    TEST_ASSERT_INT32_WITHIN(5000, (int32_t)(-ppm * 1000), stats.frequency);
+    TEST_ASSERT_LESS_THAN(2000, worst);
+}
+
+void test_discipline_fast_timer(void) {
+    runDiscipline(100);
+}
+
+void test_discipline_slow_timer(void) {
+    runDiscipline(-250);
+}
+
+void test_discipline_accurate_timer(void) {
+    runDiscipline(20);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_invalid_until_set);
+    RUN_TEST(test_stale_reading_is_discarded);
+    RUN_TEST(test_large_offset_steps);
+    RUN_TEST(test_small_offset_is_slewed);
+    RUN_TEST(test_discipline_fast_timer);
+    RUN_TEST(test_discipline_slow_timer);
+    RUN_TEST(test_discipline_accurate_timer);
+    return UNITY_END();
+}